@@ -8,6 +8,11 @@ See www.cartotype.com for more information.
 #define CARTOTYPE_CACHE_H__
 
 #include "cartotype_list.h"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace CartoType
 {
@@ -85,6 +90,417 @@ template<class TCached,class TKey> class CCache
     size_t iMaxSize { 0 };
     };
 
+/** The policy used to choose which items to evict from a CHashCache. */
+enum class TCachePolicy
+    {
+    /** Evict the least recently used item. */
+    LRU,
+    /**
+    Evict the least recently added item that has not been used since it was added or last passed over:
+    the CLOCK approximation to LRU, which does not reorder the items when they are found.
+    */
+    Clock,
+    /**
+    Greedy dual size frequency: evict the item with the lowest priority, where the priority is the number of uses divided by the size,
+    plus an inflation value which is raised to the priority of each evicted item, so that items which are no longer used age out.
+    Favours small, frequently used items.
+    */
+    GDSF
+    };
+
+/** Counters describing the use of a cache. */
+class TCacheCounters
+    {
+    public:
+    /** Return the proportion of lookups which found an item, or zero if there have been no lookups. */
+    double HitRate() const { return iHitCount + iMissCount ? double(iHitCount) / double(iHitCount + iMissCount) : 0; }
+
+    TCacheCounters& operator+=(const TCacheCounters& aOther)
+        {
+        iHitCount += aOther.iHitCount;
+        iMissCount += aOther.iMissCount;
+        iEvictionCount += aOther.iEvictionCount;
+        iItemCount += aOther.iItemCount;
+        iSize += aOther.iSize;
+        iMaxSize += aOther.iMaxSize;
+        return *this;
+        }
+
+    /** The number of lookups which found an item. */
+    size_t iHitCount = 0;
+    /** The number of lookups which did not find an item. */
+    size_t iMissCount = 0;
+    /** The number of items discarded to keep the cache within its maximum size. */
+    size_t iEvictionCount = 0;
+    /** The number of items in the cache. */
+    size_t iItemCount = 0;
+    /** The total size of the items in the cache. */
+    size_t iSize = 0;
+    /** The maximum total size of the items. */
+    size_t iMaxSize = 0;
+    };
+
+/**
+A cache for objects of type TCached with a key of type TKey, with hashed lookup.
+Objects must have a Key function to return the key,
+and keys must be comparable for equality and hashable using THash. They must also have a Size function
+to return their size in arbitrary units, so that a maximum size can be enforced.
+
+The items are held in a hash table whose nodes also form an intrusive list in order of use or addition,
+so that finding, adding and evicting an item all take constant time, except for GDSF eviction, which uses a heap.
+
+The cache can be divided into shards, each holding the items whose keys hash to it and protected by its own mutex,
+so that threads using different shards do not contend. The maximum size is divided equally between the shards.
+Pointers returned by Find remain valid only until the item is evicted, so threads sharing a cache should use FindShared.
+*/
+template<class TCached,class TKey,class THash = std::hash<TKey>> class CHashCache
+    {
+    public:
+    explicit CHashCache(size_t aMaxSize,TCachePolicy aPolicy = TCachePolicy::LRU,size_t aShardCount = 1,const THash& aHash = THash()):
+        iShard(std::max(size_t(1),aShardCount)),
+        iMaxSize(aMaxSize),
+        iPolicy(aPolicy),
+        iHash(aHash)
+        {
+        for (auto& s : iShard)
+            s.iMaxSize = aMaxSize / iShard.size();
+        }
+
+    CHashCache(const CHashCache&) = delete;
+    CHashCache& operator=(const CHashCache&) = delete;
+
+    ~CHashCache()
+        {
+        for (auto& s : iShard)
+            s.Clear();
+        }
+
+    /** Return the item with the key aKey, or null if it is not in the cache, and mark it as used. */
+    TCached* Find(const TKey& aKey)
+        {
+        const size_t hash_value = iHash(aKey);
+        TShard& s = Shard(hash_value);
+        std::lock_guard<std::mutex> lock(s.iMutex);
+        TNode* n = s.Find(aKey,hash_value,iPolicy);
+        return n ? n->iItem.get() : nullptr;
+        }
+
+    /** Return a shared pointer to the item with the key aKey, or null if it is not in the cache, and mark it as used. */
+    std::shared_ptr<TCached> FindShared(const TKey& aKey)
+        {
+        const size_t hash_value = iHash(aKey);
+        TShard& s = Shard(hash_value);
+        std::lock_guard<std::mutex> lock(s.iMutex);
+        TNode* n = s.Find(aKey,hash_value,iPolicy);
+        return n ? n->iItem : nullptr;
+        }
+
+    /**
+    Add an item, taking ownership of it, replacing any item with the same key, and evicting other items if necessary.
+    The cache always holds at least the item most recently added to each shard.
+    */
+    void Add(TCached* aItem)
+        {
+        Add(std::shared_ptr<TCached>(aItem));
+        }
+
+    /** Add a shared item. */
+    void Add(std::shared_ptr<TCached> aItem)
+        {
+        assert(aItem->Size() >= 0);
+        TKey key = aItem->Key();
+        const size_t hash_value = iHash(key);
+        TShard& s = Shard(hash_value);
+        std::lock_guard<std::mutex> lock(s.iMutex);
+        s.Add(key,std::move(aItem),hash_value,iPolicy);
+        }
+
+    void Clear()
+        {
+        for (auto& s : iShard)
+            {
+            std::lock_guard<std::mutex> lock(s.iMutex);
+            s.Clear();
+            }
+        }
+
+    void SetMaxSize(size_t aMaxSize)
+        {
+        iMaxSize = aMaxSize;
+        for (auto& s : iShard)
+            {
+            std::lock_guard<std::mutex> lock(s.iMutex);
+            s.iMaxSize = aMaxSize / iShard.size();
+            s.Trim(0,iPolicy);
+            }
+        }
+
+    /** Return the counters summed over all the shards. */
+    TCacheCounters Counters() const
+        {
+        TCacheCounters counters;
+        for (auto& s : iShard)
+            {
+            std::lock_guard<std::mutex> lock(s.iMutex);
+            counters += s.iCounters;
+            counters.iMaxSize += s.iMaxSize;
+            }
+        return counters;
+        }
+
+    private:
+    class TNode
+        {
+        public:
+        std::shared_ptr<TCached> iItem;
+        TKey iKey;
+        size_t iHashValue;
+        size_t iSize;
+        TNode* iHashNext = nullptr;
+        TNode* iPrev = nullptr; // towards the most recently used or added item
+        TNode* iNext = nullptr; // towards the next item to be evicted
+        size_t iHeapIndex = 0;
+        double iPriority = 0;
+        uint32 iUseCount = 1;
+        bool iReferenced = false;
+        };
+
+    class TShard
+        {
+        public:
+        TNode* Find(const TKey& aKey,size_t aHashValue,TCachePolicy aPolicy)
+            {
+            TNode* n = nullptr;
+            if (!iBucket.empty())
+                {
+                n = iBucket[aHashValue & (iBucket.size() - 1)];
+                while (n && !(n->iKey == aKey))
+                    n = n->iHashNext;
+                }
+            if (!n)
+                {
+                iCounters.iMissCount++;
+                return nullptr;
+                }
+            iCounters.iHitCount++;
+            switch (aPolicy)
+                {
+                case TCachePolicy::LRU: Unlink(n); LinkFirst(n); break;
+                case TCachePolicy::Clock: n->iReferenced = true; break;
+                case TCachePolicy::GDSF: n->iUseCount++; n->iPriority = Priority(*n); SiftDown(n->iHeapIndex); break;
+                }
+            return n;
+            }
+
+        void Add(const TKey& aKey,std::shared_ptr<TCached> aItem,size_t aHashValue,TCachePolicy aPolicy)
+            {
+            if (!iBucket.empty())
+                {
+                TNode** p = &iBucket[aHashValue & (iBucket.size() - 1)];
+                while (*p && !((*p)->iKey == aKey))
+                    p = &(*p)->iHashNext;
+                if (*p)
+                    Remove(*p,aPolicy);
+                }
+
+            const size_t size = size_t(aItem->Size());
+            Trim(size,aPolicy);
+
+            TNode* n = new TNode { std::move(aItem),aKey,aHashValue,size };
+            if (iCounters.iItemCount + 1 > iBucket.size())
+                Rehash(std::max(size_t(16),iBucket.size() * 2));
+            TNode*& bucket = iBucket[aHashValue & (iBucket.size() - 1)];
+            n->iHashNext = bucket;
+            bucket = n;
+            LinkFirst(n);
+            if (aPolicy == TCachePolicy::GDSF)
+                {
+                n->iPriority = Priority(*n);
+                n->iHeapIndex = iHeap.size();
+                iHeap.push_back(n);
+                SiftUp(n->iHeapIndex);
+                }
+            iCounters.iItemCount++;
+            iCounters.iSize += size;
+            }
+
+        // Evict items until an item of aSize can be added without exceeding the maximum size, or until the shard is empty.
+        void Trim(size_t aSize,TCachePolicy aPolicy)
+            {
+            while (iCounters.iSize + aSize > iMaxSize && iLast)
+                {
+                TNode* victim = nullptr;
+                switch (aPolicy)
+                    {
+                    case TCachePolicy::LRU:
+                        victim = iLast;
+                        break;
+
+                    case TCachePolicy::Clock:
+                        // Give referenced items a second chance; this terminates because references are cleared as the hand passes.
+                        while (iLast->iReferenced)
+                            {
+                            TNode* n = iLast;
+                            n->iReferenced = false;
+                            Unlink(n);
+                            LinkFirst(n);
+                            }
+                        victim = iLast;
+                        break;
+
+                    case TCachePolicy::GDSF:
+                        victim = iHeap.front();
+                        iInflation = victim->iPriority;
+                        break;
+                    }
+                Remove(victim,aPolicy);
+                iCounters.iEvictionCount++;
+                }
+            }
+
+        void Clear()
+            {
+            for (TNode* n = iFirst; n; )
+                {
+                TNode* next = n->iNext;
+                delete n;
+                n = next;
+                }
+            iFirst = iLast = nullptr;
+            iBucket.clear();
+            iHeap.clear();
+            iInflation = 0;
+            iCounters.iItemCount = 0;
+            iCounters.iSize = 0;
+            }
+
+        mutable std::mutex iMutex;
+        size_t iMaxSize = 0;
+        TCacheCounters iCounters;
+
+        private:
+        double Priority(const TNode& aNode) const
+            {
+            return iInflation + double(aNode.iUseCount) / double(std::max(size_t(1),aNode.iSize));
+            }
+
+        void LinkFirst(TNode* aNode)
+            {
+            aNode->iPrev = nullptr;
+            aNode->iNext = iFirst;
+            if (iFirst)
+                iFirst->iPrev = aNode;
+            else
+                iLast = aNode;
+            iFirst = aNode;
+            }
+
+        void Unlink(TNode* aNode)
+            {
+            if (aNode->iPrev)
+                aNode->iPrev->iNext = aNode->iNext;
+            else
+                iFirst = aNode->iNext;
+            if (aNode->iNext)
+                aNode->iNext->iPrev = aNode->iPrev;
+            else
+                iLast = aNode->iPrev;
+            }
+
+        void Remove(TNode* aNode,TCachePolicy aPolicy)
+            {
+            TNode** p = &iBucket[aNode->iHashValue & (iBucket.size() - 1)];
+            while (*p != aNode)
+                p = &(*p)->iHashNext;
+            *p = aNode->iHashNext;
+            Unlink(aNode);
+            if (aPolicy == TCachePolicy::GDSF)
+                {
+                size_t i = aNode->iHeapIndex;
+                iHeap[i] = iHeap.back();
+                iHeap[i]->iHeapIndex = i;
+                iHeap.pop_back();
+                if (i < iHeap.size())
+                    {
+                    SiftUp(i);
+                    SiftDown(iHeap[i]->iHeapIndex);
+                    }
+                }
+            iCounters.iItemCount--;
+            iCounters.iSize -= aNode->iSize;
+            delete aNode;
+            }
+
+        void Rehash(size_t aBucketCount)
+            {
+            std::vector<TNode*> bucket(aBucketCount);
+            for (TNode* n = iFirst; n; n = n->iNext)
+                {
+                TNode*& b = bucket[n->iHashValue & (aBucketCount - 1)];
+                n->iHashNext = b;
+                b = n;
+                }
+            iBucket.swap(bucket);
+            }
+
+        void SiftUp(size_t aIndex)
+            {
+            while (aIndex > 0)
+                {
+                size_t parent = (aIndex - 1) / 2;
+                if (iHeap[parent]->iPriority <= iHeap[aIndex]->iPriority)
+                    break;
+                Swap(parent,aIndex);
+                aIndex = parent;
+                }
+            }
+
+        void SiftDown(size_t aIndex)
+            {
+            for (;;)
+                {
+                size_t least = aIndex;
+                size_t child = aIndex * 2 + 1;
+                if (child < iHeap.size() && iHeap[child]->iPriority < iHeap[least]->iPriority)
+                    least = child;
+                if (child + 1 < iHeap.size() && iHeap[child + 1]->iPriority < iHeap[least]->iPriority)
+                    least = child + 1;
+                if (least == aIndex)
+                    break;
+                Swap(least,aIndex);
+                aIndex = least;
+                }
+            }
+
+        void Swap(size_t aA,size_t aB)
+            {
+            std::swap(iHeap[aA],iHeap[aB]);
+            iHeap[aA]->iHeapIndex = aA;
+            iHeap[aB]->iHeapIndex = aB;
+            }
+
+        std::vector<TNode*> iBucket; // a power of two in size
+        TNode* iFirst = nullptr;
+        TNode* iLast = nullptr;
+        std::vector<TNode*> iHeap; // a min-heap on priority, used by GDSF
+        double iInflation = 0;
+        };
+
+    TShard& Shard(size_t aHashValue)
+        {
+        if (iShard.size() == 1)
+            return iShard[0];
+        // Use the high bits of a remixed hash so that the shard does not depend on the bits that select the bucket.
+        uint64 h = uint64(aHashValue) * 0x9E3779B97F4A7C15ULL;
+        return iShard[size_t((h >> 32) % iShard.size())];
+        }
+
+    std::vector<TShard> iShard;
+    size_t iMaxSize;
+    TCachePolicy iPolicy;
+    THash iHash;
+    };
+
 }
 
 #endif
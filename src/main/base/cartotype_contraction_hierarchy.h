@@ -0,0 +1,587 @@
+/*
+CARTOTYPE_CONTRACTION_HIERARCHY.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_CONTRACTION_HIERARCHY_H__
+#define CARTOTYPE_CONTRACTION_HIERARCHY_H__
+
+#include <cartotype_graph.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace CartoType
+{
+
+/** A value used for a missing node or arc in a customizable contraction hierarchy. */
+constexpr uint32 KNoContractionHierarchyItem = UINT32_MAX;
+
+/**
+The costs of the arcs of a CCustomizableContractionHierarchy for a particular route profile.
+Each arc joins a lower-ranked node to a higher-ranked one and has a cost in each direction.
+UINT32_MAX means that the arc cannot be used in that direction.
+*/
+class CContractionHierarchyMetric
+    {
+    public:
+    /** Make every arc unusable in both directions, ready for the original arc costs to be set. */
+    void Init(size_t aArcCount)
+        {
+        iUpCost.assign(aArcCount,UINT32_MAX);
+        iDownCost.assign(aArcCount,UINT32_MAX);
+        iUpMiddle.assign(aArcCount,KNoContractionHierarchyItem);
+        iDownMiddle.assign(aArcCount,KNoContractionHierarchyItem);
+        }
+
+    /** The cost of each arc going from its lower to its higher node. */
+    std::vector<uint32> iUpCost;
+    /** The cost of each arc going from its higher to its lower node. */
+    std::vector<uint32> iDownCost;
+    /** The middle node of each upward shortcut, or KNoContractionHierarchyItem if the best upward cost is that of an original arc. */
+    std::vector<uint32> iUpMiddle;
+    /** The middle node of each downward shortcut, or KNoContractionHierarchyItem if the best downward cost is that of an original arc. */
+    std::vector<uint32> iDownMiddle;
+    };
+
+/**
+A customizable contraction hierarchy: the metric-independent part of a contraction hierarchy,
+consisting of a node order and the arcs, including shortcuts, that contracting the nodes in that order creates
+regardless of arc costs. It is created once for a map and does not depend on any route profile.
+
+A route profile is applied by customization, which fills a CContractionHierarchyMetric
+with the original arc costs, then calculates the costs of all the shortcuts
+by visiting the lower triangles of each arc. Customization takes time linear in the number of triangles
+and is run in parallel: the arcs are grouped in levels of the elimination tree and the arcs in a level
+depend only on arcs in lower levels.
+After changes to the costs of a few arcs, for example from traffic information,
+CustomizePartially recalculates only the arcs affected.
+
+Nodes are identified by their rank in the contraction order, from 0 upwards.
+*/
+class CCustomizableContractionHierarchy
+    {
+    public:
+    /**
+    Create a customizable contraction hierarchy with aNodeCount nodes, numbered in contraction order,
+    from the undirected edges of the road graph, adding the shortcuts needed to make the graph chordal.
+    Any order gives correct routes, but the hierarchy is small and fast only if the order is a good one, such as that returned by NodeOrder.
+    Duplicate edges and loops are ignored.
+    */
+    CCustomizableContractionHierarchy(uint32 aNodeCount,const std::vector<std::pair<uint32,uint32>>& aEdge)
+        {
+        std::vector<std::vector<uint32>> up(aNodeCount);
+        for (const auto& e : aEdge)
+            {
+            if (e.first == e.second)
+                continue;
+            assert(e.first < aNodeCount && e.second < aNodeCount);
+            if (e.first < e.second)
+                up[e.first].push_back(e.second);
+            else
+                up[e.second].push_back(e.first);
+            }
+
+        // Contract nodes in order. Joining the lowest upper neighbour to the others is enough, because it will pass them on when it is contracted.
+        for (uint32 v = 0; v < aNodeCount; v++)
+            {
+            auto& n = up[v];
+            std::sort(n.begin(),n.end());
+            n.erase(std::unique(n.begin(),n.end()),n.end());
+            if (n.size() > 1)
+                up[n[0]].insert(up[n[0]].end(),n.begin() + 1,n.end());
+            }
+
+        iUpFirst.resize(size_t(aNodeCount) + 1);
+        for (uint32 v = 0; v < aNodeCount; v++)
+            {
+            iUpFirst[v] = uint32(iUpHead.size());
+            iUpHead.insert(iUpHead.end(),up[v].begin(),up[v].end());
+            }
+        iUpFirst[aNodeCount] = uint32(iUpHead.size());
+        std::vector<std::vector<uint32>>().swap(up);
+
+        // Create the downward index, with the arcs into each node sorted by their lower node.
+        iDownFirst.assign(size_t(aNodeCount) + 1,0);
+        for (uint32 head : iUpHead)
+            iDownFirst[head + 1]++;
+        for (uint32 v = 0; v < aNodeCount; v++)
+            iDownFirst[v + 1] += iDownFirst[v];
+        iDownTail.resize(iUpHead.size());
+        iDownArc.resize(iUpHead.size());
+        std::vector<uint32> fill(iDownFirst.begin(),iDownFirst.end() - 1);
+        for (uint32 v = 0; v < aNodeCount; v++)
+            {
+            for (uint32 a = iUpFirst[v]; a < iUpFirst[v + 1]; a++)
+                {
+                uint32 i = fill[iUpHead[a]]++;
+                iDownTail[i] = v;
+                iDownArc[i] = a;
+                }
+            }
+
+        // Group the nodes into levels: each node is one level above the highest of its lower neighbours.
+        std::vector<uint32> level(aNodeCount,0);
+        uint32 level_count = aNodeCount ? 1 : 0;
+        for (uint32 v = 0; v < aNodeCount; v++)
+            {
+            for (uint32 i = iDownFirst[v]; i < iDownFirst[v + 1]; i++)
+                level[v] = std::max(level[v],level[iDownTail[i]] + 1);
+            level_count = std::max(level_count,level[v] + 1);
+            }
+        iLevelFirst.assign(size_t(level_count) + 1,0);
+        for (uint32 v = 0; v < aNodeCount; v++)
+            iLevelFirst[level[v] + 1]++;
+        for (uint32 l = 0; l < level_count; l++)
+            iLevelFirst[l + 1] += iLevelFirst[l];
+        iLevelNode.resize(aNodeCount);
+        fill.assign(iLevelFirst.begin(),iLevelFirst.end() - 1);
+        for (uint32 v = 0; v < aNodeCount; v++)
+            iLevelNode[fill[level[v]]++] = v;
+        }
+
+    /**
+    Return a contraction order for a graph with nodes at the points in aPosition, which may use any planar coordinates such as map coordinates,
+    and the undirected edges aEdge. The order is returned as the rank of each node, and the nodes must be renumbered by rank before the hierarchy is created.
+
+    The order is found by nested dissection, using the positions to find small separators. The nodes are split at the median
+    along the longer side of their bounding box. The nodes on one side of the split which have neighbours on the other side,
+    taking the side with fewer of them, form a separator, which is ranked above the two parts, and each part is split in the same way.
+    The order depends only on the graph, not on any arc costs, so it serves for every route profile.
+    */
+    static std::vector<uint32> NodeOrder(const std::vector<TPoint>& aPosition,const std::vector<std::pair<uint32,uint32>>& aEdge)
+        {
+        const uint32 node_count = uint32(aPosition.size());
+        TDissection d { aPosition };
+        d.iFirst.assign(size_t(node_count) + 1,0);
+        for (const auto& e : aEdge)
+            {
+            if (e.first == e.second)
+                continue;
+            assert(e.first < node_count && e.second < node_count);
+            d.iFirst[e.first + 1]++;
+            d.iFirst[e.second + 1]++;
+            }
+        for (uint32 v = 0; v < node_count; v++)
+            d.iFirst[v + 1] += d.iFirst[v];
+        d.iNeighbour.resize(d.iFirst[node_count]);
+        std::vector<uint32> fill(d.iFirst.begin(),d.iFirst.end() - 1);
+        for (const auto& e : aEdge)
+            {
+            if (e.first == e.second)
+                continue;
+            d.iNeighbour[fill[e.first]++] = e.second;
+            d.iNeighbour[fill[e.second]++] = e.first;
+            }
+        d.iRank.resize(node_count);
+        d.iMark.assign(node_count,0);
+        d.iNextRank = node_count;
+        std::vector<uint32> node(node_count);
+        for (uint32 v = 0; v < node_count; v++)
+            node[v] = v;
+        Dissect(d,node);
+        return std::move(d.iRank);
+        }
+
+    uint32 NodeCount() const { return uint32(iUpFirst.size() - 1); }
+    uint32 ArcCount() const { return uint32(iUpHead.size()); }
+    uint32 LevelCount() const { return uint32(iLevelFirst.size() - 1); }
+    /** Return the first arc going upwards from a node. */
+    uint32 UpArcBegin(uint32 aNode) const { return iUpFirst[aNode]; }
+    /** Return the end of the range of arcs going upwards from a node. */
+    uint32 UpArcEnd(uint32 aNode) const { return iUpFirst[aNode + 1]; }
+    /** Return the higher node of an arc. */
+    uint32 ArcHead(uint32 aArc) const { return iUpHead[aArc]; }
+    /** Return the lower node of an arc. */
+    uint32 ArcTail(uint32 aArc) const { return uint32(std::upper_bound(iUpFirst.begin(),iUpFirst.end(),aArc) - iUpFirst.begin()) - 1; }
+
+    /** Return the arc joining two nodes, in either order, or KNoContractionHierarchyItem if there is none. */
+    uint32 FindArc(uint32 aNode1,uint32 aNode2) const
+        {
+        if (aNode1 > aNode2)
+            std::swap(aNode1,aNode2);
+        auto begin = iUpHead.begin() + iUpFirst[aNode1];
+        auto end = iUpHead.begin() + iUpFirst[aNode1 + 1];
+        auto p = std::lower_bound(begin,end,aNode2);
+        if (p == end || *p != aNode2)
+            return KNoContractionHierarchyItem;
+        return uint32(p - iUpHead.begin());
+        }
+
+    /** Set the cost of the original arc going from aFrom to aTo in a metric, keeping the lower cost if it is already set. */
+    void SetArcCost(CContractionHierarchyMetric& aMetric,uint32 aFrom,uint32 aTo,uint32 aCost) const
+        {
+        uint32 a = FindArc(aFrom,aTo);
+        assert(a != KNoContractionHierarchyItem);
+        uint32& c = aFrom < aTo ? aMetric.iUpCost[a] : aMetric.iDownCost[a];
+        if (aCost < c)
+            c = aCost;
+        }
+
+    /**
+    Calculate the costs of all the shortcuts in aMetric, which must already contain the costs of the original arcs,
+    using up to aThreadCount threads. A thread count of zero uses the number of hardware threads.
+    */
+    void Customize(CContractionHierarchyMetric& aMetric,size_t aThreadCount = 0) const
+        {
+        assert(aMetric.iUpCost.size() == ArcCount() && aMetric.iDownCost.size() == ArcCount());
+        aMetric.iUpMiddle.assign(ArcCount(),KNoContractionHierarchyItem);
+        aMetric.iDownMiddle.assign(ArcCount(),KNoContractionHierarchyItem);
+
+        if (aThreadCount == 0)
+            aThreadCount = std::max(1U,std::thread::hardware_concurrency());
+        if (aThreadCount == 1 || ArcCount() < KMinArcsPerThread * 2)
+            {
+            for (uint32 v : iLevelNode)
+                CustomizeNode(aMetric,v);
+            return;
+            }
+
+        const uint32 level_count = LevelCount();
+        std::vector<std::atomic<uint32>> next(level_count);
+        for (uint32 l = 0; l < level_count; l++)
+            next[l].store(iLevelFirst[l]);
+        TBarrier barrier(aThreadCount);
+
+        auto worker = [&]()
+            {
+            for (uint32 l = 0; l < level_count; l++)
+                {
+                const uint32 end = iLevelFirst[l + 1];
+                for (;;)
+                    {
+                    uint32 i = next[l].fetch_add(KNodesPerTask);
+                    if (i >= end)
+                        break;
+                    uint32 task_end = std::min(end,i + KNodesPerTask);
+                    for (; i < task_end; i++)
+                        CustomizeNode(aMetric,iLevelNode[i]);
+                    }
+                barrier.Wait();
+                }
+            };
+
+        std::vector<std::thread> thread;
+        for (size_t i = 1; i < aThreadCount; i++)
+            thread.emplace_back(worker);
+        worker();
+        for (auto& t : thread)
+            t.join();
+        }
+
+    /**
+    Update aMetric, which must have been customized from the original arc costs in aInput, after the original costs
+    of the arcs in aChangedArc have been changed in aInput. Only those arcs and the shortcuts depending on them are recalculated,
+    in order of their lower nodes, so that the time taken depends on the number of changes rather than on the size of the graph.
+    Returns the number of arcs recalculated.
+    */
+    size_t CustomizePartially(CContractionHierarchyMetric& aMetric,const CContractionHierarchyMetric& aInput,const std::vector<uint32>& aChangedArc) const
+        {
+        assert(aInput.iUpCost.size() == ArcCount() && aInput.iDownCost.size() == ArcCount());
+        std::vector<std::pair<uint32,uint32>> queue; // (lower node, arc) as a min-heap
+        std::unordered_set<uint32> queued;
+        auto push = [&](uint32 aLowerNode,uint32 aArc)
+            {
+            if (queued.insert(aArc).second)
+                {
+                queue.emplace_back(aLowerNode,aArc);
+                std::push_heap(queue.begin(),queue.end(),std::greater<std::pair<uint32,uint32>>());
+                }
+            };
+        for (uint32 a : aChangedArc)
+            push(ArcTail(a),a);
+
+        size_t recalculated = 0;
+        while (!queue.empty())
+            {
+            std::pop_heap(queue.begin(),queue.end(),std::greater<std::pair<uint32,uint32>>());
+            const uint32 u = queue.back().first;
+            const uint32 a = queue.back().second;
+            queue.pop_back();
+            recalculated++;
+            const uint32 old_up = aMetric.iUpCost[a];
+            const uint32 old_down = aMetric.iDownCost[a];
+            if (!CustomizeArc(aMetric,u,a,aInput.iUpCost[a],aInput.iDownCost[a]))
+                continue;
+            const bool increased = aMetric.iUpCost[a] > old_up || aMetric.iDownCost[a] > old_down;
+
+            /*
+            The arc (u,w) is a lower arc of the triangle (u,w,x) for every other upper neighbour x of u.
+            The arc (w,x) must be recalculated if its best cost went through u and a cost of (u,w) increased,
+            or if a path through u is now cheaper.
+            */
+            const uint32 w = iUpHead[a];
+            for (uint32 b = iUpFirst[u]; b < iUpFirst[u + 1]; b++)
+                {
+                const uint32 x = iUpHead[b];
+                if (x == w)
+                    continue;
+                const uint32 c = FindArc(w,x);
+                bool update = increased && (aMetric.iUpMiddle[c] == u || aMetric.iDownMiddle[c] == u);
+                if (!update)
+                    {
+                    uint64 w_to_x = uint64(aMetric.iDownCost[a]) + aMetric.iUpCost[b];
+                    uint64 x_to_w = uint64(aMetric.iDownCost[b]) + aMetric.iUpCost[a];
+                    if (w > x)
+                        std::swap(w_to_x,x_to_w);
+                    update = w_to_x < aMetric.iUpCost[c] || x_to_w < aMetric.iDownCost[c];
+                    }
+                if (update)
+                    push(std::min(w,x),c);
+                }
+            }
+        return recalculated;
+        }
+
+    /**
+    Append to aPath the nodes after aFrom on the best path from aFrom to aTo, which must be joined by an arc,
+    replacing shortcuts by the original arcs they represent.
+    */
+    void Unpack(const CContractionHierarchyMetric& aMetric,uint32 aFrom,uint32 aTo,std::vector<uint32>& aPath) const
+        {
+        uint32 a = FindArc(aFrom,aTo);
+        assert(a != KNoContractionHierarchyItem);
+        uint32 middle = aFrom < aTo ? aMetric.iUpMiddle[a] : aMetric.iDownMiddle[a];
+        if (middle == KNoContractionHierarchyItem)
+            aPath.push_back(aTo);
+        else
+            {
+            Unpack(aMetric,aFrom,middle,aPath);
+            Unpack(aMetric,middle,aTo,aPath);
+            }
+        }
+
+    private:
+    static constexpr uint32 KNodesPerTask = 64;
+    static constexpr uint32 KMinArcsPerThread = 4096;
+    static constexpr size_t KMaxDissectionLeafSize = 16;
+
+    // The state of the nested dissection used by NodeOrder.
+    class TDissection
+        {
+        public:
+        const std::vector<TPoint>& iPosition;
+        std::vector<uint32> iFirst;      // the index of the first neighbour of each node in iNeighbour
+        std::vector<uint32> iNeighbour;
+        std::vector<uint32> iRank;
+        std::vector<uint32> iMark;       // the side of the current split each node is on
+        uint32 iNextRank = 0;            // ranks are assigned downwards, so separators rank above the parts they separate
+        uint32 iStamp = 0;
+        };
+
+    // Rank aNode, a set of nodes not yet ranked, by splitting it into two parts and a separator and ranking the separator highest.
+    static void Dissect(TDissection& aD,std::vector<uint32>& aNode)
+        {
+        if (aNode.size() <= KMaxDissectionLeafSize)
+            {
+            for (uint32 v : aNode)
+                aD.iRank[v] = --aD.iNextRank;
+            return;
+            }
+
+        int64 min_x = INT64_MAX, min_y = INT64_MAX, max_x = INT64_MIN, max_y = INT64_MIN;
+        for (uint32 v : aNode)
+            {
+            const TPoint& p = aD.iPosition[v];
+            min_x = std::min(min_x,int64(p.iX));
+            max_x = std::max(max_x,int64(p.iX));
+            min_y = std::min(min_y,int64(p.iY));
+            max_y = std::max(max_y,int64(p.iY));
+            }
+        const bool split_x = max_x - min_x >= max_y - min_y;
+        const auto middle = aNode.begin() + aNode.size() / 2;
+        std::nth_element(aNode.begin(),middle,aNode.end(),[&aD,split_x](uint32 aA,uint32 aB)
+            {
+            const TPoint& a = aD.iPosition[aA];
+            const TPoint& b = aD.iPosition[aB];
+            const int32 ca = split_x ? a.iX : a.iY;
+            const int32 cb = split_x ? b.iX : b.iY;
+            return ca < cb || (ca == cb && aA < aB);
+            });
+
+        // Mark the two sides, then find the nodes on each side with neighbours on the other.
+        const uint32 first_side = aD.iStamp += 2;
+        for (auto p = aNode.begin(); p != aNode.end(); ++p)
+            aD.iMark[*p] = p < middle ? first_side : first_side + 1;
+        std::vector<uint32> boundary[2];
+        for (uint32 v : aNode)
+            {
+            const uint32 other_side = aD.iMark[v] == first_side ? first_side + 1 : first_side;
+            for (uint32 i = aD.iFirst[v]; i < aD.iFirst[v + 1]; i++)
+                if (aD.iMark[aD.iNeighbour[i]] == other_side)
+                    {
+                    boundary[aD.iMark[v] - first_side].push_back(v);
+                    break;
+                    }
+            }
+        for (uint32 v : boundary[boundary[1].size() < boundary[0].size() ? 1 : 0])
+            {
+            aD.iRank[v] = --aD.iNextRank;
+            aD.iMark[v] = 0;
+            }
+
+        std::vector<uint32> part[2];
+        for (uint32 v : aNode)
+            if (aD.iMark[v])
+                part[aD.iMark[v] - first_side].push_back(v);
+        std::vector<uint32>().swap(aNode);
+        Dissect(aD,part[0]);
+        Dissect(aD,part[1]);
+        }
+
+    class TBarrier
+        {
+        public:
+        explicit TBarrier(size_t aCount): iCount(aCount) { }
+        void Wait()
+            {
+            std::unique_lock<std::mutex> lock(iMutex);
+            size_t generation = iGeneration;
+            if (++iWaiting == iCount)
+                {
+                iWaiting = 0;
+                iGeneration++;
+                iCondition.notify_all();
+                }
+            else
+                iCondition.wait(lock,[&] { return generation != iGeneration; });
+            }
+
+        private:
+        std::mutex iMutex;
+        std::condition_variable iCondition;
+        size_t iCount;
+        size_t iWaiting = 0;
+        size_t iGeneration = 0;
+        };
+
+    // Relax every upward arc (u,w) from aNode = u through its lower triangles (v,u,w), where v is below u.
+    void CustomizeNode(CContractionHierarchyMetric& aMetric,uint32 aNode) const
+        {
+        for (uint32 a = iUpFirst[aNode]; a < iUpFirst[aNode + 1]; a++)
+            CustomizeArc(aMetric,aNode,a,aMetric.iUpCost[a],aMetric.iDownCost[a]);
+        }
+
+    // Set the costs of the arc aArc from aNode = u to w to the lowest of the original costs and the costs through its lower triangles (v,u,w).
+    // Return true if either cost changed.
+    bool CustomizeArc(CContractionHierarchyMetric& aMetric,uint32 aNode,uint32 aArc,uint32 aUpCost,uint32 aDownCost) const
+        {
+        const uint32 u = aNode;
+        const uint32 a = aArc;
+        const uint32 w = iUpHead[a];
+        uint32 i = iDownFirst[u], i_end = iDownFirst[u + 1];
+        uint32 j = iDownFirst[w], j_end = iDownFirst[w + 1];
+        uint64 up = aUpCost;
+        uint64 down = aDownCost;
+        uint32 up_middle = KNoContractionHierarchyItem;
+        uint32 down_middle = KNoContractionHierarchyItem;
+        while (i < i_end && j < j_end)
+            {
+            uint32 vi = iDownTail[i], vj = iDownTail[j];
+            if (vi < vj)
+                i++;
+            else if (vj < vi)
+                j++;
+            else
+                {
+                const uint32 vu = iDownArc[i], vw = iDownArc[j];
+                uint64 c = uint64(aMetric.iDownCost[vu]) + aMetric.iUpCost[vw];
+                if (c < up)
+                    {
+                    up = c;
+                    up_middle = vi;
+                    }
+                c = uint64(aMetric.iDownCost[vw]) + aMetric.iUpCost[vu];
+                if (c < down)
+                    {
+                    down = c;
+                    down_middle = vi;
+                    }
+                i++;
+                j++;
+                }
+            }
+        const uint32 up_cost = uint32(std::min(up,uint64(UINT32_MAX)));
+        const uint32 down_cost = uint32(std::min(down,uint64(UINT32_MAX)));
+        bool changed = up_cost != aMetric.iUpCost[a] || down_cost != aMetric.iDownCost[a];
+        aMetric.iUpCost[a] = up_cost;
+        aMetric.iDownCost[a] = down_cost;
+        aMetric.iUpMiddle[a] = up_middle;
+        aMetric.iDownMiddle[a] = down_middle;
+        return changed;
+        }
+
+    std::vector<uint32> iUpFirst;     // index into iUpHead for each node, plus one for the end
+    std::vector<uint32> iUpHead;      // the higher node of each arc, sorted for each lower node
+    std::vector<uint32> iDownFirst;   // index into iDownTail and iDownArc for each node, plus one for the end
+    std::vector<uint32> iDownTail;    // the lower node of each arc into a node, sorted
+    std::vector<uint32> iDownArc;     // the arc index corresponding to each entry in iDownTail
+    std::vector<uint32> iLevelFirst;  // index into iLevelNode for each level, plus one for the end
+    std::vector<uint32> iLevelNode;   // the nodes in order of level
+    };
+
+/**
+A customized contraction hierarchy, presenting a CCustomizableContractionHierarchy and a metric
+as a static graph for use with CSearchGraph and TDijkstra. Only upward arcs are returned,
+as needed for contraction hierarchy queries: forward searches use upward costs and backward searches downward costs.
+Arc references are arc indexes plus one, so that zero means null.
+*/
+class TContractionHierarchyGraph
+    {
+    public:
+    using TArcRef = uint32;
+
+    TContractionHierarchyGraph(const CCustomizableContractionHierarchy& aHierarchy,const CContractionHierarchyMetric& aMetric):
+        iHierarchy(aHierarchy),
+        iMetric(aMetric)
+        {
+        }
+
+    size_t NodeCount() const { return iHierarchy.NodeCount(); }
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(const TContractionHierarchyGraph& aGraph,uint32 aNode,bool aOutgoing):
+            iHierarchy(aGraph.iHierarchy),
+            iCost(aOutgoing ? aGraph.iMetric.iUpCost.data() : aGraph.iMetric.iDownCost.data()),
+            iArc(aGraph.iHierarchy.UpArcBegin(aNode) - 1),
+            iEnd(aGraph.iHierarchy.UpArcEnd(aNode))
+            {
+            }
+
+        bool Next(TResult& /*aError*/)
+            {
+            while (++iArc < iEnd)
+                if (iCost[iArc] != UINT32_MAX)
+                    return true;
+            return false;
+            }
+        TArcRef Arc() const { return iArc + 1; }
+        uint32 Cost() const { return iCost[iArc]; }
+        uint32 EndNodeIndex() const { return iHierarchy.ArcHead(iArc); }
+
+        private:
+        const CCustomizableContractionHierarchy& iHierarchy;
+        const uint32* iCost;
+        uint32 iArc;
+        uint32 iEnd;
+        };
+
+    TArcIterator ArcIterator(uint32 aNode,bool aOutgoing) const { return TArcIterator(*this,aNode,aOutgoing); }
+
+    private:
+    const CCustomizableContractionHierarchy& iHierarchy;
+    const CContractionHierarchyMetric& iMetric;
+    };
+
+}
+
+#endif
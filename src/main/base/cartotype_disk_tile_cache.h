@@ -0,0 +1,616 @@
+/*
+CARTOTYPE_DISK_TILE_CACHE.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_DISK_TILE_CACHE_H__
+#define CARTOTYPE_DISK_TILE_CACHE_H__
+
+#include <cartotype_cache.h>
+#include <cartotype_framework.h>
+#include <cartotype_graphics_context.h>
+#include <cartotype_image_server_helper.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace CartoType
+{
+
+/** The key identifying a tile in a CDiskTileCache. */
+class TDiskTileKey
+    {
+    public:
+    bool operator==(const TDiskTileKey& aOther) const
+        {
+        return iStyleHash == aOther.iStyleHash && iMapGeneration == aOther.iMapGeneration &&
+               iZoom == aOther.iZoom && iX == aOther.iX && iY == aOther.iY;
+        }
+
+    /**
+    A hash of everything other than the tile position which affects the appearance of the tile, such as the style sheet,
+    the tile size and the drawing options: see CDiskTileCache::Hash.
+    */
+    uint64 iStyleHash = 0;
+    /** A number which changes whenever the map data changes, such as a data version or a file modification time. */
+    uint32 iMapGeneration = 0;
+    /** The zoom level. */
+    int32 iZoom = 0;
+    /** The column of the tile. */
+    int32 iX = 0;
+    /** The row of the tile. */
+    int32 iY = 0;
+    };
+
+/**
+A persistent cache of encoded tiles, stored in a single file, so that tiles drawn before an application was restarted
+need not be drawn again.
+
+The file is a header followed by a sequence of records, each holding the key, the length and a checksum of an encoded tile.
+New tiles are appended, and a tile added again supersedes the earlier copy. On opening, the index is rebuilt by scanning the records;
+scanning stops at the first incomplete or corrupt record, which is overwritten by the next tile added, so a crash while writing loses
+only that tile. Tiles are read from a memory mapping of the file where the platform supports it.
+
+When the file grows larger than its maximum size it is compacted by copying the most recently used tiles, up to three quarters of the maximum size,
+to a new file which replaces the old one.
+
+All functions are thread-safe.
+*/
+class CDiskTileCache
+    {
+    public:
+    /** Open the cache file aFileName, creating it if necessary, and limit its size to aMaxBytes. */
+    static std::unique_ptr<CDiskTileCache> New(TResult& aError,const std::string& aFileName,size_t aMaxBytes)
+        {
+        std::unique_ptr<CDiskTileCache> cache(new CDiskTileCache(aFileName,aMaxBytes));
+        aError = cache->Open();
+        if (aError)
+            cache.reset();
+        return cache;
+        }
+
+    ~CDiskTileCache()
+        {
+        Close();
+        }
+
+    /** Return the FNV-1a hash of aLength bytes of data, added to aHash; used to create style hashes. */
+    static uint64 Hash(const void* aData,size_t aLength,uint64 aHash = 14695981039346656037ULL)
+        {
+        const uint8* p = static_cast<const uint8*>(aData);
+        for (size_t i = 0; i < aLength; i++)
+            {
+            aHash ^= p[i];
+            aHash *= 1099511628211ULL;
+            }
+        return aHash;
+        }
+
+    /** Return the hash of a string added to aHash. */
+    static uint64 Hash(const std::string& aText,uint64 aHash = 14695981039346656037ULL)
+        {
+        return Hash(aText.data(),aText.size(),aHash);
+        }
+
+    /**
+    Return the hash of a style sheet, given as in CFramework::TParam by a file name or by text, added to aHash.
+    The contents of the file are hashed, so the hash changes when the file is edited.
+    */
+    static uint64 StyleSheetHash(const std::string& aFileName,const std::string& aText,uint64 aHash = 14695981039346656037ULL)
+        {
+        uint64 h = Hash(aFileName,Hash(aText,aHash));
+        FILE* file = aFileName.empty() ? nullptr : fopen(aFileName.c_str(),"rb");
+        if (file)
+            {
+            uint8 buffer[4096];
+            size_t length;
+            while ((length = fread(buffer,1,sizeof(buffer),file)) > 0)
+                h = Hash(buffer,length,h);
+            fclose(file);
+            }
+        return h;
+        }
+
+    /** Return the hash of the tile size and of every member of aParam which affects the appearance of a tile, added to aHash. */
+    static uint64 TileHash(int32 aTileSize,const TTileBitmapParam& aParam,uint64 aHash = 14695981039346656037ULL)
+        {
+        const int32 option[] = { aTileSize, aParam.iDrawMapObjects, aParam.iDrawLabels, aParam.iDrawBackground, aParam.iLabelHandler != nullptr };
+        return Hash(option,sizeof(option),aHash);
+        }
+
+    /**
+    Get the encoded tile with the key aKey, returning KErrorNotFound if it is not in the cache.
+    If aIsBitmap is non-null, *aIsBitmap is set to true if the tile was stored by AddBitmap, and is therefore a PNG file.
+    */
+    TResult Find(const TDiskTileKey& aKey,std::vector<uint8>& aData,bool* aIsBitmap = nullptr)
+        {
+        uint32 type = KRawData;
+        TResult error = FindRecord(aKey,aData,type);
+        if (aIsBitmap)
+            *aIsBitmap = type == KPng;
+        return error;
+        }
+
+    /** Add an encoded tile, replacing any tile with the same key. */
+    TResult Add(const TDiskTileKey& aKey,const uint8* aData,size_t aLength)
+        {
+        return AddRecord(aKey,aData,aLength,KRawData);
+        }
+
+    /** Get a tile stored by AddBitmap, returning KErrorNotFound if it is not in the cache. */
+    CBitmap FindBitmap(TResult& aError,const TDiskTileKey& aKey)
+        {
+        std::vector<uint8> data;
+        bool is_bitmap = false;
+        aError = Find(aKey,data,&is_bitmap);
+        if (!aError && !is_bitmap)
+            aError = KErrorNotFound;
+        if (aError)
+            return CBitmap();
+        return DecodeBitmap(aError,data);
+        }
+
+    /** Decode a tile stored by AddBitmap and returned by Find. */
+    static CBitmap DecodeBitmap(TResult& aError,const std::vector<uint8>& aData)
+        {
+        TMemoryInputStream input(aData.data(),aData.size());
+        std::unique_ptr<CBitmap> bitmap = CBitmap::New(aError,input);
+        if (aError)
+            return CBitmap();
+        return std::move(*bitmap);
+        }
+
+    /** Add a tile, storing it as a PNG file, replacing any tile with the same key. */
+    TResult AddBitmap(const TDiskTileKey& aKey,const TBitmap& aBitmap,bool aPalettize = false)
+        {
+        CMemoryOutputStream png;
+        TResult error = aBitmap.WritePng(png,aPalettize);
+        if (!error)
+            error = AddRecord(aKey,png.Data(),png.Length(),KPng);
+        return error;
+        }
+
+    /** Discard all the tiles. */
+    TResult Clear()
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        Close();
+        std::remove(iFileName.c_str());
+        iIndex.clear();
+        iCounters.iItemCount = 0;
+        iCounters.iSize = 0;
+        iUseCounter = 0;
+        return Open();
+        }
+
+    /**
+    Return the counters. iItemCount and iSize are the number of tiles and their total size in bytes,
+    iMaxSize is the maximum file size, and iEvictionCount is the number of tiles discarded by compaction.
+    */
+    TCacheCounters Counters() const
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        TCacheCounters counters = iCounters;
+        counters.iMaxSize = iMaxBytes;
+        return counters;
+        }
+
+    /**
+    Return the error from the last compaction, which is done when a tile is added and the file is too large.
+    After a failure the cache goes on using the old file, except on Windows, where the old file is removed before the new one
+    is renamed, so the cache starts again empty if the rename fails.
+    */
+    TResult LastCompactionError() const
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        return iCompactionError;
+        }
+
+    /** Return the size of the file in bytes, including superseded tiles not yet removed by compaction. */
+    uint64 FileSize() const
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        return iEnd;
+        }
+
+    private:
+    static constexpr uint32 KFileSignature = 0x43544443; // "CTDC"
+    static constexpr uint32 KFileVersion = 1;
+    static constexpr uint32 KRecordSignature = 0x54494C45; // "TILE"
+    static constexpr uint32 KHeaderSize = 8;
+    static constexpr uint32 KRecordHeaderSize = 40;
+    static constexpr uint32 KRawData = 0;
+    static constexpr uint32 KPng = 1;
+
+    class THash
+        {
+        public:
+        size_t operator()(const TDiskTileKey& aKey) const
+            {
+            uint64 h = aKey.iStyleHash;
+            h = (h ^ aKey.iMapGeneration) * 1099511628211ULL;
+            h = (h ^ uint32(aKey.iZoom)) * 1099511628211ULL;
+            h = (h ^ uint32(aKey.iX)) * 1099511628211ULL;
+            h = (h ^ uint32(aKey.iY)) * 1099511628211ULL;
+            return size_t(h ^ (h >> 32));
+            }
+        };
+
+    class TEntry
+        {
+        public:
+        uint64 iOffset;      // the offset of the record
+        uint32 iLength;      // the length of the data
+        uint32 iType;
+        uint64 iLastUse;     // the value of iUseCounter when the tile was last added or found
+        };
+
+    CDiskTileCache(const std::string& aFileName,size_t aMaxBytes):
+        iFileName(aFileName),
+        iMaxBytes(aMaxBytes)
+        {
+        }
+
+    CDiskTileCache(const CDiskTileCache&) = delete;
+    CDiskTileCache& operator=(const CDiskTileCache&) = delete;
+
+    static uint32 Checksum(const uint8* aData,size_t aLength)
+        {
+        uint64 h = Hash(aData,aLength);
+        return uint32(h ^ (h >> 32));
+        }
+
+    static uint64 PaddedLength(uint32 aLength) { return (uint64(aLength) + 3) & ~uint64(3); }
+
+    // Open or create the file and rebuild the index.
+    TResult Open()
+        {
+        iFile = fopen(iFileName.c_str(),"r+b");
+        if (!iFile)
+            {
+            iFile = fopen(iFileName.c_str(),"w+b");
+            if (!iFile)
+                return KErrorIo;
+            const uint32 header[2] = { KFileSignature, KFileVersion };
+            if (fwrite(header,sizeof(header),1,iFile) != 1 || fflush(iFile))
+                return KErrorIo;
+            }
+        if (FileSeek(iFile,0,SEEK_END))
+            return KErrorIo;
+        const uint64 file_size = uint64(FileTell(iFile));
+        TResult error = Map(file_size);
+        if (error)
+            return error;
+
+        uint32 header[2] = { };
+        if (file_size < KHeaderSize || !Read(0,header,sizeof(header)) || header[0] != KFileSignature)
+            return KErrorCorrupt;
+        if (header[1] != KFileVersion)
+            return KErrorUnknownVersion;
+
+        uint64 offset = KHeaderSize;
+        std::vector<uint8> data;
+        while (offset + KRecordHeaderSize <= file_size)
+            {
+            uint32 r[10];
+            if (!Read(offset,r,sizeof(r)) || r[0] != KRecordSignature)
+                break;
+            const uint32 length = r[8];
+            if (offset + KRecordHeaderSize + PaddedLength(length) > file_size)
+                break;
+            data.resize(length);
+            if (!Read(offset + KRecordHeaderSize,data.data(),length) || Checksum(data.data(),length) != r[9])
+                break;
+            TDiskTileKey key;
+            key.iStyleHash = uint64(r[2]) | (uint64(r[3]) << 32);
+            key.iMapGeneration = r[4];
+            key.iZoom = int32(r[5]);
+            key.iX = int32(r[6]);
+            key.iY = int32(r[7]);
+            Insert(key,TEntry { offset,length,r[1],++iUseCounter }); // later tiles count as more recently used
+            offset += KRecordHeaderSize + PaddedLength(length);
+            }
+        iEnd = offset;
+        return KErrorNone;
+        }
+
+    void Close()
+        {
+        Unmap();
+        if (iFile)
+            {
+            fclose(iFile);
+            iFile = nullptr;
+            }
+        }
+
+    void Insert(const TDiskTileKey& aKey,const TEntry& aEntry)
+        {
+        auto p = iIndex.find(aKey);
+        if (p != iIndex.end())
+            {
+            iCounters.iSize -= p->second.iLength;
+            p->second = aEntry;
+            }
+        else
+            {
+            iIndex.emplace(aKey,aEntry);
+            iCounters.iItemCount++;
+            }
+        iCounters.iSize += aEntry.iLength;
+        }
+
+    TResult FindRecord(const TDiskTileKey& aKey,std::vector<uint8>& aData,uint32& aType)
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        auto p = iIndex.find(aKey);
+        if (p == iIndex.end() || !iFile)
+            {
+            iCounters.iMissCount++;
+            return KErrorNotFound;
+            }
+        TEntry& e = p->second;
+        aData.resize(e.iLength);
+        if (!Read(e.iOffset + KRecordHeaderSize,aData.data(),e.iLength))
+            return KErrorIo;
+        e.iLastUse = ++iUseCounter;
+        aType = e.iType;
+        iCounters.iHitCount++;
+        return KErrorNone;
+        }
+
+    TResult AddRecord(const TDiskTileKey& aKey,const uint8* aData,size_t aLength,uint32 aType)
+        {
+        if (aLength > UINT32_MAX - 3)
+            return KErrorInvalidArgument;
+        std::lock_guard<std::mutex> lock(iMutex);
+        if (!iFile)
+            return KErrorIo;
+        const uint32 length = uint32(aLength);
+        const uint32 r[10] = { KRecordSignature, aType, uint32(aKey.iStyleHash), uint32(aKey.iStyleHash >> 32), aKey.iMapGeneration,
+                               uint32(aKey.iZoom), uint32(aKey.iX), uint32(aKey.iY), length, Checksum(aData,aLength) };
+        const uint32 zero = 0;
+        const size_t padding = size_t(PaddedLength(length) - length);
+        if (FileSeek(iFile,int64(iEnd),SEEK_SET) ||
+            fwrite(r,sizeof(r),1,iFile) != 1 ||
+            (aLength && fwrite(aData,aLength,1,iFile) != 1) ||
+            (padding && fwrite(&zero,padding,1,iFile) != 1) ||
+            fflush(iFile))
+            return KErrorIo;
+        Insert(aKey,TEntry { iEnd,length,aType,++iUseCounter });
+        iEnd += KRecordHeaderSize + PaddedLength(length);
+
+        // The tile has been written, so a failed compaction is recorded for LastCompactionError but does not fail the Add.
+        if (iEnd > iMaxBytes)
+            iCompactionError = Compact();
+        return KErrorNone;
+        }
+
+    // Copy the most recently used tiles to a new file, which replaces the current one.
+    TResult Compact()
+        {
+        std::vector<std::pair<TDiskTileKey,TEntry>> entry(iIndex.begin(),iIndex.end());
+        std::sort(entry.begin(),entry.end(),[](const std::pair<TDiskTileKey,TEntry>& aA,const std::pair<TDiskTileKey,TEntry>& aB)
+            {
+            return aA.second.iLastUse > aB.second.iLastUse;
+            });
+        const uint64 target = uint64(iMaxBytes) / 4 * 3;
+        uint64 size = KHeaderSize;
+        size_t keep = 0;
+        while (keep < entry.size())
+            {
+            const uint64 record_size = KRecordHeaderSize + PaddedLength(entry[keep].second.iLength);
+            if (size + record_size > target)
+                break;
+            size += record_size;
+            keep++;
+            }
+        entry.resize(keep);
+
+        // Write the tiles least recently used first, so that the order of the file gives their order of use when it is reopened.
+        const std::string temp_name = iFileName + ".tmp";
+        FILE* temp = fopen(temp_name.c_str(),"wb");
+        if (!temp)
+            return KErrorIo;
+        const uint32 header[2] = { KFileSignature, KFileVersion };
+        bool ok = fwrite(header,sizeof(header),1,temp) == 1;
+        std::vector<uint8> record;
+        for (auto p = entry.rbegin(); ok && p != entry.rend(); ++p)
+            {
+            record.resize(size_t(KRecordHeaderSize + PaddedLength(p->second.iLength)));
+            ok = Read(p->second.iOffset,record.data(),record.size()) && fwrite(record.data(),record.size(),1,temp) == 1;
+            }
+        ok = fclose(temp) == 0 && ok;
+        if (!ok)
+            {
+            std::remove(temp_name.c_str());
+            return KErrorIo;
+            }
+
+        // Renaming over the old file replaces it in one step, so it is never lost; Windows cannot do that, so it is removed first.
+        Close();
+#ifdef _WIN32
+        std::remove(iFileName.c_str());
+#endif
+        const bool renamed = std::rename(temp_name.c_str(),iFileName.c_str()) == 0;
+        if (!renamed)
+            std::remove(temp_name.c_str());
+        const size_t evicted = iIndex.size() - entry.size();
+        iIndex.clear();
+        iCounters.iItemCount = 0;
+        iCounters.iSize = 0;
+        iUseCounter = 0;
+
+        // Reopen the new file, or the old one if the rename failed.
+        TResult error = Open();
+        if (!renamed)
+            return error ? error : KErrorIo;
+        iCounters.iEvictionCount += evicted;
+        return error;
+        }
+
+    // Read from the memory mapping, mapping any part of the file written since the mapping was made.
+    bool Read(uint64 aOffset,void* aBuffer,size_t aLength)
+        {
+#ifndef _WIN32
+        if (aOffset + aLength > iMappedSize)
+            {
+            if (FileSeek(iFile,0,SEEK_END) || Map(uint64(FileTell(iFile))) || aOffset + aLength > iMappedSize)
+                return false;
+            }
+        memcpy(aBuffer,iMapping + aOffset,aLength);
+        return true;
+#else
+        return !FileSeek(iFile,int64(aOffset),SEEK_SET) && fread(aBuffer,1,aLength,iFile) == aLength;
+#endif
+        }
+
+    TResult Map(uint64 aFileSize)
+        {
+#ifndef _WIN32
+        Unmap();
+        if (aFileSize == 0)
+            return KErrorNone;
+        void* p = mmap(nullptr,size_t(aFileSize),PROT_READ,MAP_SHARED,fileno(iFile),0);
+        if (p == MAP_FAILED)
+            return KErrorIo;
+        iMapping = static_cast<const uint8*>(p);
+        iMappedSize = aFileSize;
+#else
+        (void)aFileSize;
+#endif
+        return KErrorNone;
+        }
+
+    void Unmap()
+        {
+#ifndef _WIN32
+        if (iMapping)
+            munmap(const_cast<uint8*>(iMapping),size_t(iMappedSize));
+#endif
+        iMapping = nullptr;
+        iMappedSize = 0;
+        }
+
+    mutable std::mutex iMutex;
+    std::string iFileName;
+    size_t iMaxBytes;
+    FILE* iFile = nullptr;
+    const uint8* iMapping = nullptr;
+    uint64 iMappedSize = 0;
+    uint64 iEnd = 0;        // the end of the last valid record, where the next is written
+    uint64 iUseCounter = 0;
+    std::unordered_map<TDiskTileKey,TEntry,THash> iIndex;
+    TCacheCounters iCounters;
+    TResult iCompactionError = KErrorNone;
+    };
+
+/**
+Get a tile from aCache, or, if it is not there, draw it using CFramework::TileBitmap and add it to aCache.
+aStyleSheetHash is the hash of the style sheet used by aFramework, from CDiskTileCache::StyleSheetHash; the tile size and
+aParam are added to it to make the key. A tile which is drawn is returned even if it cannot be added to the cache.
+*/
+inline CBitmap CachedTileBitmap(TResult& aError,CFramework& aFramework,CDiskTileCache& aCache,uint64 aStyleSheetHash,uint32 aMapGeneration,
+                                int32 aTileSizeInPixels,int32 aZoom,int32 aX,int32 aY,const TTileBitmapParam* aParam = nullptr)
+    {
+    TDiskTileKey key;
+    key.iStyleHash = CDiskTileCache::TileHash(aTileSizeInPixels,aParam ? *aParam : TTileBitmapParam(),aStyleSheetHash);
+    key.iMapGeneration = aMapGeneration;
+    key.iZoom = aZoom;
+    key.iX = aX;
+    key.iY = aY;
+    CBitmap bitmap = aCache.FindBitmap(aError,key);
+    if (!aError)
+        return bitmap;
+    bitmap = aFramework.TileBitmap(aError,aTileSizeInPixels,aZoom,aX,aY,aParam);
+    if (!aError)
+        aCache.AddBitmap(key,bitmap);
+    return bitmap;
+    }
+
+/**
+An image server helper which implements AddImageDataToCache and GetImageDataFromCache using a CDiskTileCache.
+Derive from it instead of MImageServerHelper to keep the images drawn by the image server on disk between sessions.
+Images supplied as bitmaps are stored as PNG files; images supplied as user data are stored as they are.
+*/
+class MDiskCachedImageServerHelper: public MImageServerHelper
+    {
+    public:
+    /** Create a helper using aCache. aStyleHash and aMapGeneration form part of the key of every image. */
+    MDiskCachedImageServerHelper(std::shared_ptr<CDiskTileCache> aCache,uint64 aStyleHash,uint32 aMapGeneration):
+        iCache(aCache),
+        iStyleHash(aStyleHash),
+        iMapGeneration(aMapGeneration)
+        {
+        }
+
+    /** Set the map generation, for example after loading new map data. */
+    void SetMapGeneration(uint32 aMapGeneration) { iMapGeneration = aMapGeneration; }
+
+    TResult AddImageDataToCache(const MString& aId,const TImageData& aImageData) override
+        {
+        if (!iCache)
+            return KErrorNone;
+        TDiskTileKey key = Key(aId);
+        if (aImageData.iImageData && aImageData.iImageDataSize > 0)
+            return iCache->Add(key,static_cast<const uint8*>(aImageData.iImageData),size_t(aImageData.iImageDataSize));
+        if (aImageData.iBitmap)
+            return iCache->AddBitmap(key,*aImageData.iBitmap);
+        return KErrorNone;
+        }
+
+    /**
+    Get an image from the cache. The returned bitmap or data are owned by the helper
+    and remain valid until the next call to this function.
+    */
+    TResult GetImageDataFromCache(const MString& aId,TImageData& aImageData) override
+        {
+        if (!iCache)
+            return KErrorNotFound;
+        bool is_bitmap = false;
+        TResult error = iCache->Find(Key(aId),iData,&is_bitmap);
+        if (error)
+            return error;
+        aImageData = TImageData();
+        if (is_bitmap)
+            {
+            iBitmap = CDiskTileCache::DecodeBitmap(error,iData);
+            if (!error)
+                aImageData.iBitmap = &iBitmap;
+            return error;
+            }
+        aImageData.iImageData = iData.data();
+        aImageData.iImageDataSize = int32(iData.size());
+        return KErrorNone;
+        }
+
+    private:
+    TDiskTileKey Key(const MString& aId) const
+        {
+        // The image identifiers are not tile positions, so they are hashed into the style hash.
+        TDiskTileKey key;
+        key.iStyleHash = CDiskTileCache::Hash(aId.Text(),aId.Length() * sizeof(uint16),iStyleHash);
+        key.iMapGeneration = iMapGeneration;
+        key.iZoom = -1;
+        return key;
+        }
+
+    std::shared_ptr<CDiskTileCache> iCache;
+    uint64 iStyleHash;
+    uint32 iMapGeneration;
+    CBitmap iBitmap;
+    std::vector<uint8> iData;
+    };
+
+}
+
+#endif
@@ -8,10 +8,334 @@ See www.cartotype.com for more information.
 #define CARTOTYPE_GRAPH_H__
 
 #include <cartotype_tree.h>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace CartoType
 {
 
+/**
+The open set used by TDijkstra by default: an unbalanced binary tree of nodes ordered by cost.
+TNode must fulfil the requirements of CPointerTree with a key of type uint32.
+
+An open set class used by TDijkstra must have the functions:
+
+void Clear() - remove all nodes;
+size_t Count() const - return the number of nodes in the set;
+TNode* Min() - return the node with the lowest cost, or null if the set is empty;
+void Insert(TNode* aNode) - insert a node, the cost of which has already been set;
+void Delete(TNode* aNode) - delete the node returned by the last call to Min();
+void BeginDecreaseKey(TNode* aNode) - prepare to reduce the cost of a node in the set;
+void EndDecreaseKey(TNode* aNode) - restore the set's ordering after reducing the cost of a node.
+*/
+template<class TNode> class CTreeOpenSet
+    {
+    public:
+    explicit CTreeOpenSet(bool aOwnData):
+        iTree(aOwnData)
+        {
+        }
+
+    void Clear() { iTree.Clear(); }
+    size_t Count() const { return iTree.Count(); }
+    TNode* Min() { return iTree.Min(); }
+    void Insert(TNode* aNode) { iTree.Insert(aNode); }
+    void Delete(TNode* aNode) { iTree.Delete(aNode); }
+    void BeginDecreaseKey(TNode* aNode) { iTree.Delete(aNode,true); }
+    void EndDecreaseKey(TNode* aNode) { iTree.Insert(aNode); }
+
+    private:
+    CPointerTree<TNode,uint32> iTree;
+    };
+
+/** The value of TNode::iQueueIndex for a node not in an open set implemented by a heap. */
+constexpr size_t KNotInOpenSet = SIZE_MAX;
+
+/**
+An open set for TDijkstra implemented as an indexed 4-ary heap, with true decrease-key.
+TNode must have a function Key() returning its cost as a uint32, and a member iQueueIndex of type size_t,
+which is used to store the position of the node in the heap.
+
+A 4-ary heap is shallower than a binary heap and keeps each node's children together in memory,
+so that sifting down touches fewer cache lines.
+The heap never owns its nodes.
+*/
+template<class TNode> class CFourAryHeapOpenSet
+    {
+    public:
+    explicit CFourAryHeapOpenSet(bool aOwnData)
+        {
+        assert(!aOwnData);
+        (void)aOwnData;
+        }
+
+    void Clear()
+        {
+        for (auto p : iHeap)
+            p->iQueueIndex = KNotInOpenSet;
+        iHeap.clear();
+        }
+
+    size_t Count() const { return iHeap.size(); }
+    TNode* Min() { return iHeap.empty() ? nullptr : iHeap[0]; }
+
+    void Insert(TNode* aNode)
+        {
+        iHeap.push_back(aNode);
+        SiftUp(iHeap.size() - 1);
+        }
+
+    void Delete(TNode* aNode)
+        {
+        assert(!iHeap.empty() && iHeap[0] == aNode);
+        aNode->iQueueIndex = KNotInOpenSet;
+        TNode* last = iHeap.back();
+        iHeap.pop_back();
+        if (!iHeap.empty() && last != aNode)
+            SiftDown(last);
+        }
+
+    void BeginDecreaseKey(TNode* /*aNode*/) { }
+
+    void EndDecreaseKey(TNode* aNode)
+        {
+        assert(aNode->iQueueIndex < iHeap.size() && iHeap[aNode->iQueueIndex] == aNode);
+        SiftUp(aNode->iQueueIndex);
+        }
+
+    private:
+    void SiftUp(size_t aIndex)
+        {
+        TNode* node = iHeap[aIndex];
+        uint32 key = node->Key();
+        while (aIndex)
+            {
+            size_t parent = (aIndex - 1) >> 2;
+            TNode* p = iHeap[parent];
+            if (p->Key() <= key)
+                break;
+            iHeap[aIndex] = p;
+            p->iQueueIndex = aIndex;
+            aIndex = parent;
+            }
+        iHeap[aIndex] = node;
+        node->iQueueIndex = aIndex;
+        }
+
+    // Move aNode into the hole at the root and sift it down.
+    void SiftDown(TNode* aNode)
+        {
+        size_t count = iHeap.size();
+        uint32 key = aNode->Key();
+        size_t index = 0;
+        for (;;)
+            {
+            size_t first_child = (index << 2) + 1;
+            if (first_child >= count)
+                break;
+            size_t end_child = first_child + 4 < count ? first_child + 4 : count;
+            size_t best = first_child;
+            uint32 best_key = iHeap[first_child]->Key();
+            for (size_t c = first_child + 1; c < end_child; c++)
+                {
+                uint32 k = iHeap[c]->Key();
+                if (k < best_key)
+                    {
+                    best = c;
+                    best_key = k;
+                    }
+                }
+            if (key <= best_key)
+                break;
+            iHeap[index] = iHeap[best];
+            iHeap[index]->iQueueIndex = index;
+            index = best;
+            }
+        iHeap[index] = aNode;
+        aNode->iQueueIndex = index;
+        }
+
+    std::vector<TNode*> iHeap;
+    };
+
+/**
+An open set for TDijkstra implemented as a monotone radix heap.
+TNode must have a function Key() returning its cost as a uint32, and a member iQueueIndex of type size_t,
+which is used only to mark whether the node is in the set.
+
+A radix heap relies on the fact that in Dijkstra's algorithm no node is ever inserted with a cost lower
+than that of the last node removed, which holds for non-negative arc costs. Items are placed in 33 buckets
+according to the highest bit in which their cost differs from the last minimum, so every item moves
+at most 32 times in its lifetime and there are no comparisons on insertion.
+
+Decreasing a cost inserts a new entry and leaves the old one in place; stale entries are recognised
+by their cost no longer being the node's current cost, and are discarded when they are reached.
+The heap never owns its nodes.
+*/
+template<class TNode> class CRadixHeapOpenSet
+    {
+    public:
+    explicit CRadixHeapOpenSet(bool aOwnData)
+        {
+        assert(!aOwnData);
+        (void)aOwnData;
+        }
+
+    void Clear()
+        {
+        for (auto& b : iBucket)
+            {
+            for (const auto& e : b)
+                e.iNode->iQueueIndex = KNotInOpenSet;
+            b.clear();
+            }
+        iLast = 0;
+        iCount = 0;
+        }
+
+    size_t Count() const { return iCount; }
+
+    TNode* Min()
+        {
+        if (!iCount)
+            return nullptr;
+        for (;;)
+            {
+            auto& b0 = iBucket[0];
+            while (!b0.empty())
+                {
+                const TEntry& e = b0.back();
+                if (Live(e))
+                    return e.iNode;
+                b0.pop_back();
+                }
+            Redistribute();
+            }
+        }
+
+    void Insert(TNode* aNode)
+        {
+        aNode->iQueueIndex = 0;
+        Push(aNode);
+        iCount++;
+        }
+
+    void Delete(TNode* aNode)
+        {
+        assert(!iBucket[0].empty() && iBucket[0].back().iNode == aNode);
+        iBucket[0].pop_back();
+        aNode->iQueueIndex = KNotInOpenSet;
+        assert(iCount > 0);
+        iCount--;
+        }
+
+    void BeginDecreaseKey(TNode* /*aNode*/) { }
+    void EndDecreaseKey(TNode* aNode) { Push(aNode); }
+
+    private:
+    class TEntry
+        {
+        public:
+        uint32 iKey;
+        TNode* iNode;
+        };
+
+    static constexpr size_t KBuckets = 33;
+
+    static bool Live(const TEntry& aEntry)
+        {
+        return aEntry.iNode->iQueueIndex != KNotInOpenSet && aEntry.iNode->Key() == aEntry.iKey;
+        }
+
+    // Return the bucket for a key: 0 if it equals the last minimum, otherwise one more than the index of the highest differing bit.
+    size_t Bucket(uint32 aKey) const
+        {
+        uint32 x = aKey ^ iLast;
+        if (!x)
+            return 0;
+        size_t b = 1;
+        if (x & 0xFFFF0000) { b += 16; x >>= 16; }
+        if (x & 0xFF00) { b += 8; x >>= 8; }
+        if (x & 0xF0) { b += 4; x >>= 4; }
+        if (x & 0xC) { b += 2; x >>= 2; }
+        if (x & 0x2) b += 1;
+        return b;
+        }
+
+    void Push(TNode* aNode)
+        {
+        uint32 key = aNode->Key();
+        assert(key >= iLast);
+        iBucket[Bucket(key)].push_back(TEntry { key, aNode });
+        }
+
+    // Find the lowest non-empty bucket, make its minimum the new base, and spread its live entries into lower buckets.
+    void Redistribute()
+        {
+        size_t i = 1;
+        while (i < KBuckets && iBucket[i].empty())
+            i++;
+        assert(i < KBuckets);
+        auto& b = iBucket[i];
+        bool found = false;
+        uint32 new_last = 0;
+        for (const auto& e : b)
+            {
+            if (Live(e) && (!found || e.iKey < new_last))
+                {
+                new_last = e.iKey;
+                found = true;
+                }
+            }
+        if (found)
+            iLast = new_last;
+        for (const auto& e : b)
+            if (Live(e))
+                iBucket[Bucket(e.iKey)].push_back(e);
+        b.clear();
+        }
+
+    std::array<std::vector<TEntry>,KBuckets> iBucket;
+    uint32 iLast = 0;
+    size_t iCount = 0;
+    };
+
+/** Counts of the work done by one or more TDijkstra searches. */
+class TSearchStats
+    {
+    public:
+    /** The total number of open set operations. */
+    size_t OpenSetOperations() const { return iOpenSetInsertions + iOpenSetDecreases + iOpenSetRemovals; }
+
+    /** Add the counts from another search; the peak open set sizes are added, giving an upper bound for searches run together. */
+    TSearchStats& operator+=(const TSearchStats& aOther)
+        {
+        iSettledNodes += aOther.iSettledNodes;
+        iRelaxedArcs += aOther.iRelaxedArcs;
+        iOpenSetInsertions += aOther.iOpenSetInsertions;
+        iOpenSetDecreases += aOther.iOpenSetDecreases;
+        iOpenSetRemovals += aOther.iOpenSetRemovals;
+        iPeakOpenSetSize += aOther.iPeakOpenSetSize;
+        return *this;
+        }
+
+    /** The number of nodes settled. */
+    size_t iSettledNodes = 0;
+    /** The number of arcs examined from settled nodes. */
+    size_t iRelaxedArcs = 0;
+    /** The number of nodes inserted into the open set. */
+    size_t iOpenSetInsertions = 0;
+    /** The number of times the cost of a node in the open set was decreased. */
+    size_t iOpenSetDecreases = 0;
+    /** The number of nodes removed from the open set. */
+    size_t iOpenSetRemovals = 0;
+    /** The largest number of nodes in the open set at any time. */
+    size_t iPeakOpenSetSize = 0;
+    };
+
 /**
 A class to implement Dijkstra's algorithm for finding the shortest distance from a source node to all
 other nodes, and to store the nodes for which the route has been calculated.
@@ -29,6 +353,10 @@ and if CalculateRoutesBidirectionally is used
 
 uint32 NodeCostInQuery(TNode* aNode,bool aForwards) - return the cost of a node already opened by the forward or backward query, or UINT32_MAX if not found
 
+and if CalculateRouteToRetainedTree is used
+
+void ResetForward() - initialise the forward query only, keeping the state of the backward query
+
 The class TGraph must have a nested TArcIterator class with the following functions:
 
 bool Next(TResult& aError) - get the next arc: this function must be called before getting the first arc and all others, and returns false when none are left;
@@ -36,11 +364,15 @@ TArcRef Arc() - return the current arc;
 uint32 Cost() - return the cost of the current arc;
 TNode* EndNode() - return the end node of the current arc.
 
-The class TNode must fulfil the requirements of CPointerTree.
+The class TNode must fulfil the requirements of the open set class TOpenSet, which is CTreeOpenSet by default.
+CRadixHeapOpenSet and CFourAryHeapOpenSet can be used instead: they avoid the degeneration of the unbalanced tree
+towards linear depth on long routes, and decrease a node's cost without deleting and re-inserting it.
 
 The class TArcRef is a pointer, or an integer, or any other small type that can be copied and assigned. The value zero must mean null.
+
+The work done by the last search is counted in a TSearchStats object returned by Stats().
 */
-template<class TGraph,class TNode,class TArcRef> class TDijkstra
+template<class TGraph,class TNode,class TArcRef,class TOpenSet = CTreeOpenSet<TNode>> class TDijkstra
     {
     public:
     TDijkstra(TGraph& aGraph,bool aOwnNodeLists,bool aOutgoing):
@@ -51,7 +383,8 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
         {
         }
 
-    static TResult CalculateRoutesBidirectionally(TGraph& aGraph,TNode* aStartNode,TNode* aEndNode,const TNode*& aMiddleNode)
+    /** Calculate a route by searching from both ends. If aStats is non-null the work done by both searches is added to it. */
+    static TResult CalculateRoutesBidirectionally(TGraph& aGraph,TNode* aStartNode,TNode* aEndNode,const TNode*& aMiddleNode,TSearchStats* aStats = nullptr)
         {
         assert(aStartNode);
         assert(aEndNode);
@@ -60,10 +393,10 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
         aGraph.Reset();
         aMiddleNode = nullptr;
         
-        TDijkstra<TGraph,TNode,TArcRef> forward_dijkstra(aGraph,false,true);
+        TDijkstra forward_dijkstra(aGraph,false,true);
         forward_dijkstra.Open(aStartNode,0,0);
               
-        TDijkstra<TGraph,TNode,TArcRef> backward_dijkstra(aGraph,false,false);
+        TDijkstra backward_dijkstra(aGraph,false,false);
         backward_dijkstra.Open(aEndNode,0,0);
         
         uint64 max_cost = UINT64_MAX;
@@ -77,15 +410,9 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
             if (f_cost >= max_cost && b_cost >= max_cost)
                 {
                 if (f)
-                    {
-                    forward_dijkstra.iOpen.Delete(f,false);
-                    aGraph.Close(f);
-                    }
+                    forward_dijkstra.Discard(f);
                 if (b)
-                    {
-                    backward_dijkstra.iOpen.Delete(b,false);
-                    aGraph.Close(b);
-                    }
+                    backward_dijkstra.Discard(b);
                 break;
                 }
 
@@ -114,14 +441,61 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
                 }
             }            
         
+        if (aStats)
+            {
+            *aStats += forward_dijkstra.iStats;
+            *aStats += backward_dijkstra.iStats;
+            }
         return error;
         }
         
+    /**
+    Calculate a route from a new start node to the destination of a previous bidirectional query,
+    reusing the backward search tree retained in the graph. Only a forward search is performed;
+    it stops when no node in the open set can improve on the best meeting point with the retained tree.
+    This is used for re-routing from a new position to the same destination.
+
+    The retained tree must have been built with the arc costs still in force.
+    The meeting node is returned in aMiddleNode, or null if the retained tree was not reached.
+    If aStats is non-null the work done by the forward search is added to it.
+    */
+    static TResult CalculateRouteToRetainedTree(TGraph& aGraph,TNode* aStartNode,const TNode*& aMiddleNode,TSearchStats* aStats = nullptr)
+        {
+        assert(aStartNode);
+        aGraph.ResetForward();
+        aMiddleNode = nullptr;
+
+        TDijkstra forward_dijkstra(aGraph,false,true);
+        forward_dijkstra.Open(aStartNode,0,0);
+
+        uint64 max_cost = UINT64_MAX;
+        TResult error = 0;
+        while (!error && forward_dijkstra.iOpen.Count())
+            {
+            TNode* f = forward_dijkstra.iOpen.Min();
+            uint64 f_cost = aGraph.Cost(f);
+            if (f_cost >= max_cost)
+                break;
+            error = forward_dijkstra.CalculateRouteStep(f);
+            uint64 other_cost = aGraph.NodeCostInQuery(f,false);
+            if (other_cost < UINT32_MAX && max_cost > f_cost + other_cost)
+                {
+                max_cost = f_cost + other_cost;
+                aMiddleNode = f;
+                }
+            }
+
+        if (aStats)
+            *aStats += forward_dijkstra.iStats;
+        return error;
+        }
+
     TResult CalculateRoutes(TNode* aStartNode,int32 aMaxSteps,uint32 aMaxCost = UINT32_MAX,TNode* aEndNode = nullptr)
         {
         TResult error = 0;
         iGraph.Reset();
         iOpen.Clear();
+        iStats = TSearchStats();
         Open(aStartNode,0,0);
         iSteps = 0;
         while (!error && iSteps < aMaxSteps && iOpen.Count())
@@ -129,8 +503,7 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
             TNode* n = iOpen.Min();
             if (n == aEndNode || iGraph.Cost(n) > aMaxCost)
                 {
-                iOpen.Delete(n);
-                iGraph.Close(n);
+                Discard(n);
                 break;
                 }
             error = CalculateRouteStep(n);
@@ -138,21 +511,24 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
         return error;
         }
 
-    TResult CalculateIsochrone(TNode* aStartNode,uint32 aMaxCost,std::function<void (const TNode*)> aHandler)
+    /**
+    Find all the nodes with a cost less than aMaxCost from aStartNode, calling aHandler(aNode) for each node reached,
+    including the nodes on the boundary, which are reached at or beyond aMaxCost. The handler is a template parameter,
+    so that lambdas are called directly rather than through std::function.
+    */
+    template<class THandler> TResult CalculateIsochrone(TNode* aStartNode,uint32 aMaxCost,THandler&& aHandler)
         {
         TResult error = 0;
         iGraph.Reset();
         iOpen.Clear();
+        iStats = TSearchStats();
         Open(aStartNode,0,0);
         iSteps = 0;
         while (!error && iOpen.Count())
             {
             TNode* n = iOpen.Min();
             if (iGraph.Cost(n) >= aMaxCost)
-                {
-                iOpen.Delete(n);
-                iGraph.Close(n);
-                }
+                Discard(n);
             else
                 error = CalculateRouteStep(n);
             if (iGraph.Previous(n))
@@ -161,6 +537,83 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
         return error;
         }
 
+    /**
+    Calculate several isochrones using a single search up to the largest limit in aMaxCost, which must be in ascending order.
+    aHandler(aNode,aBand) is called for each node reached, where aBand is the index of the smallest limit greater than the node's cost,
+    or aMaxCost.size() for nodes on the outer boundary.
+    */
+    template<class THandler> TResult CalculateIsochroneBands(TNode* aStartNode,const std::vector<uint32>& aMaxCost,THandler&& aHandler)
+        {
+        if (aMaxCost.empty())
+            return KErrorNone;
+        assert(std::is_sorted(aMaxCost.begin(),aMaxCost.end()));
+        // Nodes are reported in order of increasing cost, so the band index only ever moves forward.
+        size_t band = 0;
+        return CalculateIsochrone(aStartNode,aMaxCost.back(),[&](TNode* aNode)
+            {
+            uint32 cost = iGraph.Cost(aNode);
+            while (band < aMaxCost.size() && cost >= aMaxCost[band])
+                band++;
+            aHandler(static_cast<const TNode*>(aNode),band);
+            });
+        }
+
+    /**
+    Search outwards from aStartNode, calling aHandler(aNode,aCost) for each node as it is settled, starting with aStartNode itself,
+    until there are no more nodes with a cost less than aMaxCost, or the handler returns false.
+    The handler is a template parameter so that the call can be inlined.
+    If aResetGraph is false the graph is not reset, so that a search in the other direction can be kept.
+    */
+    template<class THandler> TResult CalculateSettledNodes(TNode* aStartNode,uint32 aMaxCost,THandler&& aHandler,bool aResetGraph = true)
+        {
+        TResult error = 0;
+        if (aResetGraph)
+            iGraph.Reset();
+        iOpen.Clear();
+        iStats = TSearchStats();
+        Open(aStartNode,0,0);
+        iSteps = 0;
+        while (!error && iOpen.Count())
+            {
+            TNode* n = iOpen.Min();
+            uint32 cost = iGraph.Cost(n);
+            if (cost >= aMaxCost)
+                break;
+            error = CalculateRouteStep(n);
+            if (!error && !aHandler(n,cost))
+                break;
+            }
+        return error;
+        }
+
+    /**
+    Calculate the costs from aStartNode to all the nodes in aEndNode, using a single search which stops
+    as soon as they have all been settled. Costs are returned in aCost, in the same order as aEndNode;
+    the cost of a node that cannot be reached, or is null, is UINT32_MAX.
+    */
+    TResult CalculateOneToMany(TNode* aStartNode,const std::vector<TNode*>& aEndNode,std::vector<uint32>& aCost,uint32 aMaxCost = UINT32_MAX)
+        {
+        aCost.assign(aEndNode.size(),UINT32_MAX);
+        std::unordered_multimap<const TNode*,size_t> end_index;
+        for (size_t i = 0; i < aEndNode.size(); i++)
+            if (aEndNode[i])
+                end_index.emplace(aEndNode[i],i);
+        size_t remaining = end_index.size();
+        if (!remaining)
+            return KErrorNone;
+
+        return CalculateSettledNodes(aStartNode,aMaxCost,[&](const TNode* aNode,uint32 aNodeCost)->bool
+            {
+            auto range = end_index.equal_range(aNode);
+            for (auto p = range.first; p != range.second; ++p)
+                {
+                aCost[p->second] = aNodeCost;
+                remaining--;
+                }
+            return remaining != 0;
+            });
+        }
+
     /** Extend an existing query by performing further steps. */
     TResult ExtendRoutes(int32 aMaxSteps,uint32 aMaxCost = UINT32_MAX,TNode* aEndNode = nullptr)
         {
@@ -170,8 +623,7 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
             TNode* n = iOpen.Min();
             if (n == aEndNode || iGraph.Cost(n) > aMaxCost)
                 {
-                iOpen.Delete(n);
-                iGraph.Close(n);
+                Discard(n);
                 break;
                 }
             error = CalculateRouteStep(n);
@@ -179,18 +631,33 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
         return error;
         }
     
+    /** Return counts of the work done by the last search. */
+    const TSearchStats& Stats() const { return iStats; }
+
     private:
     void Open(TNode* aNode,uint32 aCost,TArcRef aPrevArc)
         {
         iGraph.Set(aNode,aCost,aPrevArc);
         iOpen.Insert(aNode);
+        iStats.iOpenSetInsertions++;
+        if (iOpen.Count() > iStats.iPeakOpenSetSize)
+            iStats.iPeakOpenSetSize = iOpen.Count();
         }
     
     void Promote(TNode* aNode,uint32 aCost,TArcRef aPrevArc)
         {
-        iOpen.Delete(aNode,true);
+        iOpen.BeginDecreaseKey(aNode);
         iGraph.Set(aNode,aCost,aPrevArc);
-        iOpen.Insert(aNode);
+        iOpen.EndDecreaseKey(aNode);
+        iStats.iOpenSetDecreases++;
+        }
+
+    // Remove a node from the open set and close it without following its arcs.
+    void Discard(TNode* aNode)
+        {
+        iOpen.Delete(aNode);
+        iGraph.Close(aNode);
+        iStats.iOpenSetRemovals++;
         }
     
     TResult CalculateRouteStep(TNode* aNode)
@@ -199,6 +666,8 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
         iSteps++;
         iOpen.Delete(aNode);
         iGraph.Close(aNode);
+        iStats.iOpenSetRemovals++;
+        iStats.iSettledNodes++;
         uint32 node_cost = iGraph.Cost(aNode);
         assert(node_cost >= 0);
         typename TGraph::TArcIterator iter(iGraph.ArcIterator(aNode,iOutgoing));
@@ -213,6 +682,7 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
             assert(dest_cost >= node_cost);
             assert(dest_cost >= iter_cost);
             assert(dest_cost >= 0);
+            iStats.iRelaxedArcs++;
             TNode* end_node = iter.EndNode();
             if (iGraph.Previous(end_node))
                 {
@@ -226,9 +696,578 @@ template<class TGraph,class TNode,class TArcRef> class TDijkstra
         }
     
     TGraph& iGraph;
-    CPointerTree<TNode,uint32> iOpen;
+    TOpenSet iOpen;
     bool iOutgoing;
     int32 iSteps;
+    TSearchStats iStats;
+    };
+
+/**
+Calculate a matrix of costs from each node in aStartNode to each node in aEndNode using the bucket-based many-to-many algorithm.
+This is intended for contraction hierarchies: TGraph's arc iterator must return only upward arcs, so that each search is small.
+A backward search is made from each end node, storing its settled costs in buckets attached to the nodes reached;
+then a forward search is made from each start node, combining its costs with the buckets it meets.
+The number of searches is the number of start nodes plus the number of end nodes, not their product.
+
+On return aCost holds aStartNode.size() rows of aEndNode.size() costs; unreachable pairs have the cost UINT32_MAX.
+*/
+template<class TGraph,class TNode,class TArcRef,class TOpenSet = CTreeOpenSet<TNode>>
+TResult CalculateManyToManyCosts(TGraph& aGraph,const std::vector<TNode*>& aStartNode,const std::vector<TNode*>& aEndNode,
+                                 std::vector<uint32>& aCost,uint32 aMaxCost = UINT32_MAX)
+    {
+    const size_t end_count = aEndNode.size();
+    aCost.assign(aStartNode.size() * end_count,UINT32_MAX);
+
+    class TBucketEntry
+        {
+        public:
+        uint32 iEndIndex;
+        uint32 iCost;
+        };
+    std::unordered_map<const TNode*,std::vector<TBucketEntry>> bucket;
+
+    TResult error = KErrorNone;
+    TDijkstra<TGraph,TNode,TArcRef,TOpenSet> backward(aGraph,false,false);
+    for (size_t j = 0; !error && j < end_count; j++)
+        {
+        if (!aEndNode[j])
+            continue;
+        error = backward.CalculateSettledNodes(aEndNode[j],aMaxCost,[&](const TNode* aNode,uint32 aNodeCost)->bool
+            {
+            bucket[aNode].push_back(TBucketEntry { uint32(j), aNodeCost });
+            return true;
+            });
+        }
+
+    TDijkstra<TGraph,TNode,TArcRef,TOpenSet> forward(aGraph,false,true);
+    for (size_t i = 0; !error && i < aStartNode.size(); i++)
+        {
+        if (!aStartNode[i])
+            continue;
+        uint32* row = aCost.data() + i * end_count;
+        error = forward.CalculateSettledNodes(aStartNode[i],aMaxCost,[&](const TNode* aNode,uint32 aNodeCost)->bool
+            {
+            auto p = bucket.find(aNode);
+            if (p != bucket.end())
+                {
+                for (const auto& e : p->second)
+                    {
+                    uint64 c = uint64(aNodeCost) + e.iCost;
+                    if (c < row[e.iEndIndex])
+                        row[e.iEndIndex] = uint32(c);
+                    }
+                }
+            return true;
+            });
+        }
+
+    return error;
+    }
+
+
+/**
+The per-query state of a node in a CSearchGraph: its cost, the arc by which it was reached, and its open set position.
+*/
+template<class TArcRef> class TSearchNode
+    {
+    public:
+    uint32 Key() const { return iCost; }
+
+    /** The position of the node in a heap-based open set. */
+    size_t iQueueIndex = KNotInOpenSet;
+    /** The cost from the start of the query. */
+    uint32 iCost = 0;
+    /** The generation of the query in which this state was last set; older state is treated as empty. */
+    uint32 iGeneration = 0;
+    /** The previous arc along the best route to the node, or 0 if not known. */
+    TArcRef iPrevArc = 0;
+    /** The index of the node at the other end of iPrevArc, or UINT32_MAX if not known. */
+    uint32 iPrevNode = UINT32_MAX;
+    /** True if the node has been reached in this query. */
+    bool iOpened = false;
+    /** True if the node has been settled in this query. */
+    bool iClosed = false;
+    };
+
+/**
+A graph for use by TDijkstra which keeps all per-query state in scratch arrays indexed by node,
+leaving the underlying graph unmodified. A single immutable graph can therefore be searched
+by many threads at once, each using its own CSearchGraph.
+
+Reset() is O(1): each query has a generation number, and the state of a node set in an earlier generation
+is discarded when the node is next accessed. ResetForward() starts a new forward query but keeps the backward query,
+so that TDijkstra::CalculateRouteToRetainedTree can reuse the backward search tree when re-routing.
+
+TStaticGraph must have:
+
+a nested type TArcRef, satisfying the TDijkstra requirements for arc references;
+size_t NodeCount() const - return the number of nodes, which are indexed from zero;
+TStaticGraph::TArcIterator ArcIterator(uint32 aNodeIndex,bool aOutgoing) const - return an iterator over all the arcs from or to a node;
+or, for time-dependent graphs, ArcIterator(uint32 aNodeIndex,bool aOutgoing,uint32 aNodeCost) const, which is given the cost of the node in the query;
+
+and TStaticGraph::TArcIterator must have the functions Next(TResult& aError), Arc() and Cost() as required by TDijkstra,
+and uint32 EndNodeIndex() to return the index of the node at the other end of the current arc.
+
+Search nodes do not have the links needed by CTreeOpenSet, so use CRadixHeapOpenSet or CFourAryHeapOpenSet with a CSearchGraph.
+Forward and backward searches, as used by TDijkstra::CalculateRoutesBidirectionally, use separate node states.
+*/
+template<class TStaticGraph> class CSearchGraph
+    {
+    public:
+    using TArcRef = typename TStaticGraph::TArcRef;
+    using TNode = TSearchNode<TArcRef>;
+
+    explicit CSearchGraph(const TStaticGraph& aGraph):
+        iGraph(aGraph)
+        {
+        }
+
+    /** Return the state of a node in the forward or backward search. */
+    TNode* Node(uint32 aNodeIndex,bool aForwards = true)
+        {
+        auto& state = aForwards ? iForward : iBackward;
+        if (state.size() != iGraph.NodeCount())
+            state.resize(iGraph.NodeCount());
+        assert(aNodeIndex < state.size());
+        return &state[aNodeIndex];
+        }
+
+    /** Return the index of a node in the underlying graph. */
+    uint32 NodeIndex(const TNode* aNode) const
+        {
+        return uint32(aNode - (IsForward(aNode) ? iForward.data() : iBackward.data()));
+        }
+
+    /** Return true if aNode belongs to the forward search. */
+    bool IsForward(const TNode* aNode) const
+        {
+        return !iForward.empty() && aNode >= iForward.data() && aNode < iForward.data() + iForward.size();
+        }
+
+    void Reset()
+        {
+        ResetForward();
+        NextGeneration(iBackward,iBackwardGeneration);
+        }
+
+    void ResetForward()
+        {
+        NextGeneration(iForward,iForwardGeneration);
+        }
+
+    /**
+    Call aHandler(aNodeIndex,aPreviousNodeIndex,aCost,aForwards) for every node settled by the current forward and backward queries,
+    where aPreviousNodeIndex is UINT32_MAX for a start node. The settled nodes and the arcs to them make up the search space,
+    which can be drawn to show how a route was found.
+    */
+    template<class THandler> void GetSearchSpace(THandler&& aHandler) const
+        {
+        for (int direction = 0; direction < 2; direction++)
+            {
+            const bool forwards = direction == 0;
+            const auto& state = forwards ? iForward : iBackward;
+            const uint32 generation = forwards ? iForwardGeneration : iBackwardGeneration;
+            for (size_t i = 0; i < state.size(); i++)
+                {
+                const TNode& n = state[i];
+                if (n.iGeneration == generation && n.iClosed)
+                    aHandler(uint32(i),n.iPrevNode,n.iCost,forwards);
+                }
+            }
+        }
+
+    void Set(TNode* aNode,uint32 aCost,TArcRef aPrevArc)
+        {
+        Refresh(aNode);
+        aNode->iCost = aCost;
+        aNode->iPrevArc = aPrevArc;
+        aNode->iPrevNode = aPrevArc ? iExpandedNode : UINT32_MAX;
+        aNode->iOpened = true;
+        }
+
+    void Close(TNode* aNode) { Refresh(aNode); aNode->iClosed = true; }
+    uint32 Cost(TNode* aNode) { Refresh(aNode); return aNode->iCost; }
+    TArcRef Previous(TNode* aNode) { Refresh(aNode); return aNode->iPrevArc; }
+
+    /**
+    Return the index of the previous node along the best route to aNode, or UINT32_MAX if there is none.
+    This is the node whose arcs TDijkstra was iterating over when it last set aNode's cost.
+    */
+    uint32 PreviousNodeIndex(TNode* aNode) { Refresh(aNode); return aNode->iPrevNode; }
+
+    uint32 NodeCostInQuery(TNode* aNode,bool aForwards)
+        {
+        TNode* n = Node(NodeIndex(aNode),aForwards);
+        Refresh(n);
+        return n->iOpened ? n->iCost : UINT32_MAX;
+        }
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(CSearchGraph& aGraph,typename TStaticGraph::TArcIterator aIter,bool aForwards):
+            iGraph(aGraph),
+            iIter(aIter),
+            iForwards(aForwards)
+            {
+            }
+
+        bool Next(TResult& aError)
+            {
+            while (iIter.Next(aError))
+                {
+                iEndNode = iGraph.Node(iIter.EndNodeIndex(),iForwards);
+                iGraph.Refresh(iEndNode);
+                if (!iEndNode->iClosed)
+                    return true;
+                }
+            return false;
+            }
+        TArcRef Arc() { return iIter.Arc(); }
+        uint32 Cost() { return iIter.Cost(); }
+        TNode* EndNode() { return iEndNode; }
+
+        private:
+        CSearchGraph& iGraph;
+        typename TStaticGraph::TArcIterator iIter;
+        bool iForwards;
+        TNode* iEndNode = nullptr;
+        };
+
+    TArcIterator ArcIterator(TNode* aNode,bool aOutgoing)
+        {
+        bool forwards = IsForward(aNode);
+        iExpandedNode = NodeIndex(aNode);
+        return TArcIterator(*this,StaticArcIterator(iGraph,aNode,aOutgoing,0),forwards);
+        }
+
+    private:
+    /*
+    Pass the node's cost to static graphs which take it, such as TTimeDependentGraph; the int argument prefers this overload.
+    The cost is only looked up here, so static graphs without time-dependent costs do no extra work.
+    */
+    template<class G> auto StaticArcIterator(const G& aGraph,TNode* aNode,bool aOutgoing,int) ->
+        decltype(aGraph.ArcIterator(uint32(),aOutgoing,uint32()))
+        {
+        return aGraph.ArcIterator(iExpandedNode,aOutgoing,Cost(aNode));
+        }
+
+    template<class G> auto StaticArcIterator(const G& aGraph,TNode* /*aNode*/,bool aOutgoing,long) ->
+        decltype(aGraph.ArcIterator(uint32(),aOutgoing))
+        {
+        return aGraph.ArcIterator(iExpandedNode,aOutgoing);
+        }
+
+    void Refresh(TNode* aNode)
+        {
+        uint32 generation = IsForward(aNode) ? iForwardGeneration : iBackwardGeneration;
+        if (aNode->iGeneration != generation)
+            {
+            *aNode = TNode();
+            aNode->iGeneration = generation;
+            }
+        }
+
+    static void NextGeneration(std::vector<TNode>& aState,uint32& aGeneration)
+        {
+        if (++aGeneration == 0)
+            {
+            for (auto& n : aState)
+                n = TNode();
+            aGeneration = 1;
+            }
+        }
+
+    const TStaticGraph& iGraph;
+    std::vector<TNode> iForward;
+    std::vector<TNode> iBackward;
+    uint32 iForwardGeneration = 1;
+    uint32 iBackwardGeneration = 1;
+    uint32 iExpandedNode = UINT32_MAX;
+    };
+
+/** A route found by CalculateAlternativeRoutes. */
+class CAlternativeRoute
+    {
+    public:
+    /** The indexes of the nodes along the route, from start to end. */
+    std::vector<uint32> iNode;
+    /** The total cost. */
+    uint32 iCost = 0;
+    /** The cost of the plateau: the part of the route that is the best route both from the start and to the end. */
+    uint32 iPlateauCost = 0;
+    /** The largest cost shared with any route found earlier. */
+    uint32 iSharedCost = 0;
+    };
+
+/**
+Find up to aMaxRouteCount routes from aStartNode to aEndNode using the plateau method, putting them in aRoute.
+The first route is the best one; each alternative costs no more than aMaxStretch times as much,
+shares at most aMaxSharing of its cost with any route found before it, and has a plateau of at least
+aMinPlateau times the cost of the best route, which makes it locally optimal and free of pointless detours.
+
+Only two searches are needed, however many routes are found: one forward from the start and one backward from the end,
+both limited to aMaxStretch times the best cost. A plateau is a chain of nodes on which the two search trees agree,
+and each one gives a candidate route passing through it. Candidates passing through a node of a route already chosen
+are rejected, so no route is returned twice, whatever the value of aMaxSharing.
+*/
+template<class TStaticGraph,class TOpenSet = CRadixHeapOpenSet<TSearchNode<typename TStaticGraph::TArcRef>>>
+TResult CalculateAlternativeRoutes(CSearchGraph<TStaticGraph>& aGraph,uint32 aStartNode,uint32 aEndNode,
+                                   size_t aMaxRouteCount,double aMaxStretch,double aMaxSharing,double aMinPlateau,
+                                   std::vector<CAlternativeRoute>& aRoute)
+    {
+    using TGraph = CSearchGraph<TStaticGraph>;
+    using TNode = typename TGraph::TNode;
+    using TArcRef = typename TGraph::TArcRef;
+    aRoute.clear();
+    aGraph.Reset();
+
+    // Search forward until the end node is settled, then on up to the cost limit.
+    std::vector<uint32> forward_order;
+    uint64 max_cost = UINT32_MAX;
+    uint32 best_cost = UINT32_MAX;
+    TDijkstra<TGraph,TNode,TArcRef,TOpenSet> forward(aGraph,false,true);
+    TResult error = forward.CalculateSettledNodes(aGraph.Node(aStartNode,true),UINT32_MAX,[&](const TNode* aNode,uint32 aCost)->bool
+        {
+        if (aCost > max_cost)
+            return false;
+        uint32 index = aGraph.NodeIndex(aNode);
+        forward_order.push_back(index);
+        if (index == aEndNode)
+            {
+            best_cost = aCost;
+            max_cost = std::min(uint64(aCost * aMaxStretch),uint64(UINT32_MAX - 1));
+            }
+        return true;
+        },false);
+    if (error || best_cost == UINT32_MAX)
+        return error ? error : KErrorNoRoute;
+
+    TDijkstra<TGraph,TNode,TArcRef,TOpenSet> backward(aGraph,false,false);
+    error = backward.CalculateSettledNodes(aGraph.Node(aEndNode,false),uint32(max_cost + 1),[](const TNode*,uint32) { return true; },false);
+    if (error)
+        return error;
+
+    auto forward_cost = [&](uint32 aNode) { return aGraph.NodeCostInQuery(aGraph.Node(aNode,true),true); };
+    auto backward_cost = [&](uint32 aNode) { return aGraph.NodeCostInQuery(aGraph.Node(aNode,true),false); };
+    auto forward_parent = [&](uint32 aNode) { return aGraph.PreviousNodeIndex(aGraph.Node(aNode,true)); };
+    auto backward_parent = [&](uint32 aNode) { return aGraph.PreviousNodeIndex(aGraph.Node(aNode,false)); };
+
+    // Measure the plateaus in order of forward cost, so that each node's forward parent has already been measured.
+    std::unordered_map<uint32,uint32> plateau;
+    std::vector<std::pair<uint32,uint32>> candidate; // (plateau cost, end node)
+    for (uint32 v : forward_order)
+        {
+        uint64 b = backward_cost(v);
+        if (b == UINT32_MAX || forward_cost(v) + b > max_cost)
+            continue;
+        uint32 u = forward_parent(v);
+        uint32 p = 0;
+        if (u != UINT32_MAX && backward_parent(u) == v)
+            {
+            auto q = plateau.find(u);
+            p = (q != plateau.end() ? q->second : 0) + forward_cost(v) - forward_cost(u);
+            }
+        if (p)
+            plateau[v] = p;
+        }
+    for (const auto& q : plateau)
+        {
+        uint32 w = backward_parent(q.first);
+        if (w == UINT32_MAX || forward_parent(w) != q.first)
+            candidate.emplace_back(q.second,q.first);
+        }
+    std::sort(candidate.begin(),candidate.end(),std::greater<std::pair<uint32,uint32>>());
+
+    /*
+    Take the best route, which is the forward tree's route to the end node, then the candidates with the longest plateaus,
+    rejecting those too similar to routes already chosen.
+    */
+    std::vector<std::unordered_map<uint64,uint32>> chosen_arcs;
+    std::unordered_set<uint32> chosen_nodes;
+    auto add_route = [&](uint32 aVia,uint32 aPlateauCost)
+        {
+        // A via node on a route already chosen gives that route again.
+        if (chosen_nodes.count(aVia))
+            return;
+        CAlternativeRoute route;
+        route.iPlateauCost = aPlateauCost;
+        route.iCost = forward_cost(aVia) + backward_cost(aVia);
+        for (uint32 v = aVia; v != UINT32_MAX; v = forward_parent(v))
+            route.iNode.push_back(v);
+        std::reverse(route.iNode.begin(),route.iNode.end());
+        const size_t via_index = route.iNode.size() - 1;
+        for (uint32 v = backward_parent(aVia); v != UINT32_MAX; v = backward_parent(v))
+            route.iNode.push_back(v);
+
+        std::unordered_map<uint64,uint32> arcs;
+        for (size_t i = 1; i < route.iNode.size(); i++)
+            {
+            uint32 u = route.iNode[i - 1], v = route.iNode[i];
+            arcs[(uint64(u) << 32) | v] = i <= via_index ? forward_cost(v) - forward_cost(u) : backward_cost(u) - backward_cost(v);
+            }
+        for (const auto& other : chosen_arcs)
+            {
+            uint64 shared = 0;
+            for (const auto& a : arcs)
+                if (other.count(a.first))
+                    shared += a.second;
+            if (shared > aMaxSharing * route.iCost)
+                return;
+            route.iSharedCost = std::max(route.iSharedCost,uint32(shared));
+            }
+        chosen_nodes.insert(route.iNode.begin(),route.iNode.end());
+        aRoute.push_back(std::move(route));
+        chosen_arcs.push_back(std::move(arcs));
+        };
+
+    auto p = plateau.find(aEndNode);
+    add_route(aEndNode,p != plateau.end() ? p->second : 0);
+    for (const auto& c : candidate)
+        {
+        if (aRoute.size() >= aMaxRouteCount || c.first < aMinPlateau * best_cost)
+            break;
+        add_route(c.second,c.first);
+        }
+    return KErrorNone;
+    }
+
+/**
+A sparse table of arc costs overriding those of a static graph, used to apply traffic information
+and other temporary changes without rebuilding the graph. Setting or removing an override takes constant time.
+The arcs changed since the last call to TakeChangedArcs are recorded, so that data derived from the
+arc costs, such as a customized contraction hierarchy, can be updated incrementally.
+
+TArcRef must be usable as a key in std::unordered_map.
+*/
+template<class TArcRef> class CArcCostOverlay
+    {
+    public:
+    /** An override cost meaning that an arc cannot be used. */
+    static constexpr uint32 KForbidden = UINT32_MAX;
+
+    /** If aArc has an override, set aCost to it and return true, otherwise return false. */
+    bool Find(TArcRef aArc,uint32& aCost) const
+        {
+        if (iCost.empty())
+            return false;
+        auto p = iCost.find(aArc);
+        if (p == iCost.end())
+            return false;
+        aCost = p->second;
+        return true;
+        }
+
+    /** Override the cost of an arc. A cost of KForbidden makes the arc unusable. */
+    void Set(TArcRef aArc,uint32 aCost)
+        {
+        auto p = iCost.emplace(aArc,aCost);
+        if (!p.second)
+            {
+            if (p.first->second == aCost)
+                return;
+            p.first->second = aCost;
+            }
+        Changed(aArc);
+        }
+
+    /** Remove the override for an arc, restoring its original cost; return true if there was an override. */
+    bool Remove(TArcRef aArc)
+        {
+        if (!iCost.erase(aArc))
+            return false;
+        Changed(aArc);
+        return true;
+        }
+
+    /** Remove all the overrides. */
+    void Clear()
+        {
+        for (const auto& p : iCost)
+            Changed(p.first);
+        iCost.clear();
+        }
+
+    /** Return the number of arcs with overridden costs. */
+    size_t Count() const { return iCost.size(); }
+    /** Return the total number of changes made since the overlay was created. */
+    size_t ChangeCount() const { return iChangeCount; }
+    /** Return the number of arc changes not yet taken by TakeChangedArcs. */
+    size_t PendingChangeCount() const { return iChangedArc.size(); }
+
+    /** Move the arcs changed since the last call into aArc, replacing its contents. An arc may appear more than once. */
+    void TakeChangedArcs(std::vector<TArcRef>& aArc)
+        {
+        aArc.clear();
+        aArc.swap(iChangedArc);
+        }
+
+    private:
+    void Changed(TArcRef aArc)
+        {
+        iChangeCount++;
+        iChangedArc.push_back(aArc);
+        }
+
+    std::unordered_map<TArcRef,uint32> iCost;
+    std::vector<TArcRef> iChangedArc;
+    size_t iChangeCount = 0;
+    };
+
+/**
+A static graph, as used by CSearchGraph, with the arc costs of another static graph modified by a CArcCostOverlay.
+The arc iterator looks up each arc in the overlay, using the override cost if there is one and skipping forbidden arcs;
+an empty overlay costs a single test per arc. The overlay must not be changed while a search is using it.
+*/
+template<class TStaticGraph> class TArcCostOverlayGraph
+    {
+    public:
+    using TArcRef = typename TStaticGraph::TArcRef;
+    using TOverlay = CArcCostOverlay<TArcRef>;
+
+    TArcCostOverlayGraph(const TStaticGraph& aGraph,const TOverlay& aOverlay):
+        iGraph(aGraph),
+        iOverlay(aOverlay)
+        {
+        }
+
+    size_t NodeCount() const { return iGraph.NodeCount(); }
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(typename TStaticGraph::TArcIterator aIter,const TOverlay& aOverlay):
+            iIter(aIter),
+            iOverlay(aOverlay)
+            {
+            }
+
+        bool Next(TResult& aError)
+            {
+            while (iIter.Next(aError))
+                {
+                if (!iOverlay.Find(iIter.Arc(),iCost))
+                    iCost = iIter.Cost();
+                if (iCost != TOverlay::KForbidden)
+                    return true;
+                }
+            return false;
+            }
+        TArcRef Arc() { return iIter.Arc(); }
+        uint32 Cost() { return iCost; }
+        uint32 EndNodeIndex() { return iIter.EndNodeIndex(); }
+
+        private:
+        typename TStaticGraph::TArcIterator iIter;
+        const TOverlay& iOverlay;
+        uint32 iCost = 0;
+        };
+
+    TArcIterator ArcIterator(uint32 aNodeIndex,bool aOutgoing) const { return TArcIterator(iGraph.ArcIterator(aNodeIndex,aOutgoing),iOverlay); }
+
+    private:
+    const TStaticGraph& iGraph;
+    const TOverlay& iOverlay;
     };
 
 }
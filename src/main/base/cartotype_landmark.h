@@ -0,0 +1,298 @@
+/*
+CARTOTYPE_LANDMARK.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_LANDMARK_H__
+#define CARTOTYPE_LANDMARK_H__
+
+#include <cartotype_graph.h>
+#include <cartotype_stream.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace CartoType
+{
+
+/**
+A table of the costs from and to a small number of landmark nodes, used to give A* searches lower bounds
+on the remaining cost using the triangle inequality (the ALT method). Good landmarks lie beyond the start or end of a route,
+so they are chosen by repeatedly taking the node farthest from those already chosen.
+
+The table is created once for a map and a route profile and stored in a sidecar file.
+The file holds native-endian 32-bit integers, so that it can be memory-mapped and used by Attach without copying.
+For each node the costs from all the landmarks are followed by the costs to all the landmarks, so that
+the bound for a node is calculated from a single small block of memory. Unreachable pairs have the cost UINT32_MAX.
+*/
+class CLandmarkTable
+    {
+    public:
+    CLandmarkTable() = default;
+    /*
+    A table made by Create reads its costs through pointers into iOwnedData, which a copy would not update.
+    A move keeps the vector's buffer, so the pointers are simply set again from the moved data.
+    */
+    CLandmarkTable(const CLandmarkTable&) = delete;
+    CLandmarkTable& operator=(const CLandmarkTable&) = delete;
+    CLandmarkTable(CLandmarkTable&& aOther) noexcept { *this = std::move(aOther); }
+    CLandmarkTable& operator=(CLandmarkTable&& aOther) noexcept
+        {
+        if (this != &aOther)
+            {
+            Clear();
+            iOwnedData = std::move(aOther.iOwnedData);
+            if (aOther.iLandmark)
+                SetData(aOther.iLandmark - KHeaderSize);
+            aOther.Clear();
+            }
+        return *this;
+        }
+
+    /**
+    Choose aLandmarkCount landmarks in a static graph of the kind used by CSearchGraph and calculate their costs.
+    This takes two complete searches of the graph for each landmark.
+    */
+    template<class TStaticGraph> TResult Create(const TStaticGraph& aGraph,uint32 aLandmarkCount)
+        {
+        using TGraph = CSearchGraph<TStaticGraph>;
+        using TNode = typename TGraph::TNode;
+        using TArcRef = typename TGraph::TArcRef;
+
+        const uint32 node_count = uint32(aGraph.NodeCount());
+        aLandmarkCount = std::min(aLandmarkCount,node_count);
+        iOwnedData.assign(KHeaderSize + size_t(aLandmarkCount) + size_t(node_count) * aLandmarkCount * 2,UINT32_MAX);
+        iOwnedData[0] = KFileSignature;
+        iOwnedData[1] = KFileVersion;
+        iOwnedData[2] = node_count;
+        iOwnedData[3] = aLandmarkCount;
+        SetData(iOwnedData.data());
+
+        TGraph graph(aGraph);
+        std::vector<uint32> nearest(node_count,UINT32_MAX); // the cost from the nearest landmark to each node
+        uint32 landmark = 0;
+        for (uint32 i = 0; i < aLandmarkCount; i++)
+            {
+            iOwnedData[KHeaderSize + i] = landmark;
+            for (int direction = 0; direction < 2; direction++)
+                {
+                const bool forwards = direction == 0;
+                TDijkstra<TGraph,TNode,TArcRef,CRadixHeapOpenSet<TNode>> dijkstra(graph,false,forwards);
+                uint32* cost = iOwnedData.data() + KHeaderSize + aLandmarkCount + i + (forwards ? 0 : aLandmarkCount);
+                TResult error = dijkstra.CalculateSettledNodes(graph.Node(landmark,forwards),UINT32_MAX,[&](const TNode* aNode,uint32 aCost)->bool
+                    {
+                    uint32 n = graph.NodeIndex(aNode);
+                    cost[size_t(n) * aLandmarkCount * 2] = aCost;
+                    if (forwards)
+                        nearest[n] = std::min(nearest[n],aCost);
+                    return true;
+                    });
+                if (error)
+                    {
+                    Clear();
+                    return error;
+                    }
+                }
+
+            // The next landmark is the reachable node farthest from all the landmarks chosen so far.
+            uint32 farthest = 0;
+            for (uint32 n = 0; n < node_count; n++)
+                if (nearest[n] != UINT32_MAX && (nearest[farthest] == UINT32_MAX || nearest[n] > nearest[farthest]))
+                    farthest = n;
+            landmark = farthest;
+            }
+        return KErrorNone;
+        }
+
+    /**
+    Use a table written by Write, usually from a memory-mapped file, without copying it.
+    The data must be aligned on a four-byte boundary and must remain valid while the table is used.
+    */
+    TResult Attach(const uint8* aData,size_t aLength)
+        {
+        Clear();
+        const uint32* data = reinterpret_cast<const uint32*>(aData);
+        if (aLength < KHeaderSize * sizeof(uint32) || (reinterpret_cast<uintptr_t>(aData) % sizeof(uint32)) || data[0] != KFileSignature)
+            return KErrorUnknownDataFormat;
+        if (data[1] != KFileVersion)
+            return KErrorUnknownVersion;
+        if (aLength != (KHeaderSize + size_t(data[3]) + size_t(data[2]) * data[3] * 2) * sizeof(uint32))
+            return KErrorCorrupt;
+        SetData(data);
+        return KErrorNone;
+        }
+
+    /** Write the table in the form used by Attach. */
+    TResult Write(MOutputStream& aOutput) const
+        {
+        if (!iData)
+            return KErrorNone;
+        return aOutput.Write(reinterpret_cast<const uint8*>(iData - KHeaderSize - iLandmarkCount),
+                             (KHeaderSize + iLandmarkCount + size_t(iNodeCount) * iLandmarkCount * 2) * sizeof(uint32));
+        }
+
+    void Clear()
+        {
+        iOwnedData.clear();
+        iData = nullptr;
+        iLandmark = nullptr;
+        iNodeCount = iLandmarkCount = 0;
+        }
+
+    uint32 NodeCount() const { return iNodeCount; }
+    uint32 LandmarkCount() const { return iLandmarkCount; }
+    /** Return the node index of a landmark. */
+    uint32 Landmark(uint32 aIndex) const { return iLandmark[aIndex]; }
+    /** Return the cost from a landmark to a node. */
+    uint32 CostFromLandmark(uint32 aLandmark,uint32 aNode) const { return iData[size_t(aNode) * iLandmarkCount * 2 + aLandmark]; }
+    /** Return the cost from a node to a landmark. */
+    uint32 CostToLandmark(uint32 aLandmark,uint32 aNode) const { return iData[size_t(aNode) * iLandmarkCount * 2 + iLandmarkCount + aLandmark]; }
+
+    /**
+    Return a lower bound on the cost from aFrom to aTo, using the landmarks in aActive,
+    or all the landmarks if aActive is null.
+    */
+    uint32 LowerBound(uint32 aFrom,uint32 aTo,const std::vector<uint32>* aActive = nullptr) const
+        {
+        const uint32* from = iData + size_t(aFrom) * iLandmarkCount * 2;
+        const uint32* to = iData + size_t(aTo) * iLandmarkCount * 2;
+        int64 bound = 0;
+        const uint32 count = aActive ? uint32(aActive->size()) : iLandmarkCount;
+        for (uint32 i = 0; i < count; i++)
+            {
+            const uint32 l = aActive ? (*aActive)[i] : i;
+            // cost(from,to) >= cost(landmark,to) - cost(landmark,from)
+            if (from[l] != UINT32_MAX && to[l] != UINT32_MAX)
+                bound = std::max(bound,int64(to[l]) - int64(from[l]));
+            // cost(from,to) >= cost(from,landmark) - cost(to,landmark)
+            const uint32 from_to_l = from[iLandmarkCount + l], to_to_l = to[iLandmarkCount + l];
+            if (from_to_l != UINT32_MAX && to_to_l != UINT32_MAX)
+                bound = std::max(bound,int64(from_to_l) - int64(to_to_l));
+            }
+        return uint32(bound);
+        }
+
+    /**
+    Put in aActive the aCount landmarks giving the best lower bounds for a route from aStart to aEnd.
+    Using a few well-chosen landmarks for each query makes the bounds cheaper to calculate with little loss of accuracy.
+    */
+    void SelectLandmarks(uint32 aStart,uint32 aEnd,uint32 aCount,std::vector<uint32>& aActive) const
+        {
+        std::vector<std::pair<uint32,uint32>> bound; // (bound, landmark)
+        std::vector<uint32> single(1);
+        for (uint32 i = 0; i < iLandmarkCount; i++)
+            {
+            single[0] = i;
+            bound.emplace_back(LowerBound(aStart,aEnd,&single),i);
+            }
+        aCount = std::min(aCount,iLandmarkCount);
+        std::partial_sort(bound.begin(),bound.begin() + aCount,bound.end(),std::greater<std::pair<uint32,uint32>>());
+        aActive.clear();
+        for (uint32 i = 0; i < aCount; i++)
+            aActive.push_back(bound[i].second);
+        }
+
+    private:
+    static constexpr uint32 KFileSignature = 0x43544C4D; // "CTLM"
+    static constexpr uint32 KFileVersion = 1;
+    static constexpr size_t KHeaderSize = 4; // signature, version, node count, landmark count
+
+    void SetData(const uint32* aData)
+        {
+        iNodeCount = aData[2];
+        iLandmarkCount = aData[3];
+        iLandmark = aData + KHeaderSize;
+        iData = iLandmark + iLandmarkCount;
+        }
+
+    std::vector<uint32> iOwnedData;
+    const uint32* iData = nullptr;
+    const uint32* iLandmark = nullptr;
+    uint32 iNodeCount = 0;
+    uint32 iLandmarkCount = 0;
+    };
+
+/**
+A static graph, as used by CSearchGraph, which turns a Dijkstra search towards a destination into an A* search
+guided by landmark bounds. Arc costs are reduced by the potential, the lower bound on the cost to the destination:
+the cost of an arc from u to v becomes cost + bound(v) - bound(u), which is never negative because landmark bounds are consistent.
+Nodes are therefore settled in order of their cost plus their bound, as in A*.
+
+The cost of a node in a search of this graph is its real cost minus Potential(start) plus Potential(node).
+Only forward searches are supported. If arc costs have changed since the landmark table was created, for example because of
+traffic information, bounds can be too high; reduced costs are then clamped to zero and routes may not be optimal.
+*/
+template<class TStaticGraph> class TLandmarkGraph
+    {
+    public:
+    using TArcRef = typename TStaticGraph::TArcRef;
+
+    /**
+    Create a graph for searches towards aEndNode. If aActiveLandmarkCount is non-zero, only that number of landmarks,
+    chosen as the best for the route from aStartNode to aEndNode, is used.
+    */
+    TLandmarkGraph(const TStaticGraph& aGraph,const CLandmarkTable& aTable,uint32 aStartNode,uint32 aEndNode,uint32 aActiveLandmarkCount = 4):
+        iGraph(aGraph),
+        iTable(aTable),
+        iEndNode(aEndNode)
+        {
+        assert(aTable.NodeCount() == aGraph.NodeCount());
+        if (aActiveLandmarkCount)
+            aTable.SelectLandmarks(aStartNode,aEndNode,aActiveLandmarkCount,iActive);
+        }
+
+    size_t NodeCount() const { return iGraph.NodeCount(); }
+
+    /** Return the lower bound on the cost from a node to the end node. */
+    uint32 Potential(uint32 aNodeIndex) const { return iTable.LowerBound(aNodeIndex,iEndNode,iActive.empty() ? nullptr : &iActive); }
+
+    /** Convert the cost of a node in a search of this graph from aStartNode to the real cost. */
+    uint32 RealCost(uint32 aStartNode,uint32 aNodeIndex,uint32 aCost) const
+        {
+        if (aCost == UINT32_MAX)
+            return UINT32_MAX;
+        return uint32(int64(aCost) + Potential(aStartNode) - Potential(aNodeIndex));
+        }
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(const TLandmarkGraph& aGraph,typename TStaticGraph::TArcIterator aIter,uint32 aPotential):
+            iGraph(aGraph),
+            iIter(aIter),
+            iPotential(aPotential)
+            {
+            }
+
+        bool Next(TResult& aError) { return iIter.Next(aError); }
+        TArcRef Arc() { return iIter.Arc(); }
+        uint32 Cost()
+            {
+            int64 c = int64(iIter.Cost()) + iGraph.Potential(iIter.EndNodeIndex()) - iPotential;
+            return uint32(std::max(c,int64(0)));
+            }
+        uint32 EndNodeIndex() { return iIter.EndNodeIndex(); }
+
+        private:
+        const TLandmarkGraph& iGraph;
+        typename TStaticGraph::TArcIterator iIter;
+        uint32 iPotential;
+        };
+
+    TArcIterator ArcIterator(uint32 aNodeIndex,bool aOutgoing) const
+        {
+        assert(aOutgoing);
+        return TArcIterator(*this,iGraph.ArcIterator(aNodeIndex,aOutgoing),Potential(aNodeIndex));
+        }
+
+    private:
+    const TStaticGraph& iGraph;
+    const CLandmarkTable& iTable;
+    uint32 iEndNode;
+    std::vector<uint32> iActive;
+    };
+
+}
+
+#endif
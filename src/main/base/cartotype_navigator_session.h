@@ -0,0 +1,277 @@
+/*
+CARTOTYPE_NAVIGATOR_SESSION.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_NAVIGATOR_SESSION_H__
+#define CARTOTYPE_NAVIGATOR_SESSION_H__
+
+#include <cartotype_navigation.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <thread>
+
+namespace CartoType
+{
+
+/**
+The navigation state of a single vehicle, for guiding many vehicles at once against a shared map and router.
+
+A session holds only what differs between vehicles: a reference to its route, which is immutable and may be shared
+by many sessions, the position on the route, the navigator state, the turn state, and the identifiers of nearby objects.
+Turns are stored as route segment indexes, and the TNavigatorTurn objects with their names and instructions
+are created only when asked for.
+
+A session uses sizeof(CNavigatorSession) bytes, which is 248 bytes on 64-bit systems, plus 8 bytes for each nearby object:
+about 2.5Mb for 10,000 vehicles, excluding their routes.
+
+Sessions are updated by Update, or in parallel by NavigateSessions, given fixes already converted to map coordinates.
+A session may be updated by only one thread at a time, but different sessions may be updated in parallel.
+*/
+class CNavigatorSession
+    {
+    public:
+    /** Bit values for the events returned by Update. */
+    static constexpr uint32 KTurnChanged = 1;
+    static constexpr uint32 KTurnRound = 2;
+    static constexpr uint32 KPositionKnown = 4;
+    static constexpr uint32 KPositionUnknown = 8;
+    static constexpr uint32 KReRouteNeeded = 16;
+
+    CNavigatorSession() = default;
+    explicit CNavigatorSession(std::shared_ptr<const CRoute> aRoute)
+        {
+        SetRoute(std::move(aRoute));
+        }
+
+    /** Set the route, which may be null, and reset the navigation state. */
+    void SetRoute(std::shared_ptr<const CRoute> aRoute)
+        {
+        iRoute = std::move(aRoute);
+        iPositionOnRoute = TNearestSegmentInfo();
+        iState = iRoute && !iRoute->Empty() ? TNavigatorState::NoPosition : TNavigatorState::None;
+        iOffRouteTime = -1;
+        iFirstTurnSegment = iSecondTurnSegment = iContinuationTurnSegment = -1;
+        iFirstTurnDistance = iSecondTurnDistance = iContinuationTurnDistance = 0;
+        iFirstTurnTime = iSecondTurnTime = iContinuationTurnTime = 0;
+        }
+
+    const CRoute* Route() const { return iRoute.get(); }
+    const std::shared_ptr<const CRoute>& SharedRoute() const { return iRoute; }
+    TNavigatorState State() const { return iState; }
+    /** Return the nearest point on the route to the last position used. */
+    const TNearestSegmentInfo& PositionOnRoute() const { return iPositionOnRoute; }
+    /** Return the last navigation fix, in map coordinates. */
+    const TNavigationData& LastFix() const { return iLastFix; }
+
+    /** Return the first significant turn after the current position, or the arrival point if there are no more turns. */
+    TNavigatorTurn FirstTurn() const { return Turn(iFirstTurnSegment,iFirstTurnDistance,iFirstTurnTime); }
+    /** Return the significant turn 100 metres or less after the first turn, if any; its type is TTurnType::None if there is none. */
+    TNavigatorTurn SecondTurn() const { return Turn(iSecondTurnSegment,iSecondTurnDistance,iSecondTurnTime); }
+    /** Return the 'ahead' or 'continue' turn before the first turn, if any; its type is TTurnType::None if there is none. */
+    TNavigatorTurn ContinuationTurn() const { return Turn(iContinuationTurnSegment,iContinuationTurnDistance,iContinuationTurnTime); }
+
+    /**
+    Update the session with a navigation fix whose position is in map coordinates, and return the events caused,
+    as a combination of the bit values KTurnChanged, etc. If KReRouteNeeded is returned the caller should calculate a new route
+    from the current position and call SetRoute.
+    */
+    uint32 Update(const TNavigationData& aFix,const TNavigatorParam& aParam)
+        {
+        if (!iRoute || iRoute->Empty() || !aParam.iNavigationEnabled)
+            {
+            iLastFix = aFix;
+            iState = TNavigatorState::None;
+            return 0;
+            }
+
+        const bool had_position = iState != TNavigatorState::NoPosition && iState != TNavigatorState::None;
+        if (!(aFix.iValidity & TNavigationData::KPositionValid))
+            {
+            iState = TNavigatorState::NoPosition;
+            return had_position ? KPositionUnknown : 0;
+            }
+
+        // Ignore movements on the route too small to be distinguished from position errors; off the route, time still counts.
+        const double scale = iRoute->iPointScale;
+        const double dx = (aFix.iPosition.iX - iLastFix.iPosition.iX) * scale;
+        const double dy = (aFix.iPosition.iY - iLastFix.iPosition.iY) * scale;
+        if (iState == TNavigatorState::OnRoute && std::sqrt(dx * dx + dy * dy) < aParam.iMinimumFixDistance)
+            return 0;
+
+        uint32 events = had_position ? 0 : KPositionKnown;
+        const double previous_distance = iPositionOnRoute.iDistanceAlongRoute;
+        const int32 previous_first_turn = iFirstTurnSegment;
+        const int32 section = iPositionOnRoute.iSegmentIndex >= 0 ? iRoute->iRouteSegment[iPositionOnRoute.iSegmentIndex]->iSection : 0;
+        iRoute->GetNearestSegment(TPoint(int32(std::round(aFix.iPosition.iX)),int32(std::round(aFix.iPosition.iY))),
+                                  iPositionOnRoute,section,had_position ? previous_distance : 0);
+        iLastFix = aFix;
+
+        if (iPositionOnRoute.iDistanceToRoute <= aParam.iRouteDistanceTolerance)
+            {
+            iState = TNavigatorState::OnRoute;
+            iOffRouteTime = -1;
+            // Moving back along the route by more than the tolerance means going the wrong way.
+            if (had_position && previous_distance - iPositionOnRoute.iDistanceAlongRoute > aParam.iRouteDistanceTolerance)
+                events |= KTurnRound;
+            UpdateTurns();
+            if (iFirstTurnSegment != previous_first_turn || !had_position)
+                events |= KTurnChanged;
+            }
+        else
+            {
+            if (iOffRouteTime < 0)
+                iOffRouteTime = aFix.iTime;
+            if (aFix.iTime - iOffRouteTime >= aParam.iRouteTimeTolerance || iState == TNavigatorState::ReRouteNeeded)
+                {
+                iState = TNavigatorState::ReRouteNeeded;
+                events |= KReRouteNeeded;
+                }
+            else
+                iState = TNavigatorState::OffRoute;
+            }
+        return events;
+        }
+
+    /**
+    Replace the set of nearby objects with aObjectId, which is sorted into order, and put the identifiers of the objects
+    which have become nearby in aAdded, and of those which are no longer nearby in aRemoved.
+    */
+    void UpdateNearbyObjects(std::vector<uint64>& aObjectId,std::vector<uint64>& aAdded,std::vector<uint64>& aRemoved)
+        {
+        std::sort(aObjectId.begin(),aObjectId.end());
+        aObjectId.erase(std::unique(aObjectId.begin(),aObjectId.end()),aObjectId.end());
+        aAdded.clear();
+        aRemoved.clear();
+        std::set_difference(aObjectId.begin(),aObjectId.end(),iNearbyObject.begin(),iNearbyObject.end(),std::back_inserter(aAdded));
+        std::set_difference(iNearbyObject.begin(),iNearbyObject.end(),aObjectId.begin(),aObjectId.end(),std::back_inserter(aRemoved));
+        iNearbyObject = aObjectId;
+        }
+
+    /** Return the identifiers of the nearby objects, in ascending order. */
+    const std::vector<uint64>& NearbyObjects() const { return iNearbyObject; }
+
+    private:
+    static constexpr double KSecondTurnDistance = 100;
+
+    static bool SignificantTurn(const TTurn& aTurn)
+        {
+        return !aTurn.iContinue && aTurn.iTurnType != TTurnType::None && aTurn.iTurnType != TTurnType::Ahead;
+        }
+
+    TNavigatorTurn Turn(int32 aSegment,double aDistance,double aTime) const
+        {
+        if (aSegment < 0 || !iRoute)
+            return TNavigatorTurn();
+        const auto& segment = iRoute->iRouteSegment;
+        if (aSegment >= int32(segment.size()))
+            return TNavigatorTurn(*segment.back(),nullptr,aDistance,aTime);
+        return TNavigatorTurn(aSegment ? *segment[aSegment - 1] : *segment[0],*segment[aSegment],aDistance,aTime);
+        }
+
+    // Find the turns ahead of the current position by walking forwards along the route segments.
+    void UpdateTurns()
+        {
+        const auto& segment = iRoute->iRouteSegment;
+        const int32 count = int32(segment.size());
+        const int32 cur = std::max(iPositionOnRoute.iSegmentIndex,int32(0));
+        double distance = segment[cur]->iDistance - iPositionOnRoute.iDistanceAlongSegment;
+        double time = segment[cur]->iTime - iPositionOnRoute.iTimeAlongSegment;
+
+        iFirstTurnSegment = iSecondTurnSegment = iContinuationTurnSegment = -1;
+        int32 k = cur + 1;
+        for (; k < count; k++)
+            {
+            const TTurn& turn = segment[k]->iTurn;
+            if (SignificantTurn(turn))
+                break;
+            if (iContinuationTurnSegment < 0 && turn.iTurnType != TTurnType::None)
+                {
+                iContinuationTurnSegment = k;
+                iContinuationTurnDistance = distance;
+                iContinuationTurnTime = time;
+                }
+            distance += segment[k]->iDistance;
+            time += segment[k]->iTime;
+            }
+
+        // If there are no more significant turns, the first turn is the arrival point, represented by the segment index count.
+        iFirstTurnSegment = k;
+        iFirstTurnDistance = distance;
+        iFirstTurnTime = time;
+        if (k >= count)
+            return;
+
+        double second_distance = segment[k]->iDistance;
+        double second_time = segment[k]->iTime;
+        for (int32 j = k + 1; j < count && second_distance <= KSecondTurnDistance; j++)
+            {
+            if (SignificantTurn(segment[j]->iTurn))
+                {
+                iSecondTurnSegment = j;
+                iSecondTurnDistance = second_distance;
+                iSecondTurnTime = second_time;
+                break;
+                }
+            second_distance += segment[j]->iDistance;
+            second_time += segment[j]->iTime;
+            }
+        }
+
+    std::shared_ptr<const CRoute> iRoute;
+    TNearestSegmentInfo iPositionOnRoute;
+    TNavigationData iLastFix;
+    TNavigatorState iState = TNavigatorState::None;
+    double iOffRouteTime = -1; // the time at which the vehicle left the route, or -1 if it is on the route
+    int32 iFirstTurnSegment = -1;
+    int32 iSecondTurnSegment = -1;
+    int32 iContinuationTurnSegment = -1;
+    double iFirstTurnDistance = 0;
+    double iSecondTurnDistance = 0;
+    double iContinuationTurnDistance = 0;
+    double iFirstTurnTime = 0;
+    double iSecondTurnTime = 0;
+    double iContinuationTurnTime = 0;
+    std::vector<uint64> iNearbyObject;
+    };
+
+/**
+Update a set of sessions, each with the fix with the same index in aFix, whose positions are in map coordinates,
+putting the events returned by CNavigatorSession::Update in aEvents. The sessions are divided between up to aThreadCount threads;
+a thread count of zero uses the number of hardware threads.
+*/
+inline void NavigateSessions(const std::vector<CNavigatorSession*>& aSession,const std::vector<TNavigationData>& aFix,
+                             const TNavigatorParam& aParam,std::vector<uint32>& aEvents,size_t aThreadCount = 0)
+    {
+    assert(aSession.size() == aFix.size());
+    aEvents.assign(aSession.size(),0);
+    if (aThreadCount == 0)
+        aThreadCount = std::max(1U,std::thread::hardware_concurrency());
+    // Updates are fast, so hand them out in blocks to reduce contention.
+    const size_t KBlockSize = 64;
+    aThreadCount = std::max(size_t(1),std::min(aThreadCount,(aSession.size() + KBlockSize - 1) / KBlockSize));
+
+    std::atomic<size_t> next_block(0);
+    auto worker = [&]()
+        {
+        for (size_t start = KBlockSize * next_block++; start < aSession.size(); start = KBlockSize * next_block++)
+            {
+            const size_t end = std::min(aSession.size(),start + KBlockSize);
+            for (size_t i = start; i < end; i++)
+                aEvents[i] = aSession[i]->Update(aFix[i],aParam);
+            }
+        };
+    std::vector<std::thread> thread;
+    for (size_t i = 1; i < aThreadCount; i++)
+        thread.emplace_back(worker);
+    worker();
+    for (auto& t : thread)
+        t.join();
+    }
+
+}
+
+#endif
@@ -0,0 +1,387 @@
+/*
+CARTOTYPE_ROAD_INDEX.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_ROAD_INDEX_H__
+#define CARTOTYPE_ROAD_INDEX_H__
+
+#include <cartotype_base.h>
+#include <cartotype_errors.h>
+#include <cartotype_stream.h>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace CartoType
+{
+
+/** A straight segment of a road arc, as stored in a CRoadSegmentIndex. */
+class TRoadSegment
+    {
+    public:
+    /** The x coordinate of the start of the segment. */
+    int32 iX0;
+    /** The y coordinate of the start of the segment. */
+    int32 iY0;
+    /** The x coordinate of the end of the segment. */
+    int32 iX1;
+    /** The y coordinate of the end of the segment. */
+    int32 iY1;
+    /** The arc containing the segment. */
+    uint32 iArc;
+    /** The index of the segment within its arc. */
+    uint16 iIndex;
+    /** True if the road can be travelled only from the start to the end of the segment. */
+    uint16 iOneWay;
+    };
+
+/** A road segment found by CRoadSegmentIndex::FindNearest. */
+class TRoadSegmentMatch
+    {
+    public:
+    /** The index of the segment in the CRoadSegmentIndex. */
+    uint32 iSegment = 0;
+    /** The arc containing the segment. */
+    uint32 iArc = 0;
+    /** The index of the segment within its arc. */
+    uint32 iIndexInArc = 0;
+    /** The distance from the point to the segment in map units. */
+    double iDistance = 0;
+    /** The nearest point on the segment. */
+    TPointFP iNearestPoint;
+    /** The position of the nearest point along the segment, from 0 at the start to 1 at the end. */
+    double iFraction = 0;
+    };
+
+/**
+A packed Hilbert R-tree of road segments, for finding the nearest roads to a point quickly,
+as needed when matching position fixes to the road network.
+
+Segments are sorted by the Hilbert curve index of their centres, so that nearby segments are stored together,
+then packed into leaves of KNodeSize segments, and the leaves into parent nodes of KNodeSize children, up to a single root.
+The tree is immutable and has no pointers: each level is a contiguous array of bounding boxes, and the children of node i
+are nodes i * KNodeSize ... i * KNodeSize + KNodeSize - 1 of the level below, so a query touches few cache lines.
+
+The index can be written to a file of native-endian 32-bit words and used from a memory-mapped copy of that file without copying.
+*/
+class CRoadSegmentIndex
+    {
+    public:
+    /** The number of children of each node. */
+    static constexpr uint32 KNodeSize = 16;
+
+    CRoadSegmentIndex() = default;
+    /*
+    The level, box and segment arrays of a built index lie inside iOwnedData, so the index is not copyable.
+    Moving it transfers the buffer without reallocating it, and SetData finds the arrays again at the same addresses.
+    */
+    CRoadSegmentIndex(const CRoadSegmentIndex&) = delete;
+    CRoadSegmentIndex& operator=(const CRoadSegmentIndex&) = delete;
+    CRoadSegmentIndex(CRoadSegmentIndex&& aOther) noexcept { *this = std::move(aOther); }
+    CRoadSegmentIndex& operator=(CRoadSegmentIndex&& aOther) noexcept
+        {
+        if (this != &aOther)
+            {
+            Clear();
+            iOwnedData = std::move(aOther.iOwnedData);
+            if (aOther.iData)
+                SetData(aOther.iData);
+            aOther.Clear();
+            }
+        return *this;
+        }
+
+    /** Build the index from a set of segments, which are stored in the index in a different order. */
+    void Create(const std::vector<TRoadSegment>& aSegment)
+        {
+        const uint32 segment_count = uint32(aSegment.size());
+        TRect bounds(INT32_MAX,INT32_MAX,INT32_MIN,INT32_MIN);
+        for (const auto& s : aSegment)
+            {
+            bounds.iTopLeft.iX = std::min(bounds.iTopLeft.iX,std::min(s.iX0,s.iX1));
+            bounds.iTopLeft.iY = std::min(bounds.iTopLeft.iY,std::min(s.iY0,s.iY1));
+            bounds.iBottomRight.iX = std::max(bounds.iBottomRight.iX,std::max(s.iX0,s.iX1));
+            bounds.iBottomRight.iY = std::max(bounds.iBottomRight.iY,std::max(s.iY0,s.iY1));
+            }
+
+        // Sort the segments by the Hilbert index of their centres on a 65536 x 65536 grid covering the bounds.
+        std::vector<std::pair<uint32,uint32>> order(segment_count);
+        const double x_scale = 65535.0 / std::max(1.0,double(bounds.iBottomRight.iX) - bounds.iTopLeft.iX);
+        const double y_scale = 65535.0 / std::max(1.0,double(bounds.iBottomRight.iY) - bounds.iTopLeft.iY);
+        for (uint32 i = 0; i < segment_count; i++)
+            {
+            const auto& s = aSegment[i];
+            uint32 x = uint32(((double(s.iX0) + s.iX1) / 2 - bounds.iTopLeft.iX) * x_scale);
+            uint32 y = uint32(((double(s.iY0) + s.iY1) / 2 - bounds.iTopLeft.iY) * y_scale);
+            order[i] = std::make_pair(HilbertIndex(x,y),i);
+            }
+        std::sort(order.begin(),order.end());
+
+        const std::vector<uint32> level_count = LevelCounts(segment_count);
+        uint32 node_count = 0;
+        for (uint32 n : level_count)
+            node_count += n;
+
+        const size_t words = KHeaderSize + level_count.size() + 1 + size_t(node_count) * 4 + size_t(segment_count) * KSegmentWords;
+        iOwnedData.assign(words,0);
+        uint32* data = iOwnedData.data();
+        data[0] = KFileSignature;
+        data[1] = KFileVersion;
+        data[2] = segment_count;
+        data[3] = uint32(level_count.size());
+        uint32* level_start = data + KHeaderSize;
+        level_start[0] = 0;
+        for (size_t i = 0; i < level_count.size(); i++)
+            level_start[i + 1] = level_start[i] + level_count[i];
+        SetData(data);
+
+        int32* box = reinterpret_cast<int32*>(level_start + level_count.size() + 1);
+        TRoadSegment* segment = reinterpret_cast<TRoadSegment*>(box + size_t(node_count) * 4);
+        for (uint32 i = 0; i < segment_count; i++)
+            segment[i] = aSegment[order[i].second];
+
+        // Calculate the bounding boxes of the leaves, then of each level above.
+        for (uint32 level = 0; level < LevelCount(); level++)
+            {
+            const uint32 child_count = level ? LevelNodeCount(level - 1) : segment_count;
+            for (uint32 node = 0; node < LevelNodeCount(level); node++)
+                {
+                int32* b = box + size_t(level_start[level] + node) * 4;
+                b[0] = b[1] = INT32_MAX;
+                b[2] = b[3] = INT32_MIN;
+                const uint32 end = std::min(child_count,(node + 1) * KNodeSize);
+                for (uint32 c = node * KNodeSize; c < end; c++)
+                    {
+                    int32 cb[4] = {};
+                    if (level)
+                        std::copy(box + size_t(level_start[level - 1] + c) * 4,box + size_t(level_start[level - 1] + c) * 4 + 4,cb);
+                    else
+                        {
+                        const auto& s = segment[c];
+                        cb[0] = std::min(s.iX0,s.iX1); cb[1] = std::min(s.iY0,s.iY1);
+                        cb[2] = std::max(s.iX0,s.iX1); cb[3] = std::max(s.iY0,s.iY1);
+                        }
+                    b[0] = std::min(b[0],cb[0]); b[1] = std::min(b[1],cb[1]);
+                    b[2] = std::max(b[2],cb[2]); b[3] = std::max(b[3],cb[3]);
+                    }
+                }
+            }
+        }
+
+    /**
+    Use an index written by Write, usually from a memory-mapped file, without copying it.
+    The data must be aligned on a four-byte boundary and must remain valid while the index is used.
+    */
+    TResult Attach(const uint8* aData,size_t aLength)
+        {
+        Clear();
+        const uint32* data = reinterpret_cast<const uint32*>(aData);
+        if (aLength < KHeaderSize * sizeof(uint32) || (reinterpret_cast<uintptr_t>(aData) % sizeof(uint32)) || data[0] != KFileSignature)
+            return KErrorUnknownDataFormat;
+        if (data[1] != KFileVersion)
+            return KErrorUnknownVersion;
+        const size_t level_words = size_t(data[3]) + 1;
+        if (aLength < (KHeaderSize + level_words) * sizeof(uint32))
+            return KErrorCorrupt;
+
+        // The levels must be those Create makes for this number of segments, so that every child index is in range.
+        const std::vector<uint32> level_count = LevelCounts(data[2]);
+        const uint32* level_start = data + KHeaderSize;
+        if (data[3] != level_count.size() || level_start[0] != 0)
+            return KErrorCorrupt;
+        for (size_t i = 0; i < level_count.size(); i++)
+            if (level_start[i + 1] < level_start[i] || level_start[i + 1] - level_start[i] != level_count[i])
+                return KErrorCorrupt;
+        const uint32 node_count = level_start[data[3]];
+        if (aLength != (KHeaderSize + level_words + size_t(node_count) * 4 + size_t(data[2]) * KSegmentWords) * sizeof(uint32))
+            return KErrorCorrupt;
+        SetData(data);
+        return KErrorNone;
+        }
+
+    /** Write the index in the form used by Attach. */
+    TResult Write(MOutputStream& aOutput) const
+        {
+        if (!iData)
+            return KErrorNone;
+        const size_t words = KHeaderSize + LevelCount() + 1 + size_t(iLevelStart[LevelCount()]) * 4 + size_t(SegmentCount()) * KSegmentWords;
+        return aOutput.Write(reinterpret_cast<const uint8*>(iData),words * sizeof(uint32));
+        }
+
+    void Clear()
+        {
+        iOwnedData.clear();
+        iData = nullptr;
+        iLevelStart = nullptr;
+        iBox = nullptr;
+        iSegment = nullptr;
+        }
+
+    uint32 SegmentCount() const { return iData ? iData[2] : 0; }
+    const TRoadSegment& Segment(uint32 aIndex) const { return iSegment[aIndex]; }
+
+    /**
+    Find up to aMaxCount segments nearest to aPoint and no farther away than aMaxDistance, putting them in aMatch,
+    nearest first, and return the number found.
+
+    If aHeading is non-negative it is a direction of travel in degrees clockwise from north (the positive y axis),
+    and only segments which can be travelled in a direction within aMaxHeadingDifference degrees of it are returned.
+    */
+    size_t FindNearest(const TPointFP& aPoint,double aMaxDistance,std::vector<TRoadSegmentMatch>& aMatch,size_t aMaxCount = 1,
+                       double aHeading = -1,double aMaxHeadingDifference = 45) const
+        {
+        aMatch.clear();
+        if (!iData || !SegmentCount() || !aMaxCount)
+            return 0;
+
+        const bool use_heading = aHeading >= 0;
+        const double heading_x = std::sin(aHeading * KPi / 180);
+        const double heading_y = std::cos(aHeading * KPi / 180);
+        const double min_cos = std::cos(aMaxHeadingDifference * KPi / 180);
+
+        // Search best-first, visiting nodes in order of their distance from the point, until no node can contain a better segment.
+        double max_distance2 = aMaxDistance * aMaxDistance;
+        std::priority_queue<TQueueEntry,std::vector<TQueueEntry>,std::greater<TQueueEntry>> queue;
+        queue.push(TQueueEntry { 0,LevelCount() - 1,0 });
+        auto worst = [&]() { return aMatch.size() < aMaxCount ? max_distance2 : aMatch.back().iDistance; };
+        while (!queue.empty())
+            {
+            TQueueEntry e = queue.top();
+            queue.pop();
+            if (e.iDistance2 > worst())
+                break;
+            const uint32 first = e.iNode * KNodeSize;
+            if (e.iLevel)
+                {
+                const uint32 end = std::min(LevelNodeCount(e.iLevel - 1),first + KNodeSize);
+                for (uint32 c = first; c < end; c++)
+                    {
+                    const int32* b = iBox + size_t(iLevelStart[e.iLevel - 1] + c) * 4;
+                    double dx = std::max(std::max(b[0] - aPoint.iX,aPoint.iX - b[2]),0.0);
+                    double dy = std::max(std::max(b[1] - aPoint.iY,aPoint.iY - b[3]),0.0);
+                    double d2 = dx * dx + dy * dy;
+                    if (d2 <= worst())
+                        queue.push(TQueueEntry { d2,e.iLevel - 1,c });
+                    }
+                continue;
+                }
+
+            const uint32 end = std::min(SegmentCount(),first + KNodeSize);
+            for (uint32 i = first; i < end; i++)
+                {
+                const TRoadSegment& s = iSegment[i];
+                const double vx = double(s.iX1) - s.iX0, vy = double(s.iY1) - s.iY0;
+                const double length2 = vx * vx + vy * vy;
+                if (use_heading && length2 > 0)
+                    {
+                    double c = (vx * heading_x + vy * heading_y) / std::sqrt(length2);
+                    if (!s.iOneWay)
+                        c = std::abs(c);
+                    if (c < min_cos)
+                        continue;
+                    }
+                double t = length2 > 0 ? ((aPoint.iX - s.iX0) * vx + (aPoint.iY - s.iY0) * vy) / length2 : 0;
+                t = std::min(std::max(t,0.0),1.0);
+                const TPointFP p(s.iX0 + t * vx,s.iY0 + t * vy);
+                const double d2 = (p.iX - aPoint.iX) * (p.iX - aPoint.iX) + (p.iY - aPoint.iY) * (p.iY - aPoint.iY);
+                if (d2 > worst() || (aMatch.size() == aMaxCount && d2 == worst()))
+                    continue;
+
+                // Insert the match in order, storing the squared distance until the search is finished.
+                TRoadSegmentMatch m;
+                m.iSegment = i;
+                m.iArc = s.iArc;
+                m.iIndexInArc = s.iIndex;
+                m.iDistance = d2;
+                m.iNearestPoint = p;
+                m.iFraction = t;
+                auto pos = std::upper_bound(aMatch.begin(),aMatch.end(),d2,[](double aD,const TRoadSegmentMatch& aM) { return aD < aM.iDistance; });
+                aMatch.insert(pos,m);
+                if (aMatch.size() > aMaxCount)
+                    aMatch.pop_back();
+                }
+            }
+
+        for (auto& m : aMatch)
+            m.iDistance = std::sqrt(m.iDistance);
+        return aMatch.size();
+        }
+
+    private:
+    static constexpr uint32 KFileSignature = 0x43545249; // "CTRI"
+    static constexpr uint32 KFileVersion = 1;
+    static constexpr size_t KHeaderSize = 4; // signature, version, segment count, level count
+    static constexpr size_t KSegmentWords = sizeof(TRoadSegment) / sizeof(uint32);
+    static constexpr double KPi = 3.14159265358979323846;
+
+    class TQueueEntry
+        {
+        public:
+        bool operator>(const TQueueEntry& aOther) const { return iDistance2 > aOther.iDistance2; }
+
+        double iDistance2;
+        uint32 iLevel;
+        uint32 iNode;
+        };
+
+    // Return the index of a point on a Hilbert curve filling a 65536 x 65536 grid.
+    static uint32 HilbertIndex(uint32 aX,uint32 aY)
+        {
+        uint32 index = 0;
+        for (uint32 s = 1 << 15; s > 0; s >>= 1)
+            {
+            uint32 rx = (aX & s) > 0;
+            uint32 ry = (aY & s) > 0;
+            index += s * s * ((3 * rx) ^ ry);
+            if (ry == 0)
+                {
+                if (rx == 1)
+                    {
+                    aX = s - 1 - aX;
+                    aY = s - 1 - aY;
+                    }
+                std::swap(aX,aY);
+                }
+            }
+        return index;
+        }
+
+    // Return the number of nodes at each level, from the leaves upwards.
+    static std::vector<uint32> LevelCounts(uint32 aSegmentCount)
+        {
+        std::vector<uint32> level_count;
+        for (uint32 n = aSegmentCount; ; )
+            {
+            n = uint32((uint64(n) + KNodeSize - 1) / KNodeSize);
+            level_count.push_back(n);
+            if (n <= 1)
+                break;
+            }
+        return level_count;
+        }
+
+    uint32 LevelCount() const { return iData[3]; }
+    uint32 LevelNodeCount(uint32 aLevel) const { return iLevelStart[aLevel + 1] - iLevelStart[aLevel]; }
+
+    void SetData(const uint32* aData)
+        {
+        iData = aData;
+        iLevelStart = aData + KHeaderSize;
+        iBox = reinterpret_cast<const int32*>(iLevelStart + LevelCount() + 1);
+        iSegment = reinterpret_cast<const TRoadSegment*>(iBox + size_t(iLevelStart[LevelCount()]) * 4);
+        }
+
+    std::vector<uint32> iOwnedData;
+    const uint32* iData = nullptr;
+    const uint32* iLevelStart = nullptr;  // the index of the first node of each level in iBox, plus one for the end
+    const int32* iBox = nullptr;          // the bounding box of each node as left, top, right, bottom
+    const TRoadSegment* iSegment = nullptr;
+    };
+
+}
+
+#endif
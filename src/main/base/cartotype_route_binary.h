@@ -0,0 +1,607 @@
+/*
+CARTOTYPE_ROUTE_BINARY.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_ROUTE_BINARY_H__
+#define CARTOTYPE_ROUTE_BINARY_H__
+
+#include <cartotype_navigation.h>
+#include <cartotype_stream.h>
+#include <cmath>
+#include <unordered_map>
+
+namespace CartoType
+{
+
+/*
+The compact binary route format (CTRB) is a sequence of variable-length integers written by TDataOutputStream::WriteUint and WriteInt,
+except for the signature, which is a 32-bit integer, and the route profile, whose real numbers are written by WriteDouble.
+Distances are stored in millimetres, times in milliseconds, and speeds and angles in thousandths.
+
+signature, version
+distance, time, point scale (as WriteDouble)
+route profile
+the paths to the junctions before and after the route
+the route's path, or an empty path if it is the concatenation of the segment paths
+the string table: the number of strings, then for each string its length in bytes and its UTF-8 text;
+    strings are referred to by their index plus one, and zero means the empty string
+the number of segments, then for each segment:
+    road type, max speed, name, ref, distance, time, turn time, section, flags,
+    turn type, roundabout state, turn angle, exit number, choices, left alternatives, right alternatives, junction name, junction ref,
+    path
+
+A path is the number of points times two, plus one if point types follow the points, then the first point
+and the differences between successive points, each as a pair of signed integers, then the types, if any, as one integer each.
+*/
+
+/** Information about a segment in a CBinaryRoute. Strings point into the route data and are not null-terminated. */
+class TBinaryRouteSegment
+    {
+    public:
+    TRoadType iRoadType = TRoadType::UnknownMajor;
+    double iMaxSpeed = 0;
+    const char* iName = nullptr;
+    size_t iNameLength = 0;
+    const char* iRef = nullptr;
+    size_t iRefLength = 0;
+    double iDistance = 0;
+    double iTime = 0;
+    double iTurnTime = 0;
+    int32 iSection = 0;
+    bool iRestricted = false;
+    TTurnType iTurnType = TTurnType::None;
+    bool iContinue = true;
+    bool iIsFork = false;
+    bool iTurnOff = false;
+    TRoundaboutState iRoundaboutState = TRoundaboutState::None;
+    double iTurnAngle = 0;
+    int32 iExitNumber = 0;
+    int32 iChoices = 0;
+    int32 iLeftAlternatives = 0;
+    int32 iRightAlternatives = 0;
+    const char* iJunctionName = nullptr;
+    size_t iJunctionNameLength = 0;
+    const char* iJunctionRef = nullptr;
+    size_t iJunctionRefLength = 0;
+    /** The number of points in the path. */
+    size_t iPointCount = 0;
+    /** The offset of the path in the route data, used by CBinaryRoute::GetPath. */
+    size_t iPathOffset = 0;
+    };
+
+/**
+A route in the compact binary format, used without copying its data, which must remain valid while the object is used.
+Attach makes a single pass through the data, recording where each segment and string starts, so that segments
+can be read in any order without heap allocation; CreateRoute converts the whole route to a CRoute.
+*/
+class CBinaryRoute
+    {
+    public:
+    static constexpr uint32 KFileSignature = 0x43545242; // "CTRB"
+    static constexpr uint32 KFileVersion = 1;
+
+    /** Use the binary route in aData. */
+    TResult Attach(const uint8* aData,size_t aLength)
+        {
+        iData = aData;
+        iLength = aLength;
+        iSegmentOffset.clear();
+        iStringOffset.clear();
+        TMemoryInputStream memory(aData,aLength);
+        TDataInputStream input(memory);
+        TResult error = ReadHeader(input,iDistance,iTime,iPointScale);
+        TRouteProfile profile;
+        CPathToJunction path_to_junction;
+        if (!error)
+            error = ReadProfile(input,profile);
+        for (int i = 0; i < 2 && !error; i++)
+            error = ReadPathToJunction(input,path_to_junction);
+        if (!error)
+            error = SkipPath(input);
+
+        uint64 count = error ? 0 : input.ReadUint(error);
+        if (!error && count > aLength)
+            error = KErrorCorrupt;
+        for (uint64 i = 0; i < count && !error; i++)
+            {
+            iStringOffset.push_back(size_t(input.Position()));
+            uint64 length = input.ReadUint(error);
+            if (!error && length > aLength - size_t(input.Position()))
+                error = KErrorCorrupt;
+            if (!error)
+                error = input.Skip(int64(length));
+            }
+
+        count = error ? 0 : input.ReadUint(error);
+        if (!error && count > aLength)
+            error = KErrorCorrupt;
+        TBinaryRouteSegment segment;
+        for (uint64 i = 0; i < count && !error; i++)
+            {
+            iSegmentOffset.push_back(size_t(input.Position()));
+            error = ReadSegment(input,segment);
+            if (!error)
+                error = SkipPath(input);
+            }
+        if (error)
+            {
+            iData = nullptr;
+            iSegmentOffset.clear();
+            iStringOffset.clear();
+            }
+        return error;
+        }
+
+    double Distance() const { return iDistance; }
+    double Time() const { return iTime; }
+    double PointScale() const { return iPointScale; }
+    size_t SegmentCount() const { return iSegmentOffset.size(); }
+
+    /** Get information about a segment. */
+    TResult GetSegment(size_t aIndex,TBinaryRouteSegment& aSegment) const
+        {
+        if (aIndex >= iSegmentOffset.size())
+            return KErrorNotFound;
+        TMemoryInputStream memory(iData,iLength);
+        TDataInputStream input(memory);
+        TResult error = input.Seek(int64(iSegmentOffset[aIndex]));
+        if (!error)
+            error = ReadSegment(input,aSegment);
+        return error;
+        }
+
+    /** Call aHandler(const TOutlinePoint&) for each point in the path of a segment. */
+    template<class THandler> TResult GetPath(const TBinaryRouteSegment& aSegment,THandler&& aHandler) const
+        {
+        TMemoryInputStream memory(iData,iLength);
+        TDataInputStream input(memory);
+        TResult error = input.Seek(int64(aSegment.iPathOffset));
+        return error ? error : ReadPath(input,aHandler);
+        }
+
+    /** Create a CRoute containing the whole route. */
+    std::unique_ptr<CRoute> CreateRoute(TResult& aError) const
+        {
+        aError = iData ? KErrorNone : KErrorNotFound;
+        if (aError)
+            return nullptr;
+        TMemoryInputStream memory(iData,iLength);
+        TDataInputStream input(memory);
+        double distance, time, point_scale;
+        TRouteProfile profile;
+        aError = ReadHeader(input,distance,time,point_scale);
+        if (!aError)
+            aError = ReadProfile(input,profile);
+        if (aError)
+            return nullptr;
+
+        std::unique_ptr<CRoute> route(new CRoute(profile,point_scale));
+        route->iDistance = distance;
+        route->iTime = time;
+        aError = ReadPathToJunction(input,route->iPathToJunctionBefore);
+        if (!aError)
+            aError = ReadPathToJunction(input,route->iPathToJunctionAfter);
+        if (!aError)
+            aError = ReadPath(input,[&route](const TOutlinePoint& aPoint) { route->iPath.AppendPointEvenIfSame(aPoint); });
+        const bool build_path = route->iPath.Points() == 0;
+
+        TBinaryRouteSegment s;
+        for (size_t i = 0; i < iSegmentOffset.size() && !aError; i++)
+            {
+            aError = GetSegment(i,s);
+            if (aError)
+                break;
+            std::unique_ptr<CRouteSegment> segment(new CRouteSegment);
+            segment->iRoadType = s.iRoadType;
+            segment->iMaxSpeed = s.iMaxSpeed;
+            segment->iName.Set(s.iName,s.iNameLength);
+            segment->iRef.Set(s.iRef,s.iRefLength);
+            segment->iDistance = s.iDistance;
+            segment->iTime = s.iTime;
+            segment->iTurnTime = s.iTurnTime;
+            segment->iSection = s.iSection;
+            segment->iRestricted = s.iRestricted;
+            TTurn& turn = segment->iTurn;
+            turn.iTurnType = s.iTurnType;
+            turn.iContinue = s.iContinue;
+            turn.iRoundaboutState = s.iRoundaboutState;
+            turn.iTurnAngle = s.iTurnAngle;
+            turn.iExitNumber = s.iExitNumber;
+            turn.iChoices = s.iChoices;
+            turn.iLeftAlternatives = s.iLeftAlternatives;
+            turn.iRightAlternatives = s.iRightAlternatives;
+            turn.iIsFork = s.iIsFork;
+            turn.iTurnOff = s.iTurnOff;
+            turn.iJunctionName.Set(s.iJunctionName,s.iJunctionNameLength);
+            turn.iJunctionRef.Set(s.iJunctionRef,s.iJunctionRefLength);
+            CContour& path = segment->iPath;
+            path.ReservePoints(s.iPointCount);
+            aError = GetPath(s,[&](const TOutlinePoint& aPoint)
+                {
+                path.AppendPointEvenIfSame(aPoint);
+                if (build_path)
+                    route->iPath.AppendPoint(aPoint);
+                });
+            route->iRouteSegment.push_back(std::move(segment));
+            }
+        if (aError)
+            return nullptr;
+        return route;
+        }
+
+    /** Write aRoute in the compact binary format. */
+    static TResult Write(const CRoute& aRoute,TDataOutputStream& aOutput)
+        {
+        // Build the string table.
+        std::vector<std::string> string_table;
+        std::unordered_map<std::string,uint64> string_index;
+        auto index = [&](const MString& aString)->uint64
+            {
+            if (aString.Length() == 0)
+                return 0;
+            std::string s = aString.CreateUtf8String();
+            auto p = string_index.find(s);
+            if (p != string_index.end())
+                return p->second;
+            string_table.push_back(s);
+            return string_index[s] = string_table.size();
+            };
+        for (const auto& s : aRoute.iRouteSegment)
+            {
+            index(s->iName);
+            index(s->iRef);
+            index(s->iTurn.iJunctionName);
+            index(s->iTurn.iJunctionRef);
+            }
+
+        TResult error = aOutput.WriteUint32(KFileSignature);
+        if (!error)
+            error = aOutput.WriteUint(uint64(KFileVersion));
+        if (!error)
+            error = aOutput.WriteDouble(aRoute.iDistance);
+        if (!error)
+            error = aOutput.WriteDouble(aRoute.iTime);
+        if (!error)
+            error = aOutput.WriteDouble(aRoute.iPointScale);
+        if (!error)
+            error = WriteProfile(aOutput,aRoute.iProfile);
+        if (!error)
+            error = WritePathToJunction(aOutput,aRoute.iPathToJunctionBefore);
+        if (!error)
+            error = WritePathToJunction(aOutput,aRoute.iPathToJunctionAfter);
+
+        // Store the route's path only if it differs from the segment paths joined together.
+        bool path_is_joined_segments = true;
+        {
+        size_t n = 0;
+        const CContour& path = aRoute.iPath;
+        for (const auto& s : aRoute.iRouteSegment)
+            for (const auto& p : s->iPath)
+                {
+                if (n && p == path.Point(n - 1))
+                    continue;
+                if (n >= path.Points() || !(p == path.Point(n)))
+                    path_is_joined_segments = false;
+                n++;
+                }
+        if (n != path.Points())
+            path_is_joined_segments = false;
+        }
+        if (!error)
+            error = path_is_joined_segments ? WritePath(aOutput,CContour()) : WritePath(aOutput,aRoute.iPath);
+
+        if (!error)
+            error = aOutput.WriteUint(uint64(string_table.size()));
+        for (size_t i = 0; i < string_table.size() && !error; i++)
+            {
+            error = aOutput.WriteUint(uint64(string_table[i].length()));
+            if (!error)
+                error = aOutput.WriteBytes(reinterpret_cast<const uint8*>(string_table[i].data()),string_table[i].length());
+            }
+
+        if (!error)
+            error = aOutput.WriteUint(uint64(aRoute.iRouteSegment.size()));
+        for (size_t i = 0; i < aRoute.iRouteSegment.size() && !error; i++)
+            {
+            const CRouteSegment& s = *aRoute.iRouteSegment[i];
+            const TTurn& t = s.iTurn;
+            const uint64 flags = (t.iContinue ? 1 : 0) | (t.iIsFork ? 2 : 0) | (t.iTurnOff ? 4 : 0) | (s.iRestricted ? 8 : 0);
+            const uint64 value[] =
+                {
+                uint64(s.iRoadType), Thousandths(s.iMaxSpeed), index(s.iName), index(s.iRef),
+                Thousandths(s.iDistance), Thousandths(s.iTime), Thousandths(s.iTurnTime), uint64(std::max(s.iSection,int32(0))), flags,
+                uint64(t.iTurnType), uint64(t.iRoundaboutState)
+                };
+            for (uint64 v : value)
+                if (!error)
+                    error = aOutput.WriteUint(v);
+            const int64 signed_value[] =
+                { int64(std::round(t.iTurnAngle * 1000)), t.iExitNumber, t.iChoices, t.iLeftAlternatives, t.iRightAlternatives };
+            for (int64 v : signed_value)
+                if (!error)
+                    error = aOutput.WriteInt(v);
+            if (!error)
+                error = aOutput.WriteUint(index(t.iJunctionName));
+            if (!error)
+                error = aOutput.WriteUint(index(t.iJunctionRef));
+            if (!error)
+                error = WritePath(aOutput,s.iPath);
+            }
+        return error;
+        }
+
+    private:
+    static uint64 Thousandths(double aValue) { return aValue > 0 ? uint64(std::round(aValue * 1000)) : 0; }
+
+    static TResult ReadHeader(TDataInputStream& aInput,double& aDistance,double& aTime,double& aPointScale)
+        {
+        TResult error = 0;
+        if (aInput.ReadUint32(error) != KFileSignature || error)
+            return error ? error : KErrorUnknownDataFormat;
+        if (aInput.ReadUint(error) != KFileVersion || error)
+            return error ? error : KErrorUnknownVersion;
+        aDistance = aInput.ReadDoubleFP(error);
+        if (!error)
+            aTime = aInput.ReadDoubleFP(error);
+        if (!error)
+            aPointScale = aInput.ReadDoubleFP(error);
+        return error;
+        }
+
+    // The route profile is written field by field so that the format does not depend on the layout of TRouteProfile.
+    static TResult WriteProfile(TDataOutputStream& aOutput,const TRouteProfile& aProfile)
+        {
+        const TVehicleType& v = aProfile.iVehicleType;
+        TResult error = aOutput.WriteUint(uint64(v.iAccessFlags));
+        for (double d : { v.iWeight, v.iAxleLoad, v.iDoubleAxleLoad, v.iTripleAxleLoad, v.iHeight, v.iWidth, v.iLength })
+            if (!error)
+                error = aOutput.WriteDouble(d);
+        if (!error)
+            error = aOutput.WriteUint(uint64(v.iHazMat));
+        for (size_t i = 0; i < KArcRoadTypeCount && !error; i++)
+            {
+            error = aOutput.WriteDouble(aProfile.iSpeed[i]);
+            if (!error)
+                error = aOutput.WriteDouble(aProfile.iBonus[i]);
+            if (!error)
+                error = aOutput.WriteUint(uint64(aProfile.iRestrictionOverride[i]));
+            }
+        for (int32 t : { aProfile.iTurnTime, aProfile.iUTurnTime, aProfile.iCrossTrafficTurnTime, aProfile.iTrafficLightTime })
+            if (!error)
+                error = aOutput.WriteInt(t);
+        if (!error)
+            error = aOutput.WriteUint(uint64(aProfile.iShortest));
+        if (!error)
+            error = aOutput.WriteDouble(aProfile.iTollPenalty);
+        for (size_t i = 0; i < KArcGradientCount && !error; i++)
+            {
+            error = aOutput.WriteDouble(aProfile.iGradientSpeed[i]);
+            if (!error)
+                error = aOutput.WriteDouble(aProfile.iGradientBonus[i]);
+            }
+        if (!error)
+            error = aOutput.WriteUint(uint64(aProfile.iGradientFlags));
+        return error;
+        }
+
+    static TResult ReadProfile(TDataInputStream& aInput,TRouteProfile& aProfile)
+        {
+        TResult error = 0;
+        TVehicleType& v = aProfile.iVehicleType;
+        v.iAccessFlags = uint32(aInput.ReadUint(error));
+        for (double* d : { &v.iWeight, &v.iAxleLoad, &v.iDoubleAxleLoad, &v.iTripleAxleLoad, &v.iHeight, &v.iWidth, &v.iLength })
+            if (!error)
+                *d = aInput.ReadDoubleFP(error);
+        if (!error)
+            v.iHazMat = aInput.ReadUint(error) != 0;
+        for (size_t i = 0; i < KArcRoadTypeCount && !error; i++)
+            {
+            aProfile.iSpeed[i] = aInput.ReadDoubleFP(error);
+            if (!error)
+                aProfile.iBonus[i] = aInput.ReadDoubleFP(error);
+            if (!error)
+                aProfile.iRestrictionOverride[i] = uint32(aInput.ReadUint(error));
+            }
+        for (int32* t : { &aProfile.iTurnTime, &aProfile.iUTurnTime, &aProfile.iCrossTrafficTurnTime, &aProfile.iTrafficLightTime })
+            if (!error)
+                *t = int32(aInput.ReadInt(error));
+        if (!error)
+            aProfile.iShortest = aInput.ReadUint(error) != 0;
+        if (!error)
+            aProfile.iTollPenalty = aInput.ReadDoubleFP(error);
+        for (size_t i = 0; i < KArcGradientCount && !error; i++)
+            {
+            aProfile.iGradientSpeed[i] = aInput.ReadDoubleFP(error);
+            if (!error)
+                aProfile.iGradientBonus[i] = aInput.ReadDoubleFP(error);
+            }
+        if (!error)
+            aProfile.iGradientFlags = uint32(aInput.ReadUint(error));
+        return error;
+        }
+
+    static TResult WritePathToJunction(TDataOutputStream& aOutput,const CPathToJunction& aPath)
+        {
+        TResult error = aOutput.WriteUint(uint64(aPath.iStartRoadType));
+        if (!error)
+            error = aOutput.WriteUint(uint64(aPath.iEndRoadType));
+        if (!error)
+            error = aOutput.WriteUint(Thousandths(aPath.iDistance));
+        if (!error)
+            error = WritePath(aOutput,aPath.iPath);
+        return error;
+        }
+
+    TResult ReadPathToJunction(TDataInputStream& aInput,CPathToJunction& aPath) const
+        {
+        TResult error = 0;
+        aPath.Clear();
+        aPath.iStartRoadType = TRoadType(aInput.ReadUint(error));
+        if (!error)
+            aPath.iEndRoadType = TRoadType(aInput.ReadUint(error));
+        if (!error)
+            aPath.iDistance = double(aInput.ReadUint(error)) / 1000;
+        if (!error)
+            error = ReadPath(aInput,[&aPath](const TOutlinePoint& aPoint) { aPath.iPath.AppendPointEvenIfSame(aPoint); });
+        return error;
+        }
+
+    static TResult WritePath(TDataOutputStream& aOutput,const CContour& aPath)
+        {
+        bool has_types = false;
+        for (const auto& p : aPath)
+            if (p.iType != TPointType::OnCurve)
+                has_types = true;
+        TResult error = aOutput.WriteUint(uint64(aPath.Points()) * 2 + (has_types ? 1 : 0));
+        TPoint prev;
+        for (const auto& p : aPath)
+            {
+            if (!error)
+                error = aOutput.WriteInt(int64(p.iX) - prev.iX);
+            if (!error)
+                error = aOutput.WriteInt(int64(p.iY) - prev.iY);
+            prev = p;
+            }
+        if (has_types)
+            for (const auto& p : aPath)
+                if (!error)
+                    error = aOutput.WriteUint(uint64(p.iType));
+        return error;
+        }
+
+    template<class THandler> TResult ReadPath(TDataInputStream& aInput,THandler&& aHandler) const
+        {
+        TResult error = 0;
+        const uint64 n = aInput.ReadUint(error);
+        if (error)
+            return error;
+        const uint64 count = n / 2;
+        // Each point takes at least two bytes, so a larger count can only come from corrupt data.
+        if (count > (iLength - size_t(aInput.Position())) / 2)
+            return KErrorCorrupt;
+        if (!(n & 1))
+            return ReadCoordinates(aInput,count,[&aHandler](const TPoint& aPoint) { aHandler(TOutlinePoint(aPoint)); });
+
+        // Point types follow the coordinates, so skip the coordinates to find the types, then read both together
+        // using a second stream for the coordinates, leaving aInput at the end of the path.
+        const size_t coordinate_offset = size_t(aInput.Position());
+        error = ReadCoordinates(aInput,count,[](const TPoint&) { });
+        if (error)
+            return error;
+        TMemoryInputStream memory(iData + coordinate_offset,size_t(aInput.Position()) - coordinate_offset);
+        TDataInputStream coordinate_input(memory);
+        TResult type_error = 0;
+        error = ReadCoordinates(coordinate_input,count,[&aInput,&aHandler,&type_error](const TPoint& aPoint)
+            {
+            TOutlinePoint point(aPoint);
+            if (!type_error)
+                point.iType = TPointType(aInput.ReadUint(type_error));
+            if (!type_error)
+                aHandler(point);
+            });
+        return error ? error : type_error;
+        }
+
+    template<class THandler> static TResult ReadCoordinates(TDataInputStream& aInput,uint64 aCount,THandler&& aHandler)
+        {
+        TResult error = 0;
+        int64 x = 0, y = 0;
+        for (uint64 i = 0; i < aCount && !error; i++)
+            {
+            x += aInput.ReadInt(error);
+            if (!error)
+                y += aInput.ReadInt(error);
+            if (!error)
+                aHandler(TPoint(int32(x),int32(y)));
+            }
+        return error;
+        }
+
+    TResult SkipPath(TDataInputStream& aInput) const
+        {
+        return ReadPath(aInput,[](const TOutlinePoint&) { });
+        }
+
+    TResult ReadSegment(TDataInputStream& aInput,TBinaryRouteSegment& aSegment) const
+        {
+        TResult error = 0;
+        uint64 value[11];
+        for (uint64& v : value)
+            if (!error)
+                v = aInput.ReadUint(error);
+        int64 signed_value[5];
+        for (int64& v : signed_value)
+            if (!error)
+                v = aInput.ReadInt(error);
+        if (error)
+            return error;
+        aSegment.iRoadType = TRoadType(value[0]);
+        aSegment.iMaxSpeed = double(value[1]) / 1000;
+        aSegment.iDistance = double(value[4]) / 1000;
+        aSegment.iTime = double(value[5]) / 1000;
+        aSegment.iTurnTime = double(value[6]) / 1000;
+        aSegment.iSection = int32(value[7]);
+        aSegment.iContinue = (value[8] & 1) != 0;
+        aSegment.iIsFork = (value[8] & 2) != 0;
+        aSegment.iTurnOff = (value[8] & 4) != 0;
+        aSegment.iRestricted = (value[8] & 8) != 0;
+        aSegment.iTurnType = TTurnType(value[9]);
+        aSegment.iRoundaboutState = TRoundaboutState(value[10]);
+        aSegment.iTurnAngle = double(signed_value[0]) / 1000;
+        aSegment.iExitNumber = int32(signed_value[1]);
+        aSegment.iChoices = int32(signed_value[2]);
+        aSegment.iLeftAlternatives = int32(signed_value[3]);
+        aSegment.iRightAlternatives = int32(signed_value[4]);
+
+        error = ResolveString(value[2],aSegment.iName,aSegment.iNameLength);
+        if (!error)
+            error = ResolveString(value[3],aSegment.iRef,aSegment.iRefLength);
+        uint64 junction_name = error ? 0 : aInput.ReadUint(error);
+        uint64 junction_ref = error ? 0 : aInput.ReadUint(error);
+        if (!error)
+            error = ResolveString(junction_name,aSegment.iJunctionName,aSegment.iJunctionNameLength);
+        if (!error)
+            error = ResolveString(junction_ref,aSegment.iJunctionRef,aSegment.iJunctionRefLength);
+        if (!error)
+            {
+            aSegment.iPathOffset = size_t(aInput.Position());
+            TMemoryInputStream memory(iData + aSegment.iPathOffset,iLength - aSegment.iPathOffset);
+            TDataInputStream path_input(memory);
+            aSegment.iPointCount = size_t(path_input.ReadUint(error) / 2);
+            }
+        return error;
+        }
+
+    // Find the text of the string with index aIndex, counting from 1, in the string table.
+    TResult ResolveString(uint64 aIndex,const char*& aText,size_t& aLength) const
+        {
+        aText = nullptr;
+        aLength = 0;
+        if (aIndex == 0)
+            return KErrorNone;
+        if (aIndex > iStringOffset.size())
+            return KErrorCorrupt;
+        const size_t offset = iStringOffset[size_t(aIndex - 1)];
+        TMemoryInputStream memory(iData + offset,iLength - offset);
+        TDataInputStream input(memory);
+        TResult error = 0;
+        aLength = size_t(input.ReadUint(error));
+        if (!error)
+            aText = reinterpret_cast<const char*>(iData + offset + input.Position());
+        return error;
+        }
+
+    const uint8* iData = nullptr;
+    size_t iLength = 0;
+    double iDistance = 0;
+    double iTime = 0;
+    double iPointScale = 1;
+    std::vector<size_t> iSegmentOffset;
+    std::vector<size_t> iStringOffset;
+    };
+
+}
+
+#endif
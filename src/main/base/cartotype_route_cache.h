@@ -0,0 +1,258 @@
+/*
+CARTOTYPE_ROUTE_CACHE.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_ROUTE_CACHE_H__
+#define CARTOTYPE_ROUTE_CACHE_H__
+
+#include <cartotype_framework.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace CartoType
+{
+
+/** Return a hash of all the parameters of a route profile which affect the routes calculated using it. */
+inline uint64 RouteProfileHash(const TRouteProfile& aProfile)
+    {
+    // FNV-1a, applied to each field separately so that padding bytes are not hashed.
+    uint64 hash = 14695981039346656037ULL;
+    auto add = [&hash](const void* aData,size_t aBytes)
+        {
+        const uint8* p = static_cast<const uint8*>(aData);
+        for (size_t i = 0; i < aBytes; i++)
+            {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+            }
+        };
+    auto add_value = [&add](const auto& aValue) { add(&aValue,sizeof(aValue)); };
+
+    const TVehicleType& v = aProfile.iVehicleType;
+    add_value(v.iAccessFlags);
+    add_value(v.iWeight);
+    add_value(v.iAxleLoad);
+    add_value(v.iDoubleAxleLoad);
+    add_value(v.iTripleAxleLoad);
+    add_value(v.iHeight);
+    add_value(v.iWidth);
+    add_value(v.iLength);
+    add_value(v.iHazMat);
+    add(aProfile.iSpeed.data(),sizeof(aProfile.iSpeed));
+    add(aProfile.iBonus.data(),sizeof(aProfile.iBonus));
+    add(aProfile.iRestrictionOverride.data(),sizeof(aProfile.iRestrictionOverride));
+    add_value(aProfile.iTurnTime);
+    add_value(aProfile.iUTurnTime);
+    add_value(aProfile.iCrossTrafficTurnTime);
+    add_value(aProfile.iTrafficLightTime);
+    add_value(aProfile.iShortest);
+    add_value(aProfile.iTollPenalty);
+    add(aProfile.iGradientSpeed.data(),sizeof(aProfile.iGradientSpeed));
+    add(aProfile.iGradientBonus.data(),sizeof(aProfile.iGradientBonus));
+    add_value(aProfile.iGradientFlags);
+    return hash;
+    }
+
+/** A waypoint of a route as snapped to the road network, forming part of a TRouteCacheKey. */
+class TRouteCacheWaypoint
+    {
+    public:
+    bool operator==(const TRouteCacheWaypoint& aOther) const { return iArc == aOther.iArc && iOffset == aOther.iOffset; }
+    bool operator!=(const TRouteCacheWaypoint& aOther) const { return !(*this == aOther); }
+
+    /** The identifier of the arc to which the waypoint was snapped. */
+    uint64 iArc = 0;
+    /** The distance along the arc from its start to the snapped point, in map units. */
+    int32 iOffset = 0;
+    };
+
+/** The key identifying a route in a CRouteCache. */
+class TRouteCacheKey
+    {
+    public:
+    bool operator==(const TRouteCacheKey& aOther) const
+        {
+        return iWaypoint == aOther.iWaypoint && iProfileHash == aOther.iProfileHash && iRouterType == aOther.iRouterType;
+        }
+
+    /** Every waypoint of the route, from start to end, as snapped to the road network. */
+    std::vector<TRouteCacheWaypoint> iWaypoint;
+    /** The hash of the route profile, as returned by RouteProfileHash. */
+    uint64 iProfileHash = 0;
+    /** The router used. */
+    TRouterType iRouterType = TRouterType::Default;
+    };
+
+/** Counters describing the use of a CRouteCache. */
+class TRouteCacheCounters
+    {
+    public:
+    /** The number of route requests answered from the cache. */
+    size_t iHitCount = 0;
+    /** The number of route requests not found in the cache. */
+    size_t iMissCount = 0;
+    /** The number of routes discarded to keep the cache within its maximum size. */
+    size_t iEvictionCount = 0;
+    /** The number of times the cache has been cleared. */
+    size_t iInvalidationCount = 0;
+    /** The number of routes in the cache. */
+    size_t iRouteCount = 0;
+    /** The estimated size of the routes in the cache in bytes. */
+    size_t iBytes = 0;
+    /** The maximum size of the cache in bytes. */
+    size_t iMaxBytes = 0;
+    };
+
+/**
+A thread-safe least-recently-used cache of routes, holding shared immutable CRoute objects,
+and limited to a maximum total size in bytes as estimated by the caller.
+
+The cache must be cleared whenever the map data or traffic information change. A CRouteCacheObserver
+added to the framework clears it when maps are loaded, unloaded, enabled or disabled;
+code changing traffic information must call Clear itself, because framework observers are not told of those changes.
+*/
+class CRouteCache
+    {
+    public:
+    explicit CRouteCache(size_t aMaxBytes):
+        iMaxBytes(aMaxBytes)
+        {
+        }
+
+    /** Return the route stored under aKey, or null if there is none, and update the hit or miss count. */
+    std::shared_ptr<const CRoute> Find(const TRouteCacheKey& aKey)
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        auto p = iIndex.find(aKey);
+        if (p == iIndex.end())
+            {
+            iCounters.iMissCount++;
+            return nullptr;
+            }
+        iCounters.iHitCount++;
+        iList.splice(iList.begin(),iList,p->second);
+        return p->second->iRoute;
+        }
+
+    /** Store a route of aBytes bytes under aKey, replacing any route already stored under that key, and evicting the least recently used routes if necessary. */
+    void Add(const TRouteCacheKey& aKey,std::shared_ptr<const CRoute> aRoute,size_t aBytes)
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        auto p = iIndex.find(aKey);
+        if (p != iIndex.end())
+            Remove(p->second);
+        if (aBytes > iMaxBytes)
+            return;
+        iList.push_front(TEntry { aKey,std::move(aRoute),aBytes });
+        iIndex[aKey] = iList.begin();
+        iCounters.iBytes += aBytes;
+        iCounters.iRouteCount++;
+        Trim();
+        }
+
+    /** Discard all the routes: called when the map data or traffic information change. */
+    void Clear()
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        iList.clear();
+        iIndex.clear();
+        iCounters.iBytes = 0;
+        iCounters.iRouteCount = 0;
+        iCounters.iInvalidationCount++;
+        }
+
+    /** Set the maximum total size in bytes, evicting routes if necessary. */
+    void SetMaxBytes(size_t aMaxBytes)
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        iMaxBytes = aMaxBytes;
+        Trim();
+        }
+
+    TRouteCacheCounters Counters() const
+        {
+        std::lock_guard<std::mutex> lock(iMutex);
+        TRouteCacheCounters counters = iCounters;
+        counters.iMaxBytes = iMaxBytes;
+        return counters;
+        }
+
+    private:
+    class TEntry
+        {
+        public:
+        TRouteCacheKey iKey;
+        std::shared_ptr<const CRoute> iRoute;
+        size_t iBytes;
+        };
+
+    class THash
+        {
+        public:
+        size_t operator()(const TRouteCacheKey& aKey) const
+            {
+            uint64 h = aKey.iProfileHash;
+            for (const auto& w : aKey.iWaypoint)
+                {
+                h = (h ^ w.iArc) * 1099511628211ULL;
+                h = (h ^ uint32(w.iOffset)) * 1099511628211ULL;
+                }
+            h = (h ^ uint64(aKey.iRouterType)) * 1099511628211ULL;
+            return size_t(h ^ (h >> 32));
+            }
+        };
+
+    using TList = std::list<TEntry>;
+
+    void Remove(TList::iterator aEntry)
+        {
+        iCounters.iBytes -= aEntry->iBytes;
+        iCounters.iRouteCount--;
+        iIndex.erase(aEntry->iKey);
+        iList.erase(aEntry);
+        }
+
+    void Trim()
+        {
+        while (iCounters.iBytes > iMaxBytes && !iList.empty())
+            {
+            Remove(std::prev(iList.end()));
+            iCounters.iEvictionCount++;
+            }
+        }
+
+    mutable std::mutex iMutex;
+    size_t iMaxBytes;
+    TList iList; // most recently used first
+    std::unordered_map<TRouteCacheKey,TList::iterator,THash> iIndex;
+    TRouteCacheCounters iCounters;
+    };
+
+/** A framework observer which clears a route cache when the map data changes. Add it to the framework using CFramework::AddObserver. */
+class CRouteCacheObserver: public MFrameworkObserver
+    {
+    public:
+    explicit CRouteCacheObserver(CRouteCache& aCache):
+        iCache(aCache)
+        {
+        }
+
+    void OnViewChange() override { }
+    void OnMainDataChange() override { iCache.Clear(); }
+    void OnDynamicDataChange() override { }
+    void OnStyleChange() override { }
+    void OnLayerChange() override { }
+    void OnNoticeChange() override { }
+
+    private:
+    CRouteCache& iCache;
+    };
+
+}
+
+#endif
@@ -0,0 +1,394 @@
+/*
+CARTOTYPE_ROUTE_INDEX.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_ROUTE_INDEX_H__
+#define CARTOTYPE_ROUTE_INDEX_H__
+
+#include <cartotype_navigation.h>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace CartoType
+{
+
+/**
+The position of a vehicle or other moving point along a route, used as a hint by CRouteIndex
+so that tracking a point that moves steadily along the route takes constant time for each update.
+*/
+class TRouteCursor
+    {
+    public:
+    /** The index of the current line in the route index, or SIZE_MAX if not known. */
+    size_t iLine = SIZE_MAX;
+    };
+
+/**
+An index of the lines making up the path of a route, for finding the nearest point on the route to a point,
+and the point at a given distance or time along the route, in logarithmic time or better.
+
+The lines are stored in route order with the cumulative distance and time at the start and end of each line.
+A bounding-box hierarchy, whose leaves are runs of KNodeSize consecutive lines, is used to find the nearest line.
+When a cursor giving the previous position is supplied, the lines just ahead of it are examined first,
+and the hierarchy is then searched only for lines strictly nearer, which is cheap when the point is near the route.
+This also keeps the position on routes which overlap themselves from jumping to a later or earlier pass.
+
+An index is immutable, so it may be used by many threads at once. It is owned by the caller, typically in a shared pointer
+kept with the route, and must be rebuilt if the route changes: see Matches.
+*/
+class CRouteIndex
+    {
+    public:
+    /** The number of children of each node in the hierarchy. */
+    static constexpr size_t KNodeSize = 16;
+
+    explicit CRouteIndex(const CRoute& aRoute):
+        iRouteSegmentCount(aRoute.iRouteSegment.size()),
+        iRouteDistance(aRoute.iDistance)
+        {
+        double distance = 0;
+        double time = 0;
+        const double point_scale = aRoute.iPointScale;
+        iSegmentFirstLine.reserve(iRouteSegmentCount + 1);
+        for (size_t s = 0; s < iRouteSegmentCount; s++)
+            {
+            const CRouteSegment& segment = *aRoute.iRouteSegment[s];
+            iSegmentFirstLine.push_back(uint32(iLine.size()));
+            iSegmentStartDistance.push_back(distance);
+            iSegmentStartTime.push_back(time);
+            while (iSectionFirstLine.size() <= size_t(std::max(segment.iSection,int32(0))))
+                iSectionFirstLine.push_back(uint32(iLine.size()));
+
+            // Share the segment's distance between its lines in proportion to their lengths, and its time, after the turn time, likewise.
+            // A segment without a path has no lines, but its distance and time still count towards those of later segments.
+            const CContour& path = segment.iPath;
+            const size_t points = path.Points();
+            const double segment_start_distance = distance;
+            const double segment_start_time = time;
+            distance += segment.iDistance;
+            time += segment.iTime;
+            if (!points)
+                continue;
+            double map_length = 0;
+            for (size_t i = 1; i < points; i++)
+                map_length += Length(path.Point(i - 1),path.Point(i));
+            const double drive_time = std::max(segment.iTime - segment.iTurnTime,0.0);
+            double d = 0;
+            const size_t lines = std::max(points - 1,size_t(1));
+            for (size_t i = 0; i < lines; i++)
+                {
+                const TPoint& a = path.Point(i);
+                const TPoint& b = path.Point(std::min(i + 1,points - 1));
+                const double length = Length(a,b);
+                const double meters = map_length > 0 ? length / map_length * segment.iDistance : (lines == 1 ? segment.iDistance : 0);
+                TLine line;
+                line.iStart = a;
+                line.iEnd = b;
+                line.iSegment = uint32(s);
+                line.iIndexInSegment = uint32(i);
+                line.iStartDistance = segment_start_distance + d;
+                line.iEndDistance = segment_start_distance + d + meters;
+                const double f0 = segment.iDistance > 0 ? d / segment.iDistance : 0;
+                const double f1 = segment.iDistance > 0 ? (d + meters) / segment.iDistance : 1;
+                line.iStartTime = segment_start_time + segment.iTurnTime + f0 * drive_time;
+                line.iEndTime = segment_start_time + segment.iTurnTime + f1 * drive_time;
+                line.iMetersPerUnit = length > 0 ? meters / length : point_scale;
+                iLine.push_back(line);
+                d += meters;
+                }
+            }
+        iSegmentFirstLine.push_back(uint32(iLine.size()));
+        iSectionFirstLine.push_back(uint32(iLine.size()));
+        BuildHierarchy();
+        }
+
+    /** Return true if this index was built from aRoute in its current state. */
+    bool Matches(const CRoute& aRoute) const
+        {
+        return aRoute.iRouteSegment.size() == iRouteSegmentCount && aRoute.iDistance == iRouteDistance;
+        }
+
+    size_t LineCount() const { return iLine.size(); }
+
+    /**
+    Find the nearest point on the route to aPoint, restricted to section aSection if it is non-negative.
+    aCursor, if valid, is the previous position and is updated to the new one.
+    */
+    void GetNearestSegment(const TPoint& aPoint,TNearestSegmentInfo& aInfo,int32 aSection,TRouteCursor& aCursor) const
+        {
+        aInfo = TNearestSegmentInfo();
+        if (iLine.empty())
+            return;
+        size_t low = 0, high = iLine.size();
+        if (aSection >= 0)
+            {
+            size_t section = std::min(size_t(aSection),iSectionFirstLine.size() - 2);
+            low = iSectionFirstLine[section];
+            high = iSectionFirstLine[section + 1];
+            }
+        if (low >= high)
+            return;
+
+        // Look at the lines just ahead of the previous position first.
+        size_t best_line = SIZE_MAX;
+        double best_distance2 = HUGE_VAL;
+        if (aCursor.iLine < iLine.size())
+            {
+            const size_t first = std::max(low,aCursor.iLine > KLinesBehind ? aCursor.iLine - KLinesBehind : 0);
+            const size_t last = std::min(high,aCursor.iLine + KLinesAhead);
+            for (size_t i = first; i < last; i++)
+                {
+                double d2 = LineDistance2(iLine[i],aPoint);
+                if (d2 < best_distance2)
+                    {
+                    best_distance2 = d2;
+                    best_line = i;
+                    }
+                }
+            }
+
+        // Then search the hierarchy for any nearer line.
+        std::priority_queue<TQueueEntry,std::vector<TQueueEntry>,std::greater<TQueueEntry>> queue;
+        queue.push(TQueueEntry { 0,uint32(iLevelStart.size() - 2),0 });
+        while (!queue.empty())
+            {
+            TQueueEntry e = queue.top();
+            queue.pop();
+            if (e.iDistance2 >= best_distance2)
+                break;
+            const size_t first = e.iNode * KNodeSize;
+            if (e.iLevel)
+                {
+                const size_t end = std::min(size_t(iLevelStart[e.iLevel] - iLevelStart[e.iLevel - 1]),first + KNodeSize);
+                for (size_t c = first; c < end; c++)
+                    {
+                    if (!NodeOverlaps(e.iLevel - 1,c,low,high))
+                        continue;
+                    double d2 = BoxDistance2(iBox[iLevelStart[e.iLevel - 1] + c],aPoint);
+                    if (d2 < best_distance2)
+                        queue.push(TQueueEntry { d2,e.iLevel - 1,uint32(c) });
+                    }
+                continue;
+                }
+            const size_t end = std::min(high,first + KNodeSize);
+            for (size_t i = std::max(low,first); i < end; i++)
+                {
+                double d2 = LineDistance2(iLine[i],aPoint);
+                if (d2 < best_distance2)
+                    {
+                    best_distance2 = d2;
+                    best_line = i;
+                    }
+                }
+            }
+
+        aCursor.iLine = best_line;
+        const TLine& line = iLine[best_line];
+        const double t = LineFraction(line,aPoint);
+        SetInfo(best_line,t,aInfo);
+        aInfo.iDistanceToRoute = std::sqrt(best_distance2) * line.iMetersPerUnit;
+        }
+
+    /** Find the point at aDistanceInMeters along the route. aCursor, if valid, is the previous position and is updated to the new one. */
+    void GetPointAtDistance(double aDistanceInMeters,TNearestSegmentInfo& aInfo,TRouteCursor& aCursor) const
+        {
+        aInfo = TNearestSegmentInfo();
+        if (iLine.empty())
+            return;
+        size_t i = FindLine(aDistanceInMeters,aCursor,[](const TLine& aLine) { return aLine.iEndDistance; });
+        const TLine& line = iLine[i];
+        const double length = line.iEndDistance - line.iStartDistance;
+        const double t = length > 0 ? (aDistanceInMeters - line.iStartDistance) / length : 0;
+        aCursor.iLine = i;
+        SetInfo(i,std::min(std::max(t,0.0),1.0),aInfo);
+        }
+
+    /** Find the point at aTimeInSeconds along the route. aCursor, if valid, is the previous position and is updated to the new one. */
+    void GetPointAtTime(double aTimeInSeconds,TNearestSegmentInfo& aInfo,TRouteCursor& aCursor) const
+        {
+        aInfo = TNearestSegmentInfo();
+        if (iLine.empty())
+            return;
+        size_t i = FindLine(aTimeInSeconds,aCursor,[](const TLine& aLine) { return aLine.iEndTime; });
+        const TLine& line = iLine[i];
+        const double duration = line.iEndTime - line.iStartTime;
+        const double t = duration > 0 ? (aTimeInSeconds - line.iStartTime) / duration : 0;
+        aCursor.iLine = i;
+        SetInfo(i,std::min(std::max(t,0.0),1.0),aInfo);
+        }
+
+    /** Return a cursor for the line containing the point at aDistanceInMeters along the route, for use as a hint. */
+    TRouteCursor CursorAtDistance(double aDistanceInMeters) const
+        {
+        TRouteCursor cursor;
+        if (!iLine.empty())
+            cursor.iLine = FindLine(aDistanceInMeters,cursor,[](const TLine& aLine) { return aLine.iEndDistance; });
+        return cursor;
+        }
+
+    private:
+    // The number of lines before and after the cursor examined before searching the hierarchy.
+    static constexpr size_t KLinesBehind = 2;
+    static constexpr size_t KLinesAhead = 32;
+
+    class TLine
+        {
+        public:
+        TPoint iStart;
+        TPoint iEnd;
+        uint32 iSegment;
+        uint32 iIndexInSegment;
+        double iStartDistance;
+        double iEndDistance;
+        double iStartTime;
+        double iEndTime;
+        double iMetersPerUnit;
+        };
+
+    class TBox
+        {
+        public:
+        int32 iLeft = INT32_MAX;
+        int32 iTop = INT32_MAX;
+        int32 iRight = INT32_MIN;
+        int32 iBottom = INT32_MIN;
+        };
+
+    class TQueueEntry
+        {
+        public:
+        bool operator>(const TQueueEntry& aOther) const { return iDistance2 > aOther.iDistance2; }
+
+        double iDistance2;
+        uint32 iLevel;
+        uint32 iNode;
+        };
+
+    static double Length(const TPoint& aA,const TPoint& aB)
+        {
+        const double dx = double(aB.iX) - aA.iX, dy = double(aB.iY) - aA.iY;
+        return std::sqrt(dx * dx + dy * dy);
+        }
+
+    static double LineFraction(const TLine& aLine,const TPoint& aPoint)
+        {
+        const double vx = double(aLine.iEnd.iX) - aLine.iStart.iX, vy = double(aLine.iEnd.iY) - aLine.iStart.iY;
+        const double length2 = vx * vx + vy * vy;
+        if (length2 == 0)
+            return 0;
+        const double t = ((double(aPoint.iX) - aLine.iStart.iX) * vx + (double(aPoint.iY) - aLine.iStart.iY) * vy) / length2;
+        return std::min(std::max(t,0.0),1.0);
+        }
+
+    static double LineDistance2(const TLine& aLine,const TPoint& aPoint)
+        {
+        const double t = LineFraction(aLine,aPoint);
+        const double x = aLine.iStart.iX + t * (double(aLine.iEnd.iX) - aLine.iStart.iX) - aPoint.iX;
+        const double y = aLine.iStart.iY + t * (double(aLine.iEnd.iY) - aLine.iStart.iY) - aPoint.iY;
+        return x * x + y * y;
+        }
+
+    static double BoxDistance2(const TBox& aBox,const TPoint& aPoint)
+        {
+        const double dx = std::max(std::max(double(aBox.iLeft) - aPoint.iX,double(aPoint.iX) - aBox.iRight),0.0);
+        const double dy = std::max(std::max(double(aBox.iTop) - aPoint.iY,double(aPoint.iY) - aBox.iBottom),0.0);
+        return dx * dx + dy * dy;
+        }
+
+    // Return true if node aNode at aLevel covers any of the lines from aLow to aHigh.
+    bool NodeOverlaps(size_t aLevel,size_t aNode,size_t aLow,size_t aHigh) const
+        {
+        size_t span = KNodeSize;
+        for (size_t i = 0; i < aLevel; i++)
+            span *= KNodeSize;
+        const size_t first = aNode * span;
+        return first < aHigh && first + span > aLow;
+        }
+
+    // Find the first line whose end value, as returned by aEnd, is at least aValue, trying the lines at and after the cursor first.
+    template<class TEnd> size_t FindLine(double aValue,const TRouteCursor& aCursor,TEnd aEnd) const
+        {
+        if (aCursor.iLine < iLine.size())
+            {
+            size_t i = aCursor.iLine;
+            const size_t last = std::min(iLine.size(),i + KLinesAhead);
+            if (i == 0 || aEnd(iLine[i - 1]) < aValue)
+                {
+                for (; i < last; i++)
+                    if (aEnd(iLine[i]) >= aValue)
+                        return i;
+                }
+            }
+        auto p = std::lower_bound(iLine.begin(),iLine.end(),aValue,[&aEnd](const TLine& aLine,double aV) { return aEnd(aLine) < aV; });
+        return p == iLine.end() ? iLine.size() - 1 : size_t(p - iLine.begin());
+        }
+
+    void SetInfo(size_t aLine,double aFraction,TNearestSegmentInfo& aInfo) const
+        {
+        const TLine& line = iLine[aLine];
+        const double dx = double(line.iEnd.iX) - line.iStart.iX, dy = double(line.iEnd.iY) - line.iStart.iY;
+        aInfo.iSegmentIndex = int32(line.iSegment);
+        aInfo.iLineIndex = int32(line.iIndexInSegment);
+        aInfo.iNearestPoint = TPointFP(line.iStart.iX + aFraction * dx,line.iStart.iY + aFraction * dy);
+        aInfo.iDistanceAlongRoute = line.iStartDistance + aFraction * (line.iEndDistance - line.iStartDistance);
+        aInfo.iDistanceAlongSegment = aInfo.iDistanceAlongRoute - iSegmentStartDistance[line.iSegment];
+        aInfo.iTimeAlongRoute = line.iStartTime + aFraction * (line.iEndTime - line.iStartTime);
+        aInfo.iTimeAlongSegment = aInfo.iTimeAlongRoute - iSegmentStartTime[line.iSegment];
+        aInfo.iHeading = (dx || dy) ? std::atan2(dy,dx) * 180 / 3.14159265358979323846 : 0;
+        }
+
+    void BuildHierarchy()
+        {
+        iLevelStart.assign(1,0);
+        size_t child_count = iLine.size();
+        for (size_t level = 0; ; level++)
+            {
+            const size_t node_count = (child_count + KNodeSize - 1) / KNodeSize;
+            for (size_t node = 0; node < node_count; node++)
+                {
+                TBox box;
+                const size_t end = std::min(child_count,(node + 1) * KNodeSize);
+                for (size_t c = node * KNodeSize; c < end; c++)
+                    {
+                    TBox child;
+                    if (level)
+                        child = iBox[iLevelStart[level - 1] + c];
+                    else
+                        {
+                        const TLine& l = iLine[c];
+                        child.iLeft = std::min(l.iStart.iX,l.iEnd.iX);
+                        child.iTop = std::min(l.iStart.iY,l.iEnd.iY);
+                        child.iRight = std::max(l.iStart.iX,l.iEnd.iX);
+                        child.iBottom = std::max(l.iStart.iY,l.iEnd.iY);
+                        }
+                    box.iLeft = std::min(box.iLeft,child.iLeft);
+                    box.iTop = std::min(box.iTop,child.iTop);
+                    box.iRight = std::max(box.iRight,child.iRight);
+                    box.iBottom = std::max(box.iBottom,child.iBottom);
+                    }
+                iBox.push_back(box);
+                }
+            iLevelStart.push_back(uint32(iBox.size()));
+            if (node_count <= 1)
+                break;
+            child_count = node_count;
+            }
+        }
+
+    size_t iRouteSegmentCount;
+    double iRouteDistance;
+    std::vector<TLine> iLine;
+    std::vector<uint32> iSegmentFirstLine;     // the first line of each segment, plus one for the end
+    std::vector<double> iSegmentStartDistance;
+    std::vector<double> iSegmentStartTime;
+    std::vector<uint32> iSectionFirstLine;     // the first line of each section, plus one for the end
+    std::vector<TBox> iBox;                    // the boxes of each level of the hierarchy, starting with the leaves
+    std::vector<uint32> iLevelStart;           // the index of the first box of each level, plus one for the end
+    };
+
+}
+
+#endif
@@ -0,0 +1,290 @@
+/*
+CARTOTYPE_ROUTE_ORDER.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_ROUTE_ORDER_H__
+#define CARTOTYPE_ROUTE_ORDER_H__
+
+#include <cartotype_base.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace CartoType
+{
+
+/**
+Finds a good order in which to visit a set of points, given a matrix of the costs of travelling between them:
+the travelling salesman problem for an open path, with the first and last points optionally fixed.
+
+The costs may be asymmetric. The search is an iterated local search using 2-opt and Or-opt moves, each evaluated
+in constant time from the matrix, so no routes need to be calculated until the order is known.
+Independent searches with different random perturbations are run in parallel and the best result is kept.
+
+The open path is treated as a cycle through an extra dummy point, which joins the last point to the first at zero cost
+and is used to enforce the fixed start and end.
+*/
+class CRouteOrderOptimizer
+    {
+    public:
+    /**
+    Create an optimizer for aPointCount points, where aCost[i * aPointCount + j] is the cost of travelling from point i to point j,
+    and UINT32_MAX means that point j cannot be reached from point i.
+    If aStartFixed is true the path starts at point 0; if aEndFixed is true it ends at point aPointCount - 1.
+    The optimizer keeps its own copy of the matrix, which can be moved in to avoid copying it.
+    */
+    CRouteOrderOptimizer(size_t aPointCount,std::vector<uint32> aCost,bool aStartFixed,bool aEndFixed):
+        iPointCount(aPointCount),
+        iCost(std::move(aCost)),
+        iStartFixed(aStartFixed),
+        iEndFixed(aEndFixed)
+        {
+        assert(iCost.size() == iPointCount * iPointCount);
+        }
+
+    /**
+    Find a good order, putting it in aOrder as a permutation of the point indexes, and return its cost.
+    Each of up to aThreadCount threads runs aIterations rounds of perturbation followed by local search;
+    a thread count of zero uses the number of hardware threads.
+    If aCostHistory is non-null it receives the best cost found after each round, starting with the cost of the initial order,
+    so that convergence can be monitored.
+    */
+    uint64 Optimize(std::vector<uint32>& aOrder,size_t aIterations,size_t aThreadCount = 0,std::vector<uint64>* aCostHistory = nullptr) const
+        {
+        if (aThreadCount == 0)
+            aThreadCount = std::max(1U,std::thread::hardware_concurrency());
+        if (iPointCount < 4)
+            aThreadCount = 1;
+
+        std::vector<std::vector<uint32>> tour(aThreadCount);
+        std::vector<std::vector<uint64>> history(aThreadCount);
+        std::vector<uint64> cost(aThreadCount);
+        auto worker = [&](size_t aIndex)
+            {
+            cost[aIndex] = Search(tour[aIndex],aIterations,uint32(aIndex + 1),history[aIndex]);
+            };
+        std::vector<std::thread> thread;
+        for (size_t i = 1; i < aThreadCount; i++)
+            thread.emplace_back(worker,i);
+        worker(0);
+        for (auto& t : thread)
+            t.join();
+
+        size_t best = size_t(std::min_element(cost.begin(),cost.end()) - cost.begin());
+        aOrder.assign(tour[best].begin() + 1,tour[best].end());
+        if (aCostHistory)
+            {
+            *aCostHistory = history[0];
+            for (size_t i = 1; i < aThreadCount; i++)
+                for (size_t j = 0; j < aCostHistory->size(); j++)
+                    (*aCostHistory)[j] = std::min((*aCostHistory)[j],history[i][j]);
+            }
+        return cost[best];
+        }
+
+    /** Return the cost of visiting the points in aOrder, which must be a permutation of the point indexes. */
+    uint64 Cost(const std::vector<uint32>& aOrder) const
+        {
+        uint64 cost = 0;
+        for (size_t i = 1; i < aOrder.size(); i++)
+            cost += ArcCost(aOrder[i - 1],aOrder[i]);
+        return cost;
+        }
+
+    private:
+    // A cost greater than any real path, used for unreachable points and to forbid moving fixed points.
+    static constexpr uint64 KInfiniteCost = uint64(1) << 48;
+
+    uint32 DummyPoint() const { return uint32(iPointCount); }
+
+    uint64 ArcCost(uint32 aFrom,uint32 aTo) const
+        {
+        if (aFrom == DummyPoint())
+            return iStartFixed && aTo != 0 ? KInfiniteCost : 0;
+        if (aTo == DummyPoint())
+            return iEndFixed && aFrom != iPointCount - 1 ? KInfiniteCost : 0;
+        uint32 c = iCost[aFrom * iPointCount + aTo];
+        return c == UINT32_MAX ? KInfiniteCost : c;
+        }
+
+    uint64 TourCost(const std::vector<uint32>& aTour) const
+        {
+        uint64 cost = 0;
+        for (size_t i = 0; i < aTour.size(); i++)
+            cost += ArcCost(aTour[i],aTour[(i + 1) % aTour.size()]);
+        return cost;
+        }
+
+    // Create a tour starting at the dummy point by repeatedly visiting the nearest unvisited point.
+    void NearestNeighbourTour(std::vector<uint32>& aTour) const
+        {
+        aTour.assign(1,DummyPoint());
+        std::vector<bool> visited(iPointCount);
+        for (size_t i = 0; i < iPointCount; i++)
+            {
+            uint32 best = 0;
+            uint64 best_cost = UINT64_MAX;
+            for (uint32 p = 0; p < iPointCount; p++)
+                {
+                if (visited[p] || (iEndFixed && p == iPointCount - 1 && i + 1 < iPointCount))
+                    continue;
+                uint64 c = ArcCost(aTour.back(),p);
+                if (c < best_cost)
+                    {
+                    best = p;
+                    best_cost = c;
+                    }
+                }
+            visited[best] = true;
+            aTour.push_back(best);
+            }
+        }
+
+    uint64 Search(std::vector<uint32>& aTour,size_t aIterations,uint32 aSeed,std::vector<uint64>& aHistory) const
+        {
+        NearestNeighbourTour(aTour);
+        LocalSearch(aTour);
+        uint64 best_cost = TourCost(aTour);
+        aHistory.assign(1,best_cost);
+        if (aTour.size() < 4)
+            {
+            aHistory.resize(aIterations + 1,best_cost);
+            return best_cost;
+            }
+
+        std::mt19937 random(aSeed);
+        std::vector<uint32> tour;
+        for (size_t i = 0; i < aIterations; i++)
+            {
+            tour = aTour;
+            Perturb(tour,random);
+            LocalSearch(tour);
+            // Accepting equal costs lets the search drift across plateaus.
+            uint64 cost = TourCost(tour);
+            if (cost <= best_cost)
+                {
+                best_cost = cost;
+                aTour.swap(tour);
+                }
+            aHistory.push_back(best_cost);
+            }
+        return best_cost;
+        }
+
+    // Apply a random double-bridge move, which local search cannot easily undo, to the points that are not fixed.
+    void Perturb(std::vector<uint32>& aTour,std::mt19937& aRandom) const
+        {
+        const size_t low = iStartFixed ? 2 : 1;
+        const size_t high = aTour.size() - (iEndFixed ? 1 : 0);
+        if (high < low + 2)
+            return;
+        std::uniform_int_distribution<size_t> d(low,high);
+        size_t cut[3] = { d(aRandom), d(aRandom), d(aRandom) };
+        std::sort(cut,cut + 3);
+        // Exchange the segments [cut0,cut1) and [cut1,cut2).
+        std::rotate(aTour.begin() + cut[0],aTour.begin() + cut[1],aTour.begin() + cut[2]);
+        }
+
+    // Apply improving 2-opt and Or-opt moves until there are none left.
+    void LocalSearch(std::vector<uint32>& aTour) const
+        {
+        while (TwoOpt(aTour) || OrOpt(aTour))
+            ;
+        }
+
+    /*
+    Find and apply the best reversal of a segment of the tour. Because costs can be asymmetric, reversing a segment
+    changes its internal cost, which is found in constant time from the prefix sums of the costs in each direction.
+    */
+    bool TwoOpt(std::vector<uint32>& aTour) const
+        {
+        const size_t n = aTour.size();
+        std::vector<uint64> forward(n), backward(n);
+        for (size_t k = 1; k < n; k++)
+            {
+            forward[k] = forward[k - 1] + ArcCost(aTour[k - 1],aTour[k]);
+            backward[k] = backward[k - 1] + ArcCost(aTour[k],aTour[k - 1]);
+            }
+
+        int64 best_delta = 0;
+        size_t best_i = 0, best_j = 0;
+        for (size_t i = 1; i + 1 < n; i++)
+            {
+            const uint32 prev = aTour[i - 1];
+            const uint64 old_in = ArcCost(prev,aTour[i]);
+            for (size_t j = i + 1; j < n; j++)
+                {
+                const uint32 next = aTour[(j + 1) % n];
+                int64 delta = int64(ArcCost(prev,aTour[j]) + (backward[j] - backward[i]) + ArcCost(aTour[i],next)) -
+                              int64(old_in + (forward[j] - forward[i]) + ArcCost(aTour[j],next));
+                if (delta < best_delta)
+                    {
+                    best_delta = delta;
+                    best_i = i;
+                    best_j = j;
+                    }
+                }
+            }
+        if (best_delta == 0)
+            return false;
+        std::reverse(aTour.begin() + best_i,aTour.begin() + best_j + 1);
+        return true;
+        }
+
+    // Find and apply the best move of a segment of up to three points to another place in the tour, without reversing it.
+    bool OrOpt(std::vector<uint32>& aTour) const
+        {
+        const size_t n = aTour.size();
+        int64 best_delta = 0;
+        size_t best_i = 0, best_length = 0, best_k = 0;
+        for (size_t length = 1; length <= 3 && length + 1 < n; length++)
+            {
+            for (size_t i = 1; i + length <= n; i++)
+                {
+                const uint32 first = aTour[i];
+                const uint32 last = aTour[i + length - 1];
+                const uint32 prev = aTour[i - 1];
+                const uint32 next = aTour[(i + length) % n];
+                const int64 removal = int64(ArcCost(prev,next)) - int64(ArcCost(prev,first) + ArcCost(last,next));
+                for (size_t k = 0; k < n; k++)
+                    {
+                    if (k + 1 >= i && k < i + length)
+                        continue;
+                    const uint32 a = aTour[k];
+                    const uint32 b = aTour[(k + 1) % n];
+                    int64 delta = removal + int64(ArcCost(a,first) + ArcCost(last,b)) - int64(ArcCost(a,b));
+                    if (delta < best_delta)
+                        {
+                        best_delta = delta;
+                        best_i = i;
+                        best_length = length;
+                        best_k = k;
+                        }
+                    }
+                }
+            }
+        if (best_delta == 0)
+            return false;
+
+        // Move the segment to follow position best_k.
+        auto begin = aTour.begin();
+        if (best_k < best_i)
+            std::rotate(begin + best_k + 1,begin + best_i,begin + best_i + best_length);
+        else
+            std::rotate(begin + best_i,begin + best_i + best_length,begin + best_k + 1);
+        return true;
+        }
+
+    size_t iPointCount;
+    std::vector<uint32> iCost;
+    bool iStartFixed;
+    bool iEndFixed;
+    };
+
+}
+
+#endif
@@ -0,0 +1,316 @@
+/*
+CARTOTYPE_SPEED_PROFILE.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_SPEED_PROFILE_H__
+#define CARTOTYPE_SPEED_PROFILE_H__
+
+#include <cartotype_graph.h>
+#include <cartotype_stream.h>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace CartoType
+{
+
+/** A value meaning that an arc has no speed profile, so that its cost does not depend on the time. */
+constexpr uint32 KNoSpeedProfile = UINT32_MAX;
+
+/**
+A set of piecewise-linear speed profiles giving time-dependent arc costs, with the assignment of profiles
+to classes of arc, such as road types, and optionally to individual arcs, which override the class profiles.
+
+Each profile gives the cost factor, which is the ratio of the actual travel time to the free-flow travel time,
+at a number of times in a repeating period, normally a week, and the factor is interpolated linearly between those times.
+The points of all the profiles are stored in a single array, so that each profile occupies a few contiguous cache lines.
+Cost factors are stored as fixed-point numbers with KFactorShift fractional bits.
+
+Profiles should change slowly enough that arriving later never makes the arc faster (the FIFO property):
+the travel time must not fall by more than one second per second of departure time.
+
+Profile sets are stored in sidecar files using Write and Read.
+*/
+class CSpeedProfileSet
+    {
+    public:
+    /** The number of seconds in a week, the default period. */
+    static constexpr uint32 KWeek = 7 * 24 * 3600;
+    /** The number of fractional bits in a cost factor. */
+    static constexpr int32 KFactorShift = 12;
+
+    explicit CSpeedProfileSet(uint32 aPeriod = KWeek):
+        iPeriod(aPeriod),
+        iFirst(1,0)
+        {
+        assert(aPeriod > 0);
+        }
+
+    /**
+    Add a profile given as pairs of times in seconds from the start of the period, in ascending order,
+    and relative speeds, where 1 is the free-flow speed and 0.5 means that travel takes twice as long.
+    Return the index of the new profile.
+    */
+    uint32 AddProfile(const std::vector<std::pair<uint32,double>>& aPoint)
+        {
+        assert(!aPoint.empty());
+        for (const auto& p : aPoint)
+            {
+            assert(p.first < iPeriod);
+            assert(iPoint.size() == iFirst.back() || p.first > iPoint.back().iTime);
+            double speed = std::max(p.second,1.0 / KMaxSlowdown);
+            iPoint.push_back(TPoint { p.first,uint32(double(1 << KFactorShift) / speed + 0.5) });
+            }
+        iFirst.push_back(uint32(iPoint.size()));
+        return uint32(iFirst.size() - 2);
+        }
+
+    /** Set the profile used by arcs of class aArcClass, or KNoSpeedProfile for none. */
+    void SetClassProfile(uint32 aArcClass,uint32 aProfile)
+        {
+        if (aArcClass >= iClassProfile.size())
+            iClassProfile.resize(size_t(aArcClass) + 1,KNoSpeedProfile);
+        iClassProfile[aArcClass] = aProfile;
+        }
+
+    /** Set the profile used by an individual arc, overriding its class profile. */
+    void SetArcProfile(uint64 aArcId,uint32 aProfile) { iArcProfile[aArcId] = aProfile; }
+
+    /** Return the profile used by an arc of class aArcClass with the identifier aArcId, or KNoSpeedProfile if it has none. */
+    uint32 Profile(uint32 aArcClass,uint64 aArcId) const
+        {
+        if (!iArcProfile.empty())
+            {
+            auto p = iArcProfile.find(aArcId);
+            if (p != iArcProfile.end())
+                return p->second;
+            }
+        return aArcClass < iClassProfile.size() ? iClassProfile[aArcClass] : KNoSpeedProfile;
+        }
+
+    uint32 ProfileCount() const { return uint32(iFirst.size() - 1); }
+    uint32 Period() const { return iPeriod; }
+
+    /** Return the cost factor of a profile at aTime seconds, which is reduced modulo the period. */
+    uint32 Factor(uint32 aProfile,uint32 aTime) const
+        {
+        assert(aProfile < ProfileCount());
+        const TPoint* begin = iPoint.data() + iFirst[aProfile];
+        const TPoint* end = iPoint.data() + iFirst[aProfile + 1];
+        if (end - begin == 1)
+            return begin->iFactor;
+        aTime %= iPeriod;
+        const TPoint* next = std::upper_bound(begin,end,aTime,[](uint32 aT,const TPoint& aP) { return aT < aP.iTime; });
+
+        // Interpolate between the points on each side, wrapping round at the ends of the period.
+        const TPoint& a = next == begin ? end[-1] : next[-1];
+        const TPoint& b = next == end ? *begin : *next;
+        int64 t0 = a.iTime, t1 = b.iTime, t = aTime;
+        if (next == begin)
+            t0 -= iPeriod;
+        if (next == end)
+            t1 += iPeriod;
+        return uint32(a.iFactor + (int64(b.iFactor) - int64(a.iFactor)) * (t - t0) / (t1 - t0));
+        }
+
+    /** Return the cost of an arc with a free-flow cost of aCost, entered at aTime, using a profile, which may be KNoSpeedProfile. */
+    uint32 Cost(uint32 aProfile,uint32 aCost,uint32 aTime) const
+        {
+        if (aProfile == KNoSpeedProfile)
+            return aCost;
+        uint64 c = (uint64(aCost) * Factor(aProfile,aTime)) >> KFactorShift;
+        return uint32(std::min(c,uint64(UINT32_MAX - 1)));
+        }
+
+    /** Write the profile set to a data stream. */
+    TResult Write(TDataOutputStream& aOutput) const
+        {
+        TResult error = aOutput.WriteUint32(KFileSignature);
+        if (!error)
+            error = aOutput.WriteUint(uint64(KFileVersion));
+        if (!error)
+            error = aOutput.WriteUint(uint64(iPeriod));
+        if (!error)
+            error = aOutput.WriteUint(uint64(ProfileCount()));
+        for (uint32 i = 0; !error && i < ProfileCount(); i++)
+            {
+            error = aOutput.WriteUint(uint64(iFirst[i + 1] - iFirst[i]));
+            uint32 time = 0;
+            for (uint32 j = iFirst[i]; !error && j < iFirst[i + 1]; j++)
+                {
+                error = aOutput.WriteUint(uint64(iPoint[j].iTime - time));
+                if (!error)
+                    error = aOutput.WriteUint(uint64(iPoint[j].iFactor));
+                time = iPoint[j].iTime;
+                }
+            }
+        if (!error)
+            error = aOutput.WriteUint(uint64(iClassProfile.size()));
+        for (size_t i = 0; !error && i < iClassProfile.size(); i++)
+            error = aOutput.WriteUint(uint64(iClassProfile[i]) + 1);
+        if (!error)
+            error = aOutput.WriteUint(uint64(iArcProfile.size()));
+        for (auto p = iArcProfile.begin(); !error && p != iArcProfile.end(); ++p)
+            {
+            error = aOutput.WriteUint(p->first);
+            if (!error)
+                error = aOutput.WriteUint(uint64(p->second) + 1);
+            }
+        return error;
+        }
+
+    /** Read a profile set written by Write, replacing the current contents. */
+    TResult Read(TDataInputStream& aInput)
+        {
+        TResult error = 0;
+        if (aInput.ReadUint32(error) != KFileSignature || error)
+            return error ? error : KErrorUnknownDataFormat;
+        if (aInput.ReadUint(error) != KFileVersion || error)
+            return error ? error : KErrorUnknownVersion;
+        uint64 period = aInput.ReadUint(error);
+        if (!error && (period == 0 || period > UINT32_MAX))
+            error = KErrorCorrupt;
+        uint64 profile_count = aInput.ReadUint(error);
+
+        CSpeedProfileSet set(error ? 1 : uint32(period));
+        for (uint64 i = 0; !error && i < profile_count; i++)
+            {
+            uint64 point_count = aInput.ReadUint(error);
+            if (!error && point_count == 0)
+                error = KErrorCorrupt;
+            uint64 time = 0;
+            for (uint64 j = 0; !error && j < point_count; j++)
+                {
+                time += aInput.ReadUint(error);
+                uint64 factor = aInput.ReadUint(error);
+                if (!error && (time >= period || factor > UINT32_MAX || (j && time <= set.iPoint.back().iTime)))
+                    error = KErrorCorrupt;
+                if (!error)
+                    set.iPoint.push_back(TPoint { uint32(time),uint32(factor) });
+                }
+            set.iFirst.push_back(uint32(set.iPoint.size()));
+            }
+        uint64 class_count = error ? 0 : aInput.ReadUint(error);
+        for (uint64 i = 0; !error && i < class_count; i++)
+            set.iClassProfile.push_back(ReadProfileIndex(aInput,error,profile_count));
+        uint64 arc_count = error ? 0 : aInput.ReadUint(error);
+        for (uint64 i = 0; !error && i < arc_count; i++)
+            {
+            uint64 arc_id = aInput.ReadUint(error);
+            uint32 profile = ReadProfileIndex(aInput,error,profile_count);
+            if (!error)
+                set.iArcProfile[arc_id] = profile;
+            }
+        if (!error)
+            *this = std::move(set);
+        return error;
+        }
+
+    private:
+    static constexpr uint32 KFileSignature = 0x43545350; // "CTSP"
+    static constexpr uint32 KFileVersion = 1;
+    // The lowest relative speed allowed, as a divisor of the free-flow speed.
+    static constexpr uint32 KMaxSlowdown = 64;
+
+    class TPoint
+        {
+        public:
+        uint32 iTime;
+        uint32 iFactor;
+        };
+
+    static uint32 ReadProfileIndex(TDataInputStream& aInput,TResult& aError,uint64 aProfileCount)
+        {
+        uint64 n = aInput.ReadUint(aError);
+        if (!aError && n > aProfileCount)
+            aError = KErrorCorrupt;
+        return n ? uint32(n - 1) : KNoSpeedProfile;
+        }
+
+    uint32 iPeriod;
+    std::vector<uint32> iFirst;                     // index into iPoint for each profile, plus one for the end
+    std::vector<TPoint> iPoint;                     // the points of all the profiles
+    std::vector<uint32> iClassProfile;              // the profile for each arc class
+    std::unordered_map<uint64,uint32> iArcProfile;  // profiles for individual arcs, overriding the class profiles
+    };
+
+/**
+A static graph, as used by CSearchGraph, with the arc costs of another static graph varying with the time of day.
+Costs are travel times; the time at which an arc is entered is the departure time plus the cost of the route so far,
+and its cost is the free-flow cost multiplied by the cost factor of its speed profile at that time.
+
+TProfileOf is a function object taking a TArcRef and returning the index of the arc's profile in the CSpeedProfileSet,
+or KNoSpeedProfile if its cost does not vary. CSearchGraph passes the cost of each node to ArcIterator,
+so static graphs that are not time-dependent are unaffected.
+
+Only forward searches are time-dependent, because backward searches do not know the arrival time:
+in backward searches arcs have their free-flow costs.
+*/
+template<class TStaticGraph,class TProfileOf> class TTimeDependentGraph
+    {
+    public:
+    using TArcRef = typename TStaticGraph::TArcRef;
+
+    /**
+    Create a time-dependent graph for a route starting at aDepartureTime seconds from the start of the profiles' period,
+    where arc costs are in units of 1 / aCostPerSecond seconds.
+    */
+    TTimeDependentGraph(const TStaticGraph& aGraph,const CSpeedProfileSet& aProfileSet,TProfileOf aProfileOf,uint32 aDepartureTime,double aCostPerSecond):
+        iGraph(aGraph),
+        iProfileSet(aProfileSet),
+        iProfileOf(aProfileOf),
+        iDepartureTime(aDepartureTime),
+        iSecondsPerCost(1.0 / aCostPerSecond)
+        {
+        }
+
+    size_t NodeCount() const { return iGraph.NodeCount(); }
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(const TTimeDependentGraph& aGraph,typename TStaticGraph::TArcIterator aIter,uint32 aTime,bool aTimeDependent):
+            iGraph(aGraph),
+            iIter(aIter),
+            iTime(aTime),
+            iTimeDependent(aTimeDependent)
+            {
+            }
+
+        bool Next(TResult& aError) { return iIter.Next(aError); }
+        TArcRef Arc() { return iIter.Arc(); }
+        uint32 Cost()
+            {
+            uint32 cost = iIter.Cost();
+            return iTimeDependent ? iGraph.iProfileSet.Cost(iGraph.iProfileOf(iIter.Arc()),cost,iTime) : cost;
+            }
+        uint32 EndNodeIndex() { return iIter.EndNodeIndex(); }
+
+        private:
+        const TTimeDependentGraph& iGraph;
+        typename TStaticGraph::TArcIterator iIter;
+        uint32 iTime;
+        bool iTimeDependent;
+        };
+
+    /** Return an iterator over the arcs from or to a node, which was reached at a cost of aNodeCost. */
+    TArcIterator ArcIterator(uint32 aNodeIndex,bool aOutgoing,uint32 aNodeCost) const
+        {
+        uint32 time = iDepartureTime + uint32(aNodeCost * iSecondsPerCost);
+        return TArcIterator(*this,iGraph.ArcIterator(aNodeIndex,aOutgoing),time,aOutgoing);
+        }
+
+    private:
+    const TStaticGraph& iGraph;
+    const CSpeedProfileSet& iProfileSet;
+    TProfileOf iProfileOf;
+    uint32 iDepartureTime;
+    double iSecondsPerCost;
+    };
+
+}
+
+#endif
@@ -0,0 +1,645 @@
+/*
+CARTOTYPE_TILE_PYRAMID.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_TILE_PYRAMID_H__
+#define CARTOTYPE_TILE_PYRAMID_H__
+
+#include <cartotype_disk_tile_cache.h>
+#include <cartotype_framework.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#include <direct.h>
+#endif
+
+namespace CartoType
+{
+
+/**
+A pool of threads which runs a task for every index in a range, balancing the load by work stealing.
+Each thread starts with an equal contiguous share of the range and takes indexes from the front of it;
+a thread which runs out steals the back half of the largest remaining share of another thread.
+Contiguous shares keep neighbouring tiles, which need the same map data, on the same thread.
+*/
+class CWorkStealingPool
+    {
+    public:
+    /** Create a pool of aThreadCount threads. A thread count of zero uses the number of hardware threads. */
+    explicit CWorkStealingPool(size_t aThreadCount = 0):
+        iThreadCount(aThreadCount ? aThreadCount : std::max(1U,std::thread::hardware_concurrency()))
+        {
+        }
+
+    size_t ThreadCount() const { return iThreadCount; }
+
+    /**
+    Call aTask(aThreadIndex,aIndex) for every index from 0 to aCount - 1, where aThreadIndex is the index of the calling thread.
+    Stops early and returns the first error if a task returns an error.
+    */
+    template<class TTask> TResult Run(uint64 aCount,TTask&& aTask)
+        {
+        std::vector<TShare> share(iThreadCount);
+        for (size_t i = 0; i < iThreadCount; i++)
+            {
+            share[i].iBegin = aCount * i / iThreadCount;
+            share[i].iEnd = aCount * (i + 1) / iThreadCount;
+            }
+        std::atomic<int32> error(KErrorNone);
+
+        auto worker = [&](size_t aThreadIndex)
+            {
+            TShare& own = share[aThreadIndex];
+            while (!error.load(std::memory_order_relaxed))
+                {
+                uint64 index;
+                if (!own.Take(index) && !Steal(share,aThreadIndex,index))
+                    break;
+                TResult e = aTask(aThreadIndex,index);
+                if (e)
+                    {
+                    int32 none = KErrorNone;
+                    error.compare_exchange_strong(none,int32(e));
+                    }
+                }
+            };
+
+        std::vector<std::thread> thread;
+        for (size_t i = 1; i < iThreadCount; i++)
+            thread.emplace_back(worker,i);
+        worker(0);
+        for (auto& t : thread)
+            t.join();
+        return error.load();
+        }
+
+    private:
+    class TShare
+        {
+        public:
+        bool Take(uint64& aIndex)
+            {
+            std::lock_guard<std::mutex> lock(iMutex);
+            if (iBegin >= iEnd)
+                return false;
+            aIndex = iBegin++;
+            return true;
+            }
+
+        std::mutex iMutex;
+        uint64 iBegin = 0;
+        uint64 iEnd = 0;
+        };
+
+    // Steal half of the largest share of another thread, take its first index and keep the rest.
+    bool Steal(std::vector<TShare>& aShare,size_t aThreadIndex,uint64& aIndex)
+        {
+        for (;;)
+            {
+            size_t victim = SIZE_MAX;
+            uint64 largest = 0;
+            for (size_t i = 0; i < aShare.size(); i++)
+                {
+                if (i == aThreadIndex)
+                    continue;
+                std::lock_guard<std::mutex> lock(aShare[i].iMutex);
+                uint64 size = aShare[i].iEnd > aShare[i].iBegin ? aShare[i].iEnd - aShare[i].iBegin : 0;
+                if (size > largest)
+                    {
+                    largest = size;
+                    victim = i;
+                    }
+                }
+            if (victim == SIZE_MAX)
+                return false; // a range stolen meanwhile is always finished by its thief, so it is safe to stop
+
+            uint64 begin, end;
+                {
+                std::lock_guard<std::mutex> lock(aShare[victim].iMutex);
+                TShare& v = aShare[victim];
+                if (v.iBegin >= v.iEnd)
+                    continue; // the victim finished its share in the meantime
+                end = v.iEnd;
+                begin = v.iBegin + (v.iEnd - v.iBegin) / 2;
+                v.iEnd = begin;
+                }
+            std::lock_guard<std::mutex> lock(aShare[aThreadIndex].iMutex);
+            aShare[aThreadIndex].iBegin = begin + 1;
+            aShare[aThreadIndex].iEnd = end;
+            aIndex = begin;
+            return true;
+            }
+        }
+
+    size_t iThreadCount;
+    };
+
+/**
+Renders a pyramid of web map tiles covering a bounding box over a range of zoom levels, using the standard
+web Mercator tile numbering, in which tile (0,0) at each zoom level is at the top left.
+
+The tiles of each zoom level are rendered in parallel by a work-stealing pool. Each thread has its own CFramework,
+created using the same style sheet and sharing one CFrameworkEngine and CFrameworkMapDataSet.
+
+A tile is empty if the map contains no objects within it or near enough to it to affect it, as is the case in the open sea,
+where only the background is drawn. This is found cheaply by a search limited to one object. An empty tile looks the same
+as every other empty tile at the same zoom level, so it is rendered only once per zoom level. Since every tile inside an empty tile is
+also empty, the tiles at the next zoom level which are inside an empty tile are not searched.
+*/
+class CTilePyramidRenderer
+    {
+    public:
+    /** Parameters for rendering a tile pyramid. */
+    class TParam
+        {
+        public:
+        /** The area to be covered, in degrees of longitude and latitude. */
+        TRectFP iBounds { -180, -85.0511, 180, 85.0511 };
+        /** The first zoom level. */
+        int32 iMinZoom = 0;
+        /** The last zoom level. */
+        int32 iMaxZoom = 16;
+        /** The width and height of a tile in pixels. */
+        int32 iTileSize = 256;
+        /** The style sheet file. If this string is empty, the style sheet must be supplied in iStyleSheetText. */
+        CString iStyleSheetFileName;
+        /** The style sheet text; used if iStyleSheetFileName is empty. */
+        std::string iStyleSheetText;
+        /** Parameters passed to CFramework::TileBitmap. */
+        TTileBitmapParam iTileBitmapParam;
+        /**
+        The width and height, in tiles, of the metatiles drawn by Render: for example, 8 to draw blocks of 8 x 8 tiles
+        as single bitmaps which are then sliced into tiles. A value of 1 draws each tile separately.
+        */
+        int32 iMetatileSize = 1;
+        /** The number of threads. Zero uses the number of hardware threads. */
+        size_t iThreadCount = 0;
+        /** If true, detect empty tiles and render them only once per zoom level. */
+        bool iShareEmptyTiles = true;
+        /** If true, detect empty tiles and do not pass them to the tile handler, or write them, at all. */
+        bool iOmitEmptyTiles = false;
+        /**
+        The margin round a tile, as a fraction of the tile size, in which objects are assumed to be able to affect the tile:
+        for example, by wide lines, icons or labels.
+        */
+        double iEmptyTileMargin = 0.25;
+        /** If true, write PNG files using palettes. */
+        bool iPalettize = false;
+        /** If non-null, tiles which are not empty are taken from this cache if possible, and added to it when drawn. */
+        std::shared_ptr<CDiskTileCache> iDiskTileCache;
+        /** The map generation used in the keys of the disk tile cache: change it when the map data changes. */
+        uint32 iMapGeneration = 0;
+        };
+
+    /** Statistics about a rendering run. */
+    class TStats
+        {
+        public:
+        /** Return the number of tiles produced per second. */
+        double TilesPerSecond() const { return iSeconds > 0 ? double(iTileCount) / iSeconds : 0; }
+
+        /** The number of tiles produced, including empty tiles, but not omitted tiles. */
+        uint64 iTileCount = 0;
+        /** The number of tiles produced that are not empty. */
+        uint64 iRenderedTileCount = 0;
+        /** The number of bitmaps drawn: one for each tile or metatile that is not empty, and one empty tile for each zoom level that has any. */
+        uint64 iDrawCount = 0;
+        /** The number of tiles found to be empty, including omitted tiles. */
+        uint64 iEmptyTileCount = 0;
+        /** The number of empty tiles found without a search because they are inside an empty tile at the previous zoom level. */
+        uint64 iInheritedEmptyTileCount = 0;
+        /** The number of tiles taken from the disk tile cache. */
+        uint64 iDiskCacheHitCount = 0;
+        /** The elapsed time in seconds. */
+        double iSeconds = 0;
+        };
+
+    /**
+    A tile handler receives every tile produced. It is called from the rendering threads, possibly concurrently, so it must be thread-safe.
+    aEmpty is true if the tile is empty, in which case aBitmap is shared with all the other empty tiles at the same zoom level.
+    */
+    using TTileHandler = std::function<TResult(int32 aZoom,int32 aX,int32 aY,const TBitmap& aBitmap,bool aEmpty)>;
+
+    static std::unique_ptr<CTilePyramidRenderer> New(TResult& aError,
+                                                     std::shared_ptr<CFrameworkEngine> aSharedEngine,
+                                                     std::shared_ptr<CFrameworkMapDataSet> aSharedMapDataSet,
+                                                     const TParam& aParam)
+        {
+        aError = KErrorNone;
+        if (!aSharedEngine || !aSharedMapDataSet || aParam.iTileSize <= 0 ||
+            aParam.iMinZoom < 0 || aParam.iMaxZoom > KMaxZoom || aParam.iMinZoom > aParam.iMaxZoom)
+            {
+            aError = KErrorInvalidArgument;
+            return nullptr;
+            }
+        std::unique_ptr<CTilePyramidRenderer> r(new CTilePyramidRenderer(aParam));
+        CFramework::TParam param;
+        param.iStyleSheetFileName = aParam.iStyleSheetFileName;
+        param.iStyleSheetText = aParam.iStyleSheetText;
+        param.iViewWidth = param.iViewHeight = aParam.iTileSize;
+        param.iSharedEngine = aSharedEngine;
+        param.iSharedMapDataSet = aSharedMapDataSet;
+        for (size_t i = 0; i < r->iPool.ThreadCount() && !aError; i++)
+            r->iFramework.push_back(CFramework::New(aError,param));
+        if (aError)
+            return nullptr;
+        return r;
+        }
+
+    /**
+    Render all the tiles, passing them to aHandler.
+    If iMetatileSize is greater than one, blocks of tiles are drawn together using DrawMetatile.
+    */
+    TResult Render(const TTileHandler& aHandler)
+        {
+        auto start = std::chrono::steady_clock::now();
+        iStats = TStats();
+        std::atomic<uint64> tile_count(0), rendered_count(0), draw_count(0), empty_count(0), inherited_count(0), disk_cache_hit_count(0);
+        std::vector<uint8> parent_empty;
+        TTileRange parent_range;
+        TResult error = KErrorNone;
+        const bool detect_empty = iParam.iShareEmptyTiles || iParam.iOmitEmptyTiles;
+        const int32 metatile_size = std::max(1,iParam.iMetatileSize);
+
+        for (int32 zoom = iParam.iMinZoom; zoom <= iParam.iMaxZoom && !error; zoom++)
+            {
+            const TTileRange range = TileRange(zoom);
+            const bool inherit = !parent_empty.empty() && zoom == parent_range.iZoom + 1;
+            std::vector<uint8> empty;
+            if (detect_empty && zoom < iParam.iMaxZoom && range.Count() <= KMaxEmptyTileMapSize)
+                empty.resize(size_t(range.Count()));
+            CBitmap empty_bitmap;
+            bool have_empty_bitmap = false;
+            std::mutex empty_bitmap_mutex;
+
+            // Blocks are aligned to multiples of the metatile size so that the tiles do not depend on the bounding box.
+            TTileRange blocks;
+            blocks.iMinX = range.iMinX / metatile_size;
+            blocks.iMinY = range.iMinY / metatile_size;
+            blocks.iMaxX = range.iMaxX / metatile_size;
+            blocks.iMaxY = range.iMaxY / metatile_size;
+
+            error = iPool.Run(blocks.Count(),[&](size_t aThreadIndex,uint64 aIndex)->TResult
+                {
+                // Blocks are numbered in columns, so that a thread's share is a set of whole or partial columns.
+                const int32 bx = blocks.iMinX + int32(aIndex / blocks.Height());
+                const int32 by = blocks.iMinY + int32(aIndex % blocks.Height());
+                TTileRange block;
+                block.iMinX = std::max(bx * metatile_size,range.iMinX);
+                block.iMinY = std::max(by * metatile_size,range.iMinY);
+                block.iMaxX = std::min(bx * metatile_size + metatile_size - 1,range.iMaxX);
+                block.iMaxY = std::min(by * metatile_size + metatile_size - 1,range.iMaxY);
+                CFramework& framework = *iFramework[aThreadIndex];
+
+                bool is_empty = false;
+                if (detect_empty)
+                    {
+                    if (inherit && IsInsideEmptyTiles(block,parent_range,parent_empty))
+                        {
+                        is_empty = true;
+                        inherited_count += block.Count();
+                        }
+                    else
+                        {
+                        TResult e = KErrorNone;
+                        is_empty = IsEmpty(e,framework,zoom,block);
+                        if (e)
+                            return e;
+                        }
+                    }
+
+                if (is_empty)
+                    {
+                    empty_count += block.Count();
+                    if (!empty.empty())
+                        for (int32 x = block.iMinX; x <= block.iMaxX; x++)
+                            for (int32 y = block.iMinY; y <= block.iMaxY; y++)
+                                empty[size_t(range.Index(x,y))] = 1;
+                    if (iParam.iOmitEmptyTiles)
+                        return KErrorNone;
+                    const TBitmap* bitmap = nullptr;
+                        {
+                        std::lock_guard<std::mutex> lock(empty_bitmap_mutex);
+                        if (!have_empty_bitmap)
+                            {
+                            TResult e = KErrorNone;
+                            empty_bitmap = framework.TileBitmap(e,iParam.iTileSize,zoom,block.iMinX,block.iMinY,&iParam.iTileBitmapParam);
+                            if (e)
+                                return e;
+                            have_empty_bitmap = true;
+                            draw_count++;
+                            }
+                        bitmap = &empty_bitmap;
+                        }
+                    for (int32 x = block.iMinX; x <= block.iMaxX; x++)
+                        for (int32 y = block.iMinY; y <= block.iMaxY; y++)
+                            {
+                            tile_count++;
+                            TResult e = aHandler(zoom,x,y,*bitmap,true);
+                            if (e)
+                                return e;
+                            }
+                    return KErrorNone;
+                    }
+
+                TResult e = KErrorNone;
+                std::vector<CBitmap> tile;
+                if (FindInDiskTileCache(tile,zoom,block))
+                    {
+                    disk_cache_hit_count += tile.size();
+                    return HandleBlock(aHandler,zoom,block,tile,rendered_count,tile_count);
+                    }
+                if (metatile_size == 1)
+                    tile.push_back(framework.TileBitmap(e,iParam.iTileSize,zoom,block.iMinX,block.iMinY,&iParam.iTileBitmapParam));
+                else
+                    e = DrawMetatile(framework,tile,iParam.iTileSize,zoom,block.iMinX,block.iMinY,int32(block.Width()),int32(block.Height()),&iParam.iTileBitmapParam);
+                if (e)
+                    return e;
+                draw_count++;
+                if (iParam.iDiskTileCache)
+                    {
+                    size_t i = 0;
+                    for (int32 y = block.iMinY; y <= block.iMaxY && !e; y++)
+                        for (int32 x = block.iMinX; x <= block.iMaxX && !e; x++)
+                            e = iParam.iDiskTileCache->AddBitmap(DiskTileKey(zoom,x,y),tile[i++],iParam.iPalettize);
+                    if (e)
+                        return e;
+                    }
+                return HandleBlock(aHandler,zoom,block,tile,rendered_count,tile_count);
+                });
+
+            parent_empty = std::move(empty);
+            parent_range = range;
+            }
+
+        iStats.iTileCount = tile_count;
+        iStats.iRenderedTileCount = rendered_count;
+        iStats.iDrawCount = draw_count;
+        iStats.iEmptyTileCount = empty_count;
+        iStats.iInheritedEmptyTileCount = inherited_count;
+        iStats.iDiskCacheHitCount = disk_cache_hit_count;
+        iStats.iSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return error;
+        }
+
+    /**
+    Render all the tiles and write them as PNG files named aFolder/Z/X/Y.png, creating the folders as needed.
+    Empty tiles are encoded only once per zoom level.
+    */
+    TResult Write(const CString& aFolder)
+        {
+        std::string folder = aFolder;
+        std::mutex empty_png_mutex;
+        std::vector<uint8> empty_png;
+        int32 empty_png_zoom = -1;
+
+        return Render([&](int32 aZoom,int32 aX,int32 aY,const TBitmap& aBitmap,bool aEmpty)->TResult
+            {
+            const std::string zoom_folder = folder + "/" + std::to_string(aZoom);
+            const std::string x_folder = zoom_folder + "/" + std::to_string(aX);
+            const std::string name = x_folder + "/" + std::to_string(aY) + ".png";
+            TResult error = KErrorNone;
+            auto file = CFileOutputStream::New(error,name.c_str());
+
+            // Create the folders only when the first tile in them is written.
+            if (error)
+                {
+                CreateFolder(folder);
+                CreateFolder(zoom_folder);
+                CreateFolder(x_folder);
+                error = KErrorNone;
+                file = CFileOutputStream::New(error,name.c_str());
+                }
+            if (error)
+                return error;
+            if (!aEmpty)
+                return aBitmap.WritePng(*file,iParam.iPalettize);
+
+            std::lock_guard<std::mutex> lock(empty_png_mutex);
+            if (empty_png_zoom != aZoom)
+                {
+                CMemoryOutputStream png;
+                error = aBitmap.WritePng(png,iParam.iPalettize);
+                if (error)
+                    return error;
+                empty_png = png.RemoveData();
+                empty_png_zoom = aZoom;
+                }
+            return file->Write(empty_png.data(),empty_png.size());
+            });
+        }
+
+    /**
+    Draw a block of aColumns by aRows tiles at zoom level aZoom, with (aX,aY) at the top left, as a single bitmap, and slice it into tiles,
+    putting them in aTile in rows starting at the top left.
+
+    The map data is fetched, styled and labelled once for the whole block rather than once for each tile, and labels are placed consistently
+    across the borders between the tiles. A margin of a quarter of a tile is drawn round the block and discarded, so that labels
+    and symbols near the edges of the block are not cut off.
+    */
+    static TResult DrawMetatile(CFramework& aFramework,std::vector<CBitmap>& aTile,int32 aTileSize,int32 aZoom,int32 aX,int32 aY,int32 aColumns,int32 aRows,
+                                const TTileBitmapParam* aParam = nullptr)
+        {
+        aTile.clear();
+        const int32 n = 1 << aZoom;
+        if (aColumns <= 0 || aRows <= 0 || aX < 0 || aY < 0 || aX + aColumns > n || aY + aRows > n)
+            return KErrorInvalidArgument;
+
+        // There is no margin at the edges of the world.
+        const int32 margin = aTileSize / 4;
+        const int32 left = aX > 0 ? margin : 0;
+        const int32 top = aY > 0 ? margin : 0;
+        const int32 right = aX + aColumns < n ? margin : 0;
+        const int32 bottom = aY + aRows < n ? margin : 0;
+        const double m = double(margin) / aTileSize;
+        const TRectFP bounds(TileLong(aX - (left ? m : 0),aZoom),TileLat(aY + aRows + (bottom ? m : 0),aZoom),
+                             TileLong(aX + aColumns + (right ? m : 0),aZoom),TileLat(aY - (top ? m : 0),aZoom));
+
+        TResult error = KErrorNone;
+        CBitmap metatile = aFramework.TileBitmap(error,left + aColumns * aTileSize + right,top + aRows * aTileSize + bottom,bounds,TCoordType::Degree,aParam);
+        if (error)
+            return error;
+
+        aTile.reserve(size_t(aColumns) * size_t(aRows));
+        for (int32 row = 0; row < aRows; row++)
+            for (int32 column = 0; column < aColumns; column++)
+                {
+                const int32 x = left + column * aTileSize;
+                const int32 y = top + row * aTileSize;
+                aTile.push_back(metatile.Clip(TRect(x,y,x + aTileSize,y + aTileSize)));
+                }
+        return KErrorNone;
+        }
+
+    /** Return the statistics for the last call to Render or Write. */
+    const TStats& Stats() const { return iStats; }
+
+    private:
+    static constexpr int32 KMaxZoom = 30;
+    static constexpr uint64 KMaxEmptyTileMapSize = uint64(1) << 28;
+    static constexpr double KMaxLatitude = 85.0511287798066;
+
+    // The tiles at a zoom level intersecting the bounding box.
+    class TTileRange
+        {
+        public:
+        uint64 Width() const { return uint64(iMaxX - iMinX + 1); }
+        uint64 Height() const { return uint64(iMaxY - iMinY + 1); }
+        uint64 Count() const { return Width() * Height(); }
+        bool Contains(int32 aX,int32 aY) const { return aX >= iMinX && aX <= iMaxX && aY >= iMinY && aY <= iMaxY; }
+        uint64 Index(int32 aX,int32 aY) const { return uint64(aX - iMinX) * Height() + uint64(aY - iMinY); }
+
+        int32 iZoom = -1;
+        int32 iMinX = 0;
+        int32 iMinY = 0;
+        int32 iMaxX = -1;
+        int32 iMaxY = -1;
+        };
+
+    explicit CTilePyramidRenderer(const TParam& aParam):
+        iParam(aParam),
+        iPool(aParam.iThreadCount)
+        {
+        // The style hash covers everything other than the map data that affects the appearance of the tiles.
+        uint64 h = CDiskTileCache::StyleSheetHash(std::string(aParam.iStyleSheetFileName),aParam.iStyleSheetText);
+        h = CDiskTileCache::TileHash(aParam.iTileSize,aParam.iTileBitmapParam,h);
+        const int32 option[] = { std::max(1,aParam.iMetatileSize), aParam.iPalettize };
+        iStyleHash = CDiskTileCache::Hash(option,sizeof(option),h);
+        }
+
+    TDiskTileKey DiskTileKey(int32 aZoom,int32 aX,int32 aY) const
+        {
+        TDiskTileKey key;
+        key.iStyleHash = iStyleHash;
+        key.iMapGeneration = iParam.iMapGeneration;
+        key.iZoom = aZoom;
+        key.iX = aX;
+        key.iY = aY;
+        return key;
+        }
+
+    // Get all the tiles in a block from the disk tile cache, or none of them.
+    bool FindInDiskTileCache(std::vector<CBitmap>& aTile,int32 aZoom,const TTileRange& aBlock) const
+        {
+        if (!iParam.iDiskTileCache)
+            return false;
+        for (int32 y = aBlock.iMinY; y <= aBlock.iMaxY; y++)
+            for (int32 x = aBlock.iMinX; x <= aBlock.iMaxX; x++)
+                {
+                TResult error = KErrorNone;
+                aTile.push_back(iParam.iDiskTileCache->FindBitmap(error,DiskTileKey(aZoom,x,y)));
+                if (error)
+                    {
+                    aTile.clear();
+                    return false;
+                    }
+                }
+        return true;
+        }
+
+    // Pass a block of tiles which are not empty, in rows starting at the top left, to the tile handler.
+    static TResult HandleBlock(const TTileHandler& aHandler,int32 aZoom,const TTileRange& aBlock,const std::vector<CBitmap>& aTile,
+                               std::atomic<uint64>& aRenderedCount,std::atomic<uint64>& aTileCount)
+        {
+        size_t i = 0;
+        for (int32 y = aBlock.iMinY; y <= aBlock.iMaxY; y++)
+            for (int32 x = aBlock.iMinX; x <= aBlock.iMaxX; x++)
+                {
+                aRenderedCount++;
+                aTileCount++;
+                TResult error = aHandler(aZoom,x,y,aTile[i++],false);
+                if (error)
+                    return error;
+                }
+        return KErrorNone;
+        }
+
+    static int32 TileX(double aLong,int32 aZoom)
+        {
+        int32 n = 1 << aZoom;
+        int32 x = int32(std::floor((aLong + 180.0) / 360.0 * n));
+        return std::min(std::max(x,0),n - 1);
+        }
+
+    static int32 TileY(double aLat,int32 aZoom)
+        {
+        int32 n = 1 << aZoom;
+        aLat = std::min(std::max(aLat,-KMaxLatitude),KMaxLatitude) * KPiDouble / 180.0;
+        int32 y = int32(std::floor((1.0 - std::log(std::tan(aLat) + 1.0 / std::cos(aLat)) / KPiDouble) / 2.0 * n));
+        return std::min(std::max(y,0),n - 1);
+        }
+
+    static double TileLong(double aX,int32 aZoom)
+        {
+        return aX / double(1 << aZoom) * 360.0 - 180.0;
+        }
+
+    static double TileLat(double aY,int32 aZoom)
+        {
+        return std::atan(std::sinh(KPiDouble * (1.0 - 2.0 * aY / double(1 << aZoom)))) * 180.0 / KPiDouble;
+        }
+
+    TTileRange TileRange(int32 aZoom) const
+        {
+        TTileRange r;
+        r.iZoom = aZoom;
+        r.iMinX = TileX(iParam.iBounds.Left(),aZoom);
+        r.iMaxX = TileX(iParam.iBounds.Right(),aZoom);
+        r.iMinY = TileY(iParam.iBounds.Bottom(),aZoom); // tile rows go downwards, so the largest latitude gives the smallest row
+        r.iMaxY = TileY(iParam.iBounds.Top(),aZoom);
+        if (r.iMinY > r.iMaxY)
+            std::swap(r.iMinY,r.iMaxY);
+        return r;
+        }
+
+    // Return true if no map objects are in the block of tiles or within the margin round it.
+    bool IsEmpty(TResult& aError,const CFramework& aFramework,int32 aZoom,const TTileRange& aBlock) const
+        {
+        const double m = iParam.iEmptyTileMargin;
+        TFindParam param;
+        param.iMaxObjectCount = 1;
+        param.iMerge = false;
+        param.iClip = CGeometry(TRectFP(TileLong(aBlock.iMinX - m,aZoom),TileLat(aBlock.iMaxY + 1 + m,aZoom),
+                                        TileLong(aBlock.iMaxX + 1 + m,aZoom),TileLat(aBlock.iMinY - m,aZoom)),TCoordType::Degree);
+        CMapObjectArray found;
+        aError = aFramework.Find(found,param);
+        return !aError && found.empty();
+        }
+
+    // Return true if all the tiles at the previous zoom level containing the tiles in aBlock are known to be empty.
+    static bool IsInsideEmptyTiles(const TTileRange& aBlock,const TTileRange& aParentRange,const std::vector<uint8>& aParentEmpty)
+        {
+        for (int32 x = aBlock.iMinX >> 1; x <= aBlock.iMaxX >> 1; x++)
+            for (int32 y = aBlock.iMinY >> 1; y <= aBlock.iMaxY >> 1; y++)
+                if (!aParentRange.Contains(x,y) || !aParentEmpty[size_t(aParentRange.Index(x,y))])
+                    return false;
+        return true;
+        }
+
+    static void CreateFolder(const std::string& aName)
+        {
+#ifdef _MSC_VER
+        _mkdir(aName.c_str());
+#else
+        mkdir(aName.c_str(),0777);
+#endif
+        }
+
+    TParam iParam;
+    CWorkStealingPool iPool;
+    std::vector<std::unique_ptr<CFramework>> iFramework;
+    TStats iStats;
+    uint64 iStyleHash = 0;
+    };
+
+}
+
+#endif
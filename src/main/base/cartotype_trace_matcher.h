@@ -0,0 +1,399 @@
+/*
+CARTOTYPE_TRACE_MATCHER.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_TRACE_MATCHER_H__
+#define CARTOTYPE_TRACE_MATCHER_H__
+
+#include <cartotype_graph.h>
+#include <cartotype_road_index.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace CartoType
+{
+
+/**
+Parameters for matching a trace of position fixes to the road network using CTraceMatcher.
+Distances are in metres; CTraceMatcher converts them to map units using the map's point scale.
+*/
+class TTraceMatchParam
+    {
+    public:
+    /** The maximum distance in metres from a fix to a road to which it is matched. */
+    double iSearchRadius = 50;
+    /** The standard deviation of the position error of the fixes in metres. */
+    double iPositionAccuracy = 10;
+    /**
+    The scale in metres of the difference between the distance along the road between two matched points
+    and the straight-line distance between the fixes: larger values allow more winding routes between fixes.
+    */
+    double iRouteDifferenceScale = 20;
+    /** The maximum number of nearby road segments considered as matches for each fix. */
+    size_t iMaxCandidateCount = 8;
+    /**
+    The maximum difference in degrees between the course of a fix, if known, and the direction of travel along a road to which it is matched.
+    Fixes with a known course are matched only to the direction of a two-way road in which they are travelling.
+    */
+    double iMaxHeadingDifference = 60;
+    /** The maximum distance along the road between the matches of consecutive fixes, as a multiple of the straight-line distance. */
+    double iMaxDetourFactor = 4;
+    /** The number of threads used to match a set of traces; zero means the number of hardware threads. */
+    size_t iThreadCount = 0;
+    };
+
+/** A position fix in a trace to be matched by CTraceMatcher. */
+class TTraceFix
+    {
+    public:
+    /** The position in map units. */
+    TPointFP iPosition;
+    /** The course in degrees clockwise from north, or a negative number if not known. */
+    double iCourse = -1;
+    };
+
+/** The position on the road network to which a fix was matched by CTraceMatcher. */
+template<class TArcRef> class TMatchedFix
+    {
+    public:
+    /** The arc, or 0 if the fix was not matched. */
+    TArcRef iArc = 0;
+    /** The position along the arc, from 0 at its start to 1 at its end. */
+    double iFraction = 0;
+    /** The matched point. */
+    TPointFP iPoint;
+    /** The index of the arc in the arc sequence of the match. */
+    size_t iArcIndex = 0;
+    };
+
+/** The result of matching a trace using CTraceMatcher. */
+template<class TArcRef> class CTraceMatchResult
+    {
+    public:
+    /** The error code for this trace. */
+    TResult iError = 0;
+    /** The arcs traversed, in order. */
+    std::vector<TArcRef> iArc;
+    /** The match for each fix. */
+    std::vector<TMatchedFix<TArcRef>> iFix;
+    /** The indexes of the fixes at which the match was restarted because there was no route from the previous fix. */
+    std::vector<size_t> iBreak;
+    };
+
+/**
+Matches traces of position fixes to a road network using a hidden Markov model and the Viterbi algorithm.
+Matching a whole trace at once chooses the most likely path through the network rather than the nearest road to each fix,
+which avoids errors at junctions and on parallel roads.
+
+The candidate matches for each fix are the nearest road segments in a CRoadSegmentIndex. The probability of a candidate
+falls with the square of its distance from the fix, and the probability of a transition between candidates for consecutive fixes
+falls with the difference between the distance along the roads and the straight-line distance between the fixes.
+Distances along the roads are found by bounded one-to-many searches from the end of each earlier candidate's arc.
+
+The arc identifiers in the index must be the arc references of TStaticGraph, whose arc costs must be lengths in map units.
+Distances in TTraceMatchParam are in metres and are converted to map units using the point scale passed to the constructor:
+the size of a map unit in metres, for example 1/32 if the map unit is 32nds of metres. TArcTable must have the functions:
+
+uint32 StartNode(TArcRef aArc) const, uint32 EndNode(TArcRef aArc) const - return the node indexes of the ends of an arc;
+uint32 Length(TArcRef aArc) const - return the length of an arc;
+TArcRef ReverseArc(TArcRef aArc) const - return the arc in the opposite direction on the same road, or 0 if the road is one-way;
+double Fraction(const TRoadSegmentMatch& aMatch) const - return the position of a match along its arc, from 0 to 1.
+
+A CTraceMatcher holds per-query search state, so each thread needs its own.
+*/
+template<class TStaticGraph,class TArcTable> class CTraceMatcher
+    {
+    public:
+    using TArcRef = typename TStaticGraph::TArcRef;
+
+    CTraceMatcher(const TStaticGraph& aGraph,const TArcTable& aArcTable,const CRoadSegmentIndex& aIndex,const TTraceMatchParam& aParam,double aPointScale):
+        iSearchGraph(aGraph),
+        iArcTable(aArcTable),
+        iIndex(aIndex),
+        iParam(aParam)
+        {
+        iParam.iSearchRadius /= aPointScale;
+        iParam.iPositionAccuracy /= aPointScale;
+        iParam.iRouteDifferenceScale /= aPointScale;
+        }
+
+    /** Match a trace, putting the result in aResult. */
+    TResult Match(const std::vector<TTraceFix>& aTrace,CTraceMatchResult<TArcRef>& aResult)
+        {
+        aResult = CTraceMatchResult<TArcRef>();
+        aResult.iFix.resize(aTrace.size());
+        std::vector<std::vector<TCandidate>> layer(aTrace.size());
+        std::vector<TRoadSegmentMatch> match;
+        const std::vector<TCandidate>* prev_layer = nullptr;
+        size_t prev_fix = 0;
+        const double emission_scale = 1 / (2 * iParam.iPositionAccuracy * iParam.iPositionAccuracy);
+        const double min_cos = std::cos(iParam.iMaxHeadingDifference * KPi / 180);
+
+        for (size_t i = 0; i < aTrace.size(); i++)
+            {
+            auto& cur = layer[i];
+            iIndex.FindNearest(aTrace[i].iPosition,iParam.iSearchRadius,match,iParam.iMaxCandidateCount,
+                               aTrace[i].iCourse,iParam.iMaxHeadingDifference);
+            for (const auto& m : match)
+                {
+                // If the course is known, use only the directions of the road within the heading tolerance of it.
+                bool forward = true, backward = true;
+                const TRoadSegment& s = iIndex.Segment(m.iSegment);
+                const double vx = double(s.iX1) - s.iX0, vy = double(s.iY1) - s.iY0;
+                const double length = std::sqrt(vx * vx + vy * vy);
+                if (aTrace[i].iCourse >= 0 && length > 0)
+                    {
+                    const double c = (vx * std::sin(aTrace[i].iCourse * KPi / 180) + vy * std::cos(aTrace[i].iCourse * KPi / 180)) / length;
+                    forward = c >= min_cos;
+                    backward = -c >= min_cos;
+                    }
+
+                const double emission = m.iDistance * m.iDistance * emission_scale;
+                const double fraction = iArcTable.Fraction(m);
+                if (forward)
+                    cur.push_back(TCandidate { TArcRef(m.iArc),fraction,m.iNearestPoint,emission });
+                TArcRef reverse = iArcTable.ReverseArc(TArcRef(m.iArc));
+                if (reverse && backward)
+                    cur.push_back(TCandidate { reverse,1 - fraction,m.iNearestPoint,emission });
+                }
+            if (cur.empty())
+                continue;
+
+            bool connected = false;
+            if (prev_layer)
+                {
+                TResult error = Transitions(*prev_layer,cur,aTrace[prev_fix].iPosition,aTrace[i].iPosition);
+                if (error)
+                    return aResult.iError = error;
+                for (const auto& c : cur)
+                    connected |= c.iPrev != KNoCandidate;
+                // Candidates which cannot be reached from the previous fix cannot be on the best path.
+                if (connected)
+                    for (auto& c : cur)
+                        if (c.iPrev == KNoCandidate)
+                            c.iScore = HUGE_VAL;
+                }
+            if (!connected)
+                {
+                if (prev_layer)
+                    aResult.iBreak.push_back(i);
+                for (auto& c : cur)
+                    c.iScore = c.iEmission;
+                }
+            prev_layer = &cur;
+            prev_fix = i;
+            }
+
+        return BuildResult(layer,aResult);
+        }
+
+    private:
+    static constexpr size_t KNoCandidate = SIZE_MAX;
+    static constexpr double KPi = 3.14159265358979323846;
+
+    class TCandidate
+        {
+        public:
+        TArcRef iArc;
+        double iFraction;
+        TPointFP iPoint;
+        double iEmission;
+        // The negative log probability of the best path ending here, and the candidate for the previous matched fix on that path.
+        double iScore = 0;
+        size_t iPrev = KNoCandidate;
+        };
+
+    using TGraph = CSearchGraph<TStaticGraph>;
+    using TNode = typename TGraph::TNode;
+    using TSearch = TDijkstra<TGraph,TNode,TArcRef,CRadixHeapOpenSet<TNode>>;
+
+    // Return the length of a movement along a single arc, or -1 if it would need to leave the arc.
+    double LengthOnArc(const TCandidate& aFrom,const TCandidate& aTo) const
+        {
+        if (aFrom.iArc != aTo.iArc)
+            return -1;
+        double length = (aTo.iFraction - aFrom.iFraction) * iArcTable.Length(aFrom.iArc);
+        // Small backward movements are position errors, not loops round the network.
+        if (length < 0 && length > -2 * iParam.iPositionAccuracy)
+            length = 0;
+        return length;
+        }
+
+    // Find the best predecessor of each candidate in aCur from the candidates in aPrev.
+    TResult Transitions(const std::vector<TCandidate>& aPrev,std::vector<TCandidate>& aCur,const TPointFP& aPrevPos,const TPointFP& aCurPos)
+        {
+        const double straight = std::sqrt((aCurPos.iX - aPrevPos.iX) * (aCurPos.iX - aPrevPos.iX) + (aCurPos.iY - aPrevPos.iY) * (aCurPos.iY - aPrevPos.iY));
+        const double max_length = straight * iParam.iMaxDetourFactor + 2 * iParam.iSearchRadius;
+        std::vector<TNode*> target(aCur.size());
+        for (size_t j = 0; j < aCur.size(); j++)
+            target[j] = iSearchGraph.Node(iArcTable.StartNode(aCur[j].iArc));
+
+        auto consider = [&](size_t aFrom,size_t aTo,double aLength)
+            {
+            if (aLength < 0 || aLength > max_length || aPrev[aFrom].iScore == HUGE_VAL)
+                return;
+            double score = aPrev[aFrom].iScore + aCur[aTo].iEmission + std::abs(aLength - straight) / iParam.iRouteDifferenceScale;
+            if (aCur[aTo].iPrev == KNoCandidate || score < aCur[aTo].iScore)
+                {
+                aCur[aTo].iScore = score;
+                aCur[aTo].iPrev = aFrom;
+                }
+            };
+
+        // Search once from the end node of each distinct arc.
+        std::vector<uint32> cost;
+        std::vector<bool> done(aPrev.size());
+        TSearch dijkstra(iSearchGraph,false,true);
+        for (size_t i = 0; i < aPrev.size(); i++)
+            {
+            for (size_t j = 0; j < aCur.size(); j++)
+                consider(i,j,LengthOnArc(aPrev[i],aCur[j]));
+            if (done[i])
+                continue;
+
+            const uint32 end_node = iArcTable.EndNode(aPrev[i].iArc);
+            TResult error = dijkstra.CalculateOneToMany(iSearchGraph.Node(end_node),target,cost,uint32(std::min(max_length + 1,double(UINT32_MAX))));
+            if (error)
+                return error;
+            for (size_t k = i; k < aPrev.size(); k++)
+                {
+                if (done[k] || iArcTable.EndNode(aPrev[k].iArc) != end_node)
+                    continue;
+                done[k] = true;
+                const double rest = (1 - aPrev[k].iFraction) * iArcTable.Length(aPrev[k].iArc);
+                for (size_t j = 0; j < aCur.size(); j++)
+                    if (cost[j] != UINT32_MAX && !(aPrev[k].iArc == aCur[j].iArc && LengthOnArc(aPrev[k],aCur[j]) >= 0))
+                        consider(k,j,rest + cost[j] + aCur[j].iFraction * iArcTable.Length(aCur[j].iArc));
+                }
+            }
+        return KErrorNone;
+        }
+
+    // Append the arcs of the shortest path from the end of aFrom to the start of aTo, then aTo itself.
+    TResult AppendPath(TArcRef aFrom,TArcRef aTo,std::vector<TArcRef>& aArc)
+        {
+        const uint32 start = iArcTable.EndNode(aFrom);
+        const uint32 end = iArcTable.StartNode(aTo);
+        std::vector<uint32> cost;
+        TSearch dijkstra(iSearchGraph,false,true);
+        TResult error = dijkstra.CalculateOneToMany(iSearchGraph.Node(start),std::vector<TNode*> { iSearchGraph.Node(end) },cost);
+        if (error)
+            return error;
+        if (cost[0] == UINT32_MAX)
+            return KErrorNoRoute;
+        const size_t first = aArc.size();
+        for (uint32 n = end; n != start; )
+            {
+            TNode* node = iSearchGraph.Node(n);
+            aArc.push_back(iSearchGraph.Previous(node));
+            n = iSearchGraph.PreviousNodeIndex(node);
+            }
+        std::reverse(aArc.begin() + first,aArc.end());
+        aArc.push_back(aTo);
+        return KErrorNone;
+        }
+
+    // Trace back the best path through each run of connected fixes and build the arc sequence.
+    TResult BuildResult(const std::vector<std::vector<TCandidate>>& aLayer,CTraceMatchResult<TArcRef>& aResult)
+        {
+        std::vector<size_t> chosen(aLayer.size(),KNoCandidate);
+        size_t next_break = aResult.iBreak.size();
+        for (size_t i = aLayer.size(); i-- > 0; )
+            {
+            const auto& cur = aLayer[i];
+            if (cur.empty())
+                continue;
+            // Start at the best candidate of the last fix of each run, then follow the predecessors.
+            size_t later = KNoCandidate;
+            for (size_t k = i + 1; k < aLayer.size(); k++)
+                if (!aLayer[k].empty())
+                    {
+                    later = k;
+                    break;
+                    }
+            const bool run_end = later == KNoCandidate || (next_break > 0 && aResult.iBreak[next_break - 1] == later);
+            if (run_end)
+                {
+                if (later != KNoCandidate)
+                    next_break--;
+                size_t best = 0;
+                for (size_t c = 1; c < cur.size(); c++)
+                    if (cur[c].iScore < cur[best].iScore)
+                        best = c;
+                chosen[i] = best;
+                }
+            else
+                chosen[i] = aLayer[later][chosen[later]].iPrev;
+            }
+
+        const TCandidate* prev = nullptr;
+        size_t break_index = 0;
+        for (size_t i = 0; i < aLayer.size(); i++)
+            {
+            if (chosen[i] == KNoCandidate)
+                continue;
+            const TCandidate& c = aLayer[i][chosen[i]];
+            const bool new_run = break_index < aResult.iBreak.size() && aResult.iBreak[break_index] == i;
+            if (new_run)
+                break_index++;
+            if (!prev || new_run)
+                aResult.iArc.push_back(c.iArc);
+            else if (LengthOnArc(*prev,c) < 0)
+                {
+                TResult error = AppendPath(prev->iArc,c.iArc,aResult.iArc);
+                if (error)
+                    return aResult.iError = error;
+                }
+            auto& fix = aResult.iFix[i];
+            fix.iArc = c.iArc;
+            fix.iFraction = c.iFraction;
+            fix.iPoint = c.iPoint;
+            fix.iArcIndex = aResult.iArc.size() - 1;
+            prev = &c;
+            }
+        return KErrorNone;
+        }
+
+    TGraph iSearchGraph;
+    const TArcTable& iArcTable;
+    const CRoadSegmentIndex& iIndex;
+    TTraceMatchParam iParam;
+    };
+
+/**
+Match a set of traces in parallel, putting the results in aResult in the same order as aTrace.
+aPointScale is the size of a map unit in metres, as passed to the CTraceMatcher constructor.
+Each of up to aParam.iThreadCount threads has its own CTraceMatcher and takes the next unmatched trace until none remain.
+Errors are returned for each trace in CTraceMatchResult::iError.
+*/
+template<class TStaticGraph,class TArcTable>
+void MatchTraces(const TStaticGraph& aGraph,const TArcTable& aArcTable,const CRoadSegmentIndex& aIndex,const TTraceMatchParam& aParam,double aPointScale,
+                 const std::vector<std::vector<TTraceFix>>& aTrace,std::vector<CTraceMatchResult<typename TStaticGraph::TArcRef>>& aResult)
+    {
+    aResult.clear();
+    aResult.resize(aTrace.size());
+    size_t thread_count = aParam.iThreadCount ? aParam.iThreadCount : std::max(1U,std::thread::hardware_concurrency());
+    thread_count = std::max(size_t(1),std::min(thread_count,aTrace.size()));
+
+    std::atomic<size_t> next_trace(0);
+    auto worker = [&]()
+        {
+        CTraceMatcher<TStaticGraph,TArcTable> matcher(aGraph,aArcTable,aIndex,aParam,aPointScale);
+        for (size_t i = next_trace++; i < aTrace.size(); i = next_trace++)
+            matcher.Match(aTrace[i],aResult[i]);
+        };
+    std::vector<std::thread> thread;
+    for (size_t i = 1; i < thread_count; i++)
+        thread.emplace_back(worker);
+    worker();
+    for (auto& t : thread)
+        t.join();
+    }
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+CARTOTYPE_TRAVEL_TIME.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_TRAVEL_TIME_H__
+#define CARTOTYPE_TRAVEL_TIME_H__
+
+#include <cartotype_contraction_hierarchy.h>
+#include <cartotype_stream.h>
+#include <vector>
+
+namespace CartoType
+{
+
+/**
+The travel times from or to a single place, such as a facility used in catchment analysis,
+stored as columns of node positions and costs.
+
+Write outputs the table as native-endian 32-bit integers: a signature, a version, the number of rows,
+the number of seconds per cost unit as a 32-bit float, then the X, Y and cost columns in that order.
+*/
+class CTravelTimeTable
+    {
+    public:
+    void Clear()
+        {
+        iX.clear();
+        iY.clear();
+        iCost.clear();
+        }
+
+    size_t Count() const { return iCost.size(); }
+
+    /**
+    Append a row for each node with a cost less than aMaxCost. The cost of node N is aCost[N * aStride],
+    and its position is returned by aPosition(N) as a TPoint.
+    */
+    template<class TPositionFunction> void Append(const uint32* aCost,size_t aNodeCount,size_t aStride,uint32 aMaxCost,TPositionFunction&& aPosition)
+        {
+        for (size_t i = 0; i < aNodeCount; i++)
+            {
+            const uint32 cost = aCost[i * aStride];
+            if (cost < aMaxCost)
+                {
+                const TPoint p = aPosition(uint32(i));
+                iX.push_back(p.iX);
+                iY.push_back(p.iY);
+                iCost.push_back(cost);
+                }
+            }
+        }
+
+    /** Write the table as a block of 32-bit integers. */
+    TResult Write(MOutputStream& aOutput) const
+        {
+        float seconds_per_cost_unit = float(iSecondsPerCostUnit);
+        uint32 header[4] = { KFileSignature, KFileVersion, uint32(Count()), 0 };
+        memcpy(header + 3,&seconds_per_cost_unit,sizeof(float));
+        TResult error = aOutput.Write(reinterpret_cast<const uint8*>(header),sizeof(header));
+        if (!error)
+            error = aOutput.Write(reinterpret_cast<const uint8*>(iX.data()),iX.size() * sizeof(int32));
+        if (!error)
+            error = aOutput.Write(reinterpret_cast<const uint8*>(iY.data()),iY.size() * sizeof(int32));
+        if (!error)
+            error = aOutput.Write(reinterpret_cast<const uint8*>(iCost.data()),iCost.size() * sizeof(uint32));
+        return error;
+        }
+
+    /** The X coordinates of the nodes. */
+    std::vector<int32> iX;
+    /** The Y coordinates of the nodes. */
+    std::vector<int32> iY;
+    /** The costs from or to the place. */
+    std::vector<uint32> iCost;
+    /** The number of seconds represented by one cost unit. */
+    double iSecondsPerCostUnit = 1;
+
+    private:
+    static constexpr uint32 KFileSignature = 0x43545454; // "CTTT"
+    static constexpr uint32 KFileVersion = 1;
+    };
+
+/**
+Calculate the costs from aNode to every node in aGraph, a static graph of the kind used by CSearchGraph,
+or, if aForwards is false, the costs from every node to aNode. Nodes with a cost of aMaxCost or more,
+and nodes that cannot be reached, have the cost UINT32_MAX.
+*/
+template<class TStaticGraph> TResult CalculateTravelTimes(const TStaticGraph& aGraph,uint32 aNode,bool aForwards,uint32 aMaxCost,std::vector<uint32>& aCost)
+    {
+    using TGraph = CSearchGraph<TStaticGraph>;
+    using TNode = typename TGraph::TNode;
+    using TArcRef = typename TGraph::TArcRef;
+
+    aCost.assign(aGraph.NodeCount(),UINT32_MAX);
+    TGraph graph(aGraph);
+    TDijkstra<TGraph,TNode,TArcRef,CRadixHeapOpenSet<TNode>> dijkstra(graph,false,aForwards);
+    return dijkstra.CalculateSettledNodes(graph.Node(aNode,aForwards),aMaxCost,[&](const TNode* aSettledNode,uint32 aNodeCost)
+        {
+        aCost[graph.NodeIndex(aSettledNode)] = aNodeCost;
+        return true;
+        });
+    }
+
+/**
+Calculates the costs from or to every node for several source nodes at once using PHAST (hardware-accelerated shortest path trees)
+on a customized contraction hierarchy. Each source needs only a small upward search; then all the costs are completed
+by a single sweep over the nodes in descending order of rank, which reads the arcs of the hierarchy sequentially,
+and handles all the sources together in the inner loop.
+
+The cost of a one-to-all query is thus a linear scan rather than a full Dijkstra search with its priority queue.
+A CTravelTimeSweep holds the scratch state for the upward searches, so use one object per thread.
+*/
+class CTravelTimeSweep
+    {
+    public:
+    CTravelTimeSweep(const CCustomizableContractionHierarchy& aHierarchy,const CContractionHierarchyMetric& aMetric):
+        iHierarchy(aHierarchy),
+        iMetric(aMetric),
+        iGraph(aHierarchy,aMetric),
+        iSearchGraph(iGraph)
+        {
+        }
+
+    /**
+    Calculate the costs from each node in aNode to every node, or, if aForwards is false, from every node to each node in aNode.
+    Nodes are identified by their rank in the hierarchy. On return the cost of node N for source I is aCost[N * aNode.size() + I],
+    or UINT32_MAX if it cannot be reached.
+    */
+    TResult Calculate(const std::vector<uint32>& aNode,bool aForwards,std::vector<uint32>& aCost)
+        {
+        using TDijkstraType = TDijkstra<TSearchGraph,TNode,uint32,CRadixHeapOpenSet<TNode>>;
+
+        const size_t count = aNode.size();
+        const uint32 node_count = iHierarchy.NodeCount();
+        aCost.assign(size_t(node_count) * count,UINT32_MAX);
+        if (!count)
+            return KErrorNone;
+
+        // Search upwards from each source.
+        TResult error = 0;
+        for (size_t i = 0; i < count && !error; i++)
+            {
+            if (aNode[i] >= node_count)
+                return KErrorInvalidArgument;
+            TDijkstraType dijkstra(iSearchGraph,false,aForwards);
+            error = dijkstra.CalculateSettledNodes(iSearchGraph.Node(aNode[i],aForwards),UINT32_MAX,[&](const TNode* aSettledNode,uint32 aNodeCost)
+                {
+                aCost[size_t(iSearchGraph.NodeIndex(aSettledNode)) * count + i] = aNodeCost;
+                return true;
+                });
+            }
+        if (error)
+            return error;
+
+        // Sweep downwards: the costs of all higher nodes are final when a node is reached.
+        const uint32* arc_cost = aForwards ? iMetric.iDownCost.data() : iMetric.iUpCost.data();
+        uint32* cost = aCost.data();
+        for (uint32 node = node_count; node-- > 0; )
+            {
+            uint32* node_cost = cost + size_t(node) * count;
+            const uint32 end = iHierarchy.UpArcEnd(node);
+            for (uint32 arc = iHierarchy.UpArcBegin(node); arc < end; arc++)
+                {
+                const uint32 c = arc_cost[arc];
+                if (c == UINT32_MAX)
+                    continue;
+                const uint32* higher_cost = cost + size_t(iHierarchy.ArcHead(arc)) * count;
+                for (size_t i = 0; i < count; i++)
+                    {
+                    const uint32 h = higher_cost[i];
+                    const uint32 d = h < UINT32_MAX - c ? h + c : UINT32_MAX;
+                    if (d < node_cost[i])
+                        node_cost[i] = d;
+                    }
+                }
+            }
+        return KErrorNone;
+        }
+
+    private:
+    using TSearchGraph = CSearchGraph<TContractionHierarchyGraph>;
+    using TNode = TSearchGraph::TNode;
+
+    const CCustomizableContractionHierarchy& iHierarchy;
+    const CContractionHierarchyMetric& iMetric;
+    TContractionHierarchyGraph iGraph;
+    TSearchGraph iSearchGraph;
+    };
+
+}
+
+#endif
@@ -0,0 +1,524 @@
+/*
+CARTOTYPE_TURN_GRAPH.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+*/
+
+#ifndef CARTOTYPE_TURN_GRAPH_H__
+#define CARTOTYPE_TURN_GRAPH_H__
+
+#include <cartotype_graph.h>
+#include <cartotype_navigation.h>
+#include <cartotype_stream.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace CartoType
+{
+
+/** An arc used to create a CCompressedTurnGraph. */
+class TTurnGraphArc
+    {
+    public:
+    uint32 iStartNode = 0;
+    uint32 iEndNode = 0;
+    /** The cost of traversing the arc. */
+    uint32 iCost = 0;
+    /** The direction of travel at the start of the arc, in 256ths of a circle clockwise from north. */
+    uint8 iStartBearing = 0;
+    /** The direction of travel at the end of the arc, in 256ths of a circle clockwise from north. */
+    uint8 iEndBearing = 0;
+    };
+
+/** A turn restriction from one arc to the next, used to create a CCompressedTurnGraph. */
+class TTurnRestriction
+    {
+    public:
+    /** The index of the arc before the turn. */
+    uint32 iFromArc = 0;
+    /** The index of the arc after the turn, which must start where iFromArc ends. */
+    uint32 iToArc = 0;
+    /** If true, iToArc is the only arc that can be taken after iFromArc; if false, the turn is prohibited. */
+    bool iMandatory = false;
+    };
+
+/** The costs added to turns in a CCompressedTurnGraph, in the same units as arc costs. */
+class TTurnCosts
+    {
+    public:
+    TTurnCosts() = default;
+
+    /** Create turn costs from the turn times in a route profile, given the cost of one second. */
+    TTurnCosts(const TRouteProfile& aProfile,double aCostPerSecond,bool aDriveOnLeft):
+        iTurnCost(uint32(std::max(aProfile.iTurnTime,int32(0)) * aCostPerSecond)),
+        iUTurnCost(uint32(std::max(aProfile.iUTurnTime,int32(0)) * aCostPerSecond)),
+        iCrossTrafficTurnCost(uint32(std::max(aProfile.iCrossTrafficTurnTime,int32(0)) * aCostPerSecond)),
+        iDriveOnLeft(aDriveOnLeft)
+        {
+        }
+
+    /** The cost of a turn of more than 30 degrees. */
+    uint32 iTurnCost = 0;
+    /** The cost of a turn of more than 165 degrees, which is treated as a U-turn. */
+    uint32 iUTurnCost = 0;
+    /** The extra cost of a turn across oncoming traffic: a left turn when driving on the right, or a right turn when driving on the left. */
+    uint32 iCrossTrafficTurnCost = 0;
+    /** True if traffic drives on the left. */
+    bool iDriveOnLeft = false;
+    };
+
+/**
+A compressed edge-based routing graph, giving turn-aware routing with about the same memory as a node-based graph.
+
+The nodes of the search graph are the arcs of the road graph, so that routes can go twice through a junction
+and turns can be costed and restricted. Instead of storing an arc for every possible turn, as a fully expanded graph does,
+the turns out of an arc are generated on demand from the arcs leaving its end node. Turn costs are calculated from the
+bearings of the arcs, and prohibited turns are held in a sorted exception list, consulted only for arcs flagged as having
+restrictions. Mandatory turns are stored as prohibitions of all the other turns.
+
+The arcs of each node are packed into a byte stream of variable-length integers: for each outgoing arc the difference
+between the end and start node and a restriction flag, the cost, and the start and end bearings, then the incoming arcs,
+each as an offset from the node's first arc and a restriction flag, followed by its end bearing.
+
+The data is a block of native-endian 32-bit integers followed by the byte stream, so that it can be
+stored in a map file or sidecar file, memory-mapped, and used by Attach without copying.
+
+CCompressedTurnGraph is a static graph as used by CSearchGraph: node indexes are arc indexes, and the arc references
+returned by the arc iterator are the index plus one of the arc at the other end of the turn.
+*/
+class CCompressedTurnGraph
+    {
+    public:
+    using TArcRef = uint32;
+
+    CCompressedTurnGraph() = default;
+    /*
+    The arc offsets and the byte stream are read through pointers set by SetData, which refer to iOwnedData
+    when the graph was made by Create. Copying is therefore not allowed; a move hands over the same buffer and calls SetData again.
+    */
+    CCompressedTurnGraph(const CCompressedTurnGraph&) = delete;
+    CCompressedTurnGraph& operator=(const CCompressedTurnGraph&) = delete;
+    CCompressedTurnGraph(CCompressedTurnGraph&& aOther) noexcept { *this = std::move(aOther); }
+    CCompressedTurnGraph& operator=(CCompressedTurnGraph&& aOther) noexcept
+        {
+        if (this != &aOther)
+            {
+            Clear();
+            iOwnedData = std::move(aOther.iOwnedData);
+            if (aOther.iData)
+                SetData(aOther.iData);
+            iTurnCosts = aOther.iTurnCosts;
+            aOther.Clear();
+            }
+        return *this;
+        }
+
+    /**
+    Create the graph from arcs sorted by start node and a list of turn restrictions.
+    Arcs are referred to by their indexes in aArc.
+    */
+    TResult Create(uint32 aNodeCount,const std::vector<TTurnGraphArc>& aArc,const std::vector<TTurnRestriction>& aRestriction)
+        {
+        Clear();
+        const uint32 arc_count = uint32(aArc.size());
+        std::vector<uint32> first(size_t(aNodeCount) + 1);
+        for (uint32 i = 0; i < arc_count; i++)
+            {
+            const TTurnGraphArc& a = aArc[i];
+            if (a.iStartNode >= aNodeCount || a.iEndNode >= aNodeCount || (i && a.iStartNode < aArc[i - 1].iStartNode))
+                return KErrorInvalidArgument;
+            first[a.iStartNode + 1]++;
+            }
+        for (uint32 i = 0; i < aNodeCount; i++)
+            first[i + 1] += first[i];
+
+        // Convert the restrictions to a sorted list of prohibited turns.
+        std::vector<std::pair<uint32,uint32>> prohibited;
+        for (const auto& r : aRestriction)
+            {
+            if (r.iFromArc >= arc_count || r.iToArc >= arc_count || aArc[r.iFromArc].iEndNode != aArc[r.iToArc].iStartNode)
+                return KErrorInvalidArgument;
+            if (!r.iMandatory)
+                prohibited.emplace_back(r.iFromArc,r.iToArc);
+            else
+                {
+                const uint32 node = aArc[r.iToArc].iStartNode;
+                for (uint32 i = first[node]; i < first[node + 1]; i++)
+                    if (i != r.iToArc)
+                        prohibited.emplace_back(r.iFromArc,i);
+                }
+            }
+        std::sort(prohibited.begin(),prohibited.end());
+        prohibited.erase(std::unique(prohibited.begin(),prohibited.end()),prohibited.end());
+        std::vector<bool> restricted(arc_count);
+        for (const auto& p : prohibited)
+            restricted[p.first] = true;
+
+        std::vector<std::vector<uint32>> incoming(aNodeCount);
+        for (uint32 i = 0; i < arc_count; i++)
+            incoming[aArc[i].iEndNode].push_back(i);
+
+        std::vector<uint8> stream;
+        std::vector<uint32> offset(size_t(aNodeCount) + 1);
+        for (uint32 node = 0; node < aNodeCount; node++)
+            {
+            offset[node] = uint32(stream.size());
+            for (uint32 i = first[node]; i < first[node + 1]; i++)
+                {
+                const TTurnGraphArc& a = aArc[i];
+                WriteVarint(stream,ZigZag(int64(a.iEndNode) - int64(a.iStartNode)) << 1 | (restricted[i] ? 1 : 0));
+                WriteVarint(stream,a.iCost);
+                stream.push_back(a.iStartBearing);
+                stream.push_back(a.iEndBearing);
+                }
+            WriteVarint(stream,incoming[node].size());
+            for (uint32 i : incoming[node])
+                {
+                WriteVarint(stream,ZigZag(int64(i) - int64(first[node])) << 1 | (restricted[i] ? 1 : 0));
+                stream.push_back(aArc[i].iEndBearing);
+                }
+            std::vector<uint32>().swap(incoming[node]);
+            }
+        offset[aNodeCount] = uint32(stream.size());
+        if (stream.size() > UINT32_MAX)
+            return KErrorOverflow;
+
+        const size_t block_count = BlockCount(arc_count);
+        const size_t size = KHeaderSize + (size_t(aNodeCount) + 1) * 2 + block_count + prohibited.size() * 2 + (stream.size() + 3) / 4;
+        iOwnedData.assign(size,0);
+        uint32* p = iOwnedData.data();
+        p[0] = KFileSignature;
+        p[1] = KFileVersion;
+        p[2] = aNodeCount;
+        p[3] = arc_count;
+        p[4] = uint32(prohibited.size());
+        p[5] = uint32(stream.size());
+        p += KHeaderSize;
+        p = std::copy(first.begin(),first.end(),p);
+        p = std::copy(offset.begin(),offset.end(),p);
+        for (size_t block = 0, node = 0; block < block_count; block++)
+            {
+            // The start node of the first arc in each block, or of the last arc for the final block.
+            const uint32 arc = std::min(uint32(block * KBlockSize),arc_count ? arc_count - 1 : 0);
+            while (node < aNodeCount && first[node + 1] <= arc)
+                node++;
+            *p++ = uint32(node);
+            }
+        for (const auto& r : prohibited)
+            {
+            *p++ = r.first;
+            *p++ = r.second;
+            }
+        std::copy(stream.begin(),stream.end(),reinterpret_cast<uint8*>(p));
+        SetData(iOwnedData.data());
+        return KErrorNone;
+        }
+
+    /**
+    Use a graph written by Write, usually from a memory-mapped file, without copying it.
+    The data must be aligned on a four-byte boundary and must remain valid while the graph is used.
+    */
+    TResult Attach(const uint8* aData,size_t aLength)
+        {
+        Clear();
+        const uint32* data = reinterpret_cast<const uint32*>(aData);
+        if (aLength < KHeaderSize * sizeof(uint32) || (reinterpret_cast<uintptr_t>(aData) % sizeof(uint32)) || data[0] != KFileSignature)
+            return KErrorUnknownDataFormat;
+        if (data[1] != KFileVersion)
+            return KErrorUnknownVersion;
+        if (aLength != DataSize(data))
+            return KErrorCorrupt;
+        SetData(data);
+        return KErrorNone;
+        }
+
+    /** Write the graph in the form used by Attach. */
+    TResult Write(MOutputStream& aOutput) const
+        {
+        if (!iData)
+            return KErrorNone;
+        return aOutput.Write(reinterpret_cast<const uint8*>(iData),DataSize(iData));
+        }
+
+    void Clear()
+        {
+        iOwnedData.clear();
+        iData = nullptr;
+        iNodeCount = iArcCount = iProhibitedCount = 0;
+        }
+
+    /** Set the turn costs used by the arc iterator. */
+    void SetTurnCosts(const TTurnCosts& aTurnCosts) { iTurnCosts = aTurnCosts; }
+    const TTurnCosts& TurnCosts() const { return iTurnCosts; }
+
+    /** Return the number of nodes in the search graph, which is the number of arcs in the road graph. */
+    size_t NodeCount() const { return iArcCount; }
+    /** Return the number of nodes in the road graph. */
+    uint32 RoadNodeCount() const { return iNodeCount; }
+    uint32 ArcCount() const { return iArcCount; }
+    /** Return the number of prohibited turns. */
+    uint32 ProhibitedTurnCount() const { return iProhibitedCount; }
+    /** Return the size of the graph data in bytes. */
+    size_t ByteCount() const { return iData ? DataSize(iData) : 0; }
+
+    /** Return the start node of an arc. */
+    uint32 StartNode(uint32 aArc) const
+        {
+        assert(aArc < iArcCount);
+        const uint32 block = aArc / KBlockSize;
+        const uint32* low = iFirstArc + iBlockNode[block];
+        const uint32* high = iFirstArc + iBlockNode[block + 1] + 1;
+        return uint32(std::upper_bound(low,high,aArc) - iFirstArc) - 1;
+        }
+
+    /** Return the end node of an arc. */
+    uint32 EndNode(uint32 aArc) const
+        {
+        TArcRecord r;
+        DecodeArc(aArc,r);
+        return r.iEndNode;
+        }
+
+    /** Return the cost of an arc. */
+    uint32 ArcCost(uint32 aArc) const
+        {
+        TArcRecord r;
+        DecodeArc(aArc,r);
+        return r.iCost;
+        }
+
+    /** Return true if the turn from aFromArc to aToArc is prohibited. */
+    bool IsProhibited(uint32 aFromArc,uint32 aToArc) const
+        {
+        const TProhibitedTurn* end = iProhibited + iProhibitedCount;
+        const TProhibitedTurn* p = std::lower_bound(iProhibited,end,TProhibitedTurn { aFromArc, aToArc });
+        return p != end && p->iFromArc == aFromArc && p->iToArc == aToArc;
+        }
+
+    /** Return the cost of a turn, excluding the cost of the arc after the turn, given the bearings at the end of the arc before the turn and the start of the arc after it. */
+    uint32 TurnCost(uint8 aEndBearing,uint8 aStartBearing) const
+        {
+        // Positive angles, in 256ths of a circle, are clockwise, and thus turns to the right.
+        const int angle = int8(uint8(aStartBearing - aEndBearing));
+        const int abs_angle = angle < 0 ? -angle : angle;
+        if (abs_angle <= KStraightAngle)
+            return 0;
+        if (abs_angle >= KUTurnAngle)
+            return iTurnCosts.iUTurnCost;
+        if ((angle < 0) != iTurnCosts.iDriveOnLeft)
+            return iTurnCosts.iTurnCost + iTurnCosts.iCrossTrafficTurnCost;
+        return iTurnCosts.iTurnCost;
+        }
+
+    /**
+    An iterator over the turns from or to an arc. Cost() is the turn cost plus the cost of the arc after the turn.
+    EndNodeIndex() is the index of the arc at the other end of the turn.
+    */
+    class TArcIterator
+        {
+        public:
+        TArcIterator(const CCompressedTurnGraph& aGraph,uint32 aArc,bool aOutgoing):
+            iGraph(aGraph),
+            iArc(aArc),
+            iOutgoing(aOutgoing)
+            {
+            TArcRecord r;
+            const uint32 start_node = aGraph.DecodeArc(aArc,r);
+            iArcRestricted = r.iRestricted;
+            if (aOutgoing)
+                {
+                iBearing = r.iEndBearing;
+                iData = aGraph.iStream + aGraph.iOffset[r.iEndNode];
+                iIndex = aGraph.iFirstArc[r.iEndNode];
+                iEnd = aGraph.iFirstArc[r.iEndNode + 1];
+                }
+            else
+                {
+                iBearing = r.iStartBearing;
+                iArcCost = r.iCost;
+                iData = aGraph.iStream + aGraph.iOffset[start_node];
+                iBase = aGraph.iFirstArc[start_node];
+                for (uint32 i = iBase; i < aGraph.iFirstArc[start_node + 1]; i++)
+                    SkipArc(iData);
+                iIndex = 0;
+                iEnd = uint32(ReadVarint(iData));
+                }
+            }
+
+        bool Next(TResult& /*aError*/)
+            {
+            if (iOutgoing)
+                {
+                while (iIndex < iEnd)
+                    {
+                    const uint32 arc = iIndex++;
+                    SkipVarint(iData);
+                    const uint32 cost = uint32(ReadVarint(iData));
+                    const uint8 start_bearing = iData[0];
+                    iData += 2;
+                    if (iArcRestricted && iGraph.IsProhibited(iArc,arc))
+                        continue;
+                    iEndArc = arc;
+                    iCost = cost + iGraph.TurnCost(iBearing,start_bearing);
+                    return true;
+                    }
+                return false;
+                }
+            while (iIndex < iEnd)
+                {
+                iIndex++;
+                const uint64 v = ReadVarint(iData);
+                const uint8 end_bearing = *iData++;
+                const uint32 arc = uint32(int64(iBase) + UnZigZag(v >> 1));
+                if ((v & 1) && iGraph.IsProhibited(arc,iArc))
+                    continue;
+                iEndArc = arc;
+                iCost = iArcCost + iGraph.TurnCost(end_bearing,iBearing);
+                return true;
+                }
+            return false;
+            }
+        TArcRef Arc() const { return iEndArc + 1; }
+        uint32 Cost() const { return iCost; }
+        uint32 EndNodeIndex() const { return iEndArc; }
+
+        private:
+        const CCompressedTurnGraph& iGraph;
+        uint32 iArc;
+        bool iOutgoing;
+        bool iArcRestricted = false;
+        uint8 iBearing = 0;
+        uint32 iArcCost = 0;
+        const uint8* iData = nullptr;
+        uint32 iBase = 0;
+        uint32 iIndex = 0;
+        uint32 iEnd = 0;
+        uint32 iEndArc = 0;
+        uint32 iCost = 0;
+        };
+
+    TArcIterator ArcIterator(uint32 aArc,bool aOutgoing) const { return TArcIterator(*this,aArc,aOutgoing); }
+
+    private:
+    static constexpr uint32 KFileSignature = 0x43545447; // "CTTG"
+    static constexpr uint32 KFileVersion = 1;
+    static constexpr size_t KHeaderSize = 6; // signature, version, node count, arc count, prohibited turn count, stream size
+    static constexpr uint32 KBlockSize = 64; // the number of arcs for which the start node is stored, to speed up StartNode
+    static constexpr int KStraightAngle = 21; // about 30 degrees
+    static constexpr int KUTurnAngle = 117; // about 165 degrees
+
+    class TProhibitedTurn
+        {
+        public:
+        bool operator<(const TProhibitedTurn& aOther) const
+            { return iFromArc < aOther.iFromArc || (iFromArc == aOther.iFromArc && iToArc < aOther.iToArc); }
+
+        uint32 iFromArc;
+        uint32 iToArc;
+        };
+
+    class TArcRecord
+        {
+        public:
+        uint32 iEndNode = 0;
+        uint32 iCost = 0;
+        uint8 iStartBearing = 0;
+        uint8 iEndBearing = 0;
+        bool iRestricted = false;
+        };
+
+    static uint64 ZigZag(int64 aValue) { return (uint64(aValue) << 1) ^ uint64(aValue >> 63); }
+    static int64 UnZigZag(uint64 aValue) { return int64(aValue >> 1) ^ -int64(aValue & 1); }
+
+    static void WriteVarint(std::vector<uint8>& aStream,uint64 aValue)
+        {
+        while (aValue >= 0x80)
+            {
+            aStream.push_back(uint8(aValue | 0x80));
+            aValue >>= 7;
+            }
+        aStream.push_back(uint8(aValue));
+        }
+
+    static uint64 ReadVarint(const uint8*& aData)
+        {
+        uint64 value = *aData++;
+        if (value < 0x80)
+            return value;
+        value &= 0x7F;
+        for (int shift = 7; ; shift += 7)
+            {
+            const uint8 b = *aData++;
+            value |= uint64(b & 0x7F) << shift;
+            if (b < 0x80)
+                return value;
+            }
+        }
+
+    static void SkipVarint(const uint8*& aData)
+        {
+        while (*aData++ & 0x80)
+            { }
+        }
+
+    static void SkipArc(const uint8*& aData)
+        {
+        SkipVarint(aData);
+        SkipVarint(aData);
+        aData += 2;
+        }
+
+    // The number of entries in the table of block start nodes: one for each block and one for the last arc.
+    static size_t BlockCount(uint32 aArcCount) { return (size_t(aArcCount) + KBlockSize - 1) / KBlockSize + 1; }
+
+    // Decode an arc's record and return its start node.
+    uint32 DecodeArc(uint32 aArc,TArcRecord& aRecord) const
+        {
+        const uint32 start_node = StartNode(aArc);
+        const uint8* p = iStream + iOffset[start_node];
+        for (uint32 i = iFirstArc[start_node]; i < aArc; i++)
+            SkipArc(p);
+        const uint64 v = ReadVarint(p);
+        aRecord.iEndNode = uint32(int64(start_node) + UnZigZag(v >> 1));
+        aRecord.iRestricted = (v & 1) != 0;
+        aRecord.iCost = uint32(ReadVarint(p));
+        aRecord.iStartBearing = p[0];
+        aRecord.iEndBearing = p[1];
+        return start_node;
+        }
+
+    static size_t DataSize(const uint32* aData)
+        {
+        return (KHeaderSize + (size_t(aData[2]) + 1) * 2 + BlockCount(aData[3]) + size_t(aData[4]) * 2 + (size_t(aData[5]) + 3) / 4) * sizeof(uint32);
+        }
+
+    void SetData(const uint32* aData)
+        {
+        iData = aData;
+        iNodeCount = aData[2];
+        iArcCount = aData[3];
+        iProhibitedCount = aData[4];
+        iFirstArc = aData + KHeaderSize;
+        iOffset = iFirstArc + iNodeCount + 1;
+        iBlockNode = iOffset + iNodeCount + 1;
+        iProhibited = reinterpret_cast<const TProhibitedTurn*>(iBlockNode + BlockCount(iArcCount));
+        iStream = reinterpret_cast<const uint8*>(iProhibited + iProhibitedCount);
+        }
+
+    std::vector<uint32> iOwnedData;
+    const uint32* iData = nullptr;
+    const uint32* iFirstArc = nullptr;
+    const uint32* iOffset = nullptr;
+    const uint32* iBlockNode = nullptr;
+    const TProhibitedTurn* iProhibited = nullptr;
+    const uint8* iStream = nullptr;
+    uint32 iNodeCount = 0;
+    uint32 iArcCount = 0;
+    uint32 iProhibitedCount = 0;
+    TTurnCosts iTurnCosts;
+    };
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ALTERNATIVE_ROUTES_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Finds alternative routes between random points of a grid with CalculateAlternativeRoutes and compares the time
+with that of a single bidirectional search. The first route must cost the same as the reference search,
+every route must be a real path whose arcs add up to its cost, within the stretch limit, and no route may be returned twice,
+even when the sharing limit allows any overlap.
+
+g++ -std=c++14 -O2 -I../../main/base alternative_routes_benchmark.cpp -o alternative_routes_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cstdio>
+#include <set>
+
+using namespace CartoType;
+
+using TGraph = CSearchGraph<CBenchmarkGraph>;
+using TNode = TGraph::TNode;
+
+int main()
+    {
+    const uint32 width = 300;
+    const uint32 node_count = width * width;
+    const double max_stretch = 1.25;
+    CBenchmarkGraph graph = CBenchmarkGraph::Grid(width,width,50,100,7);
+    TGraph search_graph(graph);
+    std::mt19937 random(7);
+
+    const int query_count = 20;
+    size_t route_count = 0;
+    size_t mismatch_count = 0;
+    double alternative_time = 0;
+    double single_time = 0;
+    for (int q = 0; q < query_count; q++)
+        {
+        uint32 start = random() % node_count;
+        uint32 end = random() % node_count;
+        uint32 best_cost = ReferenceCosts(graph,start)[end];
+
+        // A sharing limit of 1 on alternate queries checks that the best route is not returned again.
+        double max_sharing = q % 2 ? 1.0 : 0.6;
+        std::vector<CAlternativeRoute> route;
+        CStopwatch stopwatch;
+        TResult error = CalculateAlternativeRoutes(search_graph,start,end,3,max_stretch,max_sharing,0.1,route);
+        alternative_time += stopwatch.Seconds();
+
+        stopwatch.Restart();
+        const TNode* middle = nullptr;
+        search_graph.Reset();
+        TDijkstra<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>>::CalculateRoutesBidirectionally(search_graph,search_graph.Node(start,true),search_graph.Node(end,false),middle);
+        single_time += stopwatch.Seconds();
+
+        if (error || route.empty() || route[0].iCost != best_cost)
+            mismatch_count++;
+        std::set<std::vector<uint32>> distinct;
+        for (const auto& r : route)
+            {
+            uint64 cost = 0;
+            bool valid = r.iNode.front() == start && r.iNode.back() == end;
+            for (size_t i = 1; i < r.iNode.size() && valid; i++)
+                {
+                uint32 arc_cost = graph.ArcCost(r.iNode[i - 1],r.iNode[i]);
+                valid = arc_cost != UINT32_MAX;
+                cost += arc_cost;
+                }
+            if (!valid || cost != r.iCost || r.iCost > best_cost * max_stretch + 1 || !distinct.insert(r.iNode).second)
+                mismatch_count++;
+            }
+        route_count += route.size();
+        if (q < 6)
+            {
+            printf("query %d, sharing %.1f, best cost %u:",q,max_sharing,best_cost);
+            for (const auto& r : route)
+                printf(" [cost %u plateau %u shared %u]",r.iCost,r.iPlateauCost,r.iSharedCost);
+            printf("\n");
+            }
+        }
+
+    printf("%.2f routes per query; alternatives %.4fs per query, single bidirectional search %.4fs per query; %zu mismatches\n",
+           double(route_count) / query_count,alternative_time / query_count,single_time / query_count,mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
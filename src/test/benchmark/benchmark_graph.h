@@ -0,0 +1,237 @@
+/*
+BENCHMARK_GRAPH.H
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Synthetic graphs and a reference search used by the routing tests and benchmarks.
+*/
+
+#ifndef BENCHMARK_GRAPH_H__
+#define BENCHMARK_GRAPH_H__
+
+#include <cartotype_graph.h>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+
+namespace CartoType
+{
+
+/**
+A static graph for CSearchGraph, stored as arrays of arcs with lists of the arcs leaving and entering each node.
+Arc references are the arc numbers plus one, so that zero is null.
+*/
+class CBenchmarkGraph
+    {
+    public:
+    using TArcRef = uint32;
+
+    explicit CBenchmarkGraph(uint32 aNodeCount):
+        iOut(aNodeCount),
+        iIn(aNodeCount)
+        {
+        }
+
+    /** Create a graph with aArcsPerNode arcs from each node to random nodes, with costs from 0 to aMaxCost - 1. */
+    static CBenchmarkGraph Random(uint32 aNodeCount,uint32 aArcsPerNode,uint32 aMaxCost,uint32 aSeed)
+        {
+        CBenchmarkGraph graph(aNodeCount);
+        std::mt19937 random(aSeed);
+        for (uint32 i = 0; i < aNodeCount; i++)
+            for (uint32 k = 0; k < aArcsPerNode; k++)
+                {
+                uint32 end = random() % aNodeCount;
+                graph.AddArc(i,end,random() % aMaxCost);
+                }
+        return graph;
+        }
+
+    /**
+    Create a grid of aWidth by aHeight nodes, numbered row by row, joined to their neighbours by arcs in both directions
+    with independent random costs from aMinCost to aMinCost + aCostRange - 1.
+    */
+    static CBenchmarkGraph Grid(uint32 aWidth,uint32 aHeight,uint32 aMinCost,uint32 aCostRange,uint32 aSeed)
+        {
+        CBenchmarkGraph graph(aWidth * aHeight);
+        std::mt19937 random(aSeed);
+        for (uint32 y = 0; y < aHeight; y++)
+            for (uint32 x = 0; x < aWidth; x++)
+                {
+                uint32 i = y * aWidth + x;
+                if (x + 1 < aWidth)
+                    graph.AddTwoWayArc(i,i + 1,aMinCost + random() % aCostRange,aMinCost + random() % aCostRange);
+                if (y + 1 < aHeight)
+                    graph.AddTwoWayArc(i,i + aWidth,aMinCost + random() % aCostRange,aMinCost + random() % aCostRange);
+                }
+        return graph;
+        }
+
+    /** Add an arc and return its reference. */
+    TArcRef AddArc(uint32 aStart,uint32 aEnd,uint32 aCost)
+        {
+        iStart.push_back(aStart);
+        iEnd.push_back(aEnd);
+        iCost.push_back(aCost);
+        uint32 arc = uint32(iCost.size() - 1);
+        iOut[aStart].push_back(arc);
+        iIn[aEnd].push_back(arc);
+        return arc + 1;
+        }
+
+    void AddTwoWayArc(uint32 aNode1,uint32 aNode2,uint32 aCost12,uint32 aCost21)
+        {
+        AddArc(aNode1,aNode2,aCost12);
+        AddArc(aNode2,aNode1,aCost21);
+        }
+
+    size_t NodeCount() const { return iOut.size(); }
+    size_t ArcCount() const { return iCost.size(); }
+    uint32 ArcStart(TArcRef aArc) const { return iStart[aArc - 1]; }
+    uint32 ArcEnd(TArcRef aArc) const { return iEnd[aArc - 1]; }
+    uint32 ArcCost(TArcRef aArc) const { return iCost[aArc - 1]; }
+    void SetArcCost(TArcRef aArc,uint32 aCost) { iCost[aArc - 1] = aCost; }
+
+    /** Return the lowest cost of an arc from aStart to aEnd, or UINT32_MAX if there is none. */
+    uint32 ArcCost(uint32 aStart,uint32 aEnd) const
+        {
+        uint32 cost = UINT32_MAX;
+        for (uint32 arc : iOut[aStart])
+            if (iEnd[arc] == aEnd && iCost[arc] < cost)
+                cost = iCost[arc];
+        return cost;
+        }
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(const CBenchmarkGraph& aGraph,const std::vector<uint32>& aArc,bool aOutgoing):
+            iGraph(aGraph),
+            iArc(aArc),
+            iOutgoing(aOutgoing)
+            {
+            }
+
+        bool Next(TResult& /*aError*/) { return ++iIndex < iArc.size(); }
+        TArcRef Arc() const { return iArc[iIndex] + 1; }
+        uint32 Cost() const { return iGraph.iCost[iArc[iIndex]]; }
+        uint32 EndNodeIndex() const { return iOutgoing ? iGraph.iEnd[iArc[iIndex]] : iGraph.iStart[iArc[iIndex]]; }
+
+        private:
+        const CBenchmarkGraph& iGraph;
+        const std::vector<uint32>& iArc;
+        bool iOutgoing;
+        size_t iIndex = SIZE_MAX;
+        };
+
+    TArcIterator ArcIterator(uint32 aNodeIndex,bool aOutgoing) const
+        {
+        return TArcIterator(*this,aOutgoing ? iOut[aNodeIndex] : iIn[aNodeIndex],aOutgoing);
+        }
+
+    private:
+    std::vector<uint32> iStart;
+    std::vector<uint32> iEnd;
+    std::vector<uint32> iCost;
+    std::vector<std::vector<uint32>> iOut;
+    std::vector<std::vector<uint32>> iIn;
+    };
+
+/**
+Calculate the costs from aStart to every node of aGraph, or from every node to aStart if aForwards is false,
+using a plain binary-heap Dijkstra search independent of TDijkstra. Unreachable nodes have the cost UINT32_MAX.
+*/
+template<class TStaticGraph> std::vector<uint32> ReferenceCosts(const TStaticGraph& aGraph,uint32 aStart,bool aForwards = true)
+    {
+    std::vector<uint32> cost(aGraph.NodeCount(),UINT32_MAX);
+    using TEntry = std::pair<uint64,uint32>;
+    std::priority_queue<TEntry,std::vector<TEntry>,std::greater<TEntry>> queue;
+    cost[aStart] = 0;
+    queue.emplace(0,aStart);
+    while (!queue.empty())
+        {
+        TEntry e = queue.top();
+        queue.pop();
+        if (e.first != cost[e.second])
+            continue;
+        auto iter = aGraph.ArcIterator(e.second,aForwards);
+        TResult error = 0;
+        while (iter.Next(error))
+            {
+            uint64 c = e.first + iter.Cost();
+            uint32 end = iter.EndNodeIndex();
+            if (c < cost[end])
+                {
+                cost[end] = uint32(c);
+                queue.emplace(c,end);
+                }
+            }
+        }
+    return cost;
+    }
+
+/**
+Return a nested dissection order for a grid of aWidth by aHeight nodes, numbered row by row:
+the rank of each node, with separator rows and columns ranked above the parts they separate.
+This is the kind of order a customizable contraction hierarchy needs to stay small.
+*/
+inline std::vector<uint32> NestedDissectionOrder(uint32 aWidth,uint32 aHeight)
+    {
+    std::vector<uint32> rank(size_t(aWidth) * aHeight);
+    uint32 next = uint32(rank.size());
+    std::function<void(uint32,uint32,uint32,uint32)> dissect = [&](uint32 aX0,uint32 aX1,uint32 aY0,uint32 aY1)
+        {
+        if (aX1 <= aX0 || aY1 <= aY0)
+            return;
+        if ((aX1 - aX0) * (aY1 - aY0) <= 4)
+            {
+            for (uint32 y = aY0; y < aY1; y++)
+                for (uint32 x = aX0; x < aX1; x++)
+                    rank[y * aWidth + x] = --next;
+            }
+        else if (aX1 - aX0 >= aY1 - aY0)
+            {
+            uint32 m = (aX0 + aX1) / 2;
+            for (uint32 y = aY0; y < aY1; y++)
+                rank[y * aWidth + m] = --next;
+            dissect(aX0,m,aY0,aY1);
+            dissect(m + 1,aX1,aY0,aY1);
+            }
+        else
+            {
+            uint32 m = (aY0 + aY1) / 2;
+            for (uint32 x = aX0; x < aX1; x++)
+                rank[m * aWidth + x] = --next;
+            dissect(aX0,aX1,aY0,m);
+            dissect(aX0,aX1,m + 1,aY1);
+            }
+        };
+    dissect(0,aWidth,0,aHeight);
+    return rank;
+    }
+
+/** Return a copy of aGraph with its nodes renumbered: node N becomes node aNewIndex[N]. */
+inline CBenchmarkGraph RenumberNodes(const CBenchmarkGraph& aGraph,const std::vector<uint32>& aNewIndex)
+    {
+    CBenchmarkGraph graph(uint32(aGraph.NodeCount()));
+    for (uint32 arc = 1; arc <= aGraph.ArcCount(); arc++)
+        graph.AddArc(aNewIndex[aGraph.ArcStart(arc)],aNewIndex[aGraph.ArcEnd(arc)],aGraph.ArcCost(arc));
+    return graph;
+    }
+
+/** A stopwatch for timing benchmarks. */
+class CStopwatch
+    {
+    public:
+    CStopwatch(): iStart(std::chrono::steady_clock::now()) { }
+    void Restart() { iStart = std::chrono::steady_clock::now(); }
+    double Seconds() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - iStart).count(); }
+
+    private:
+    std::chrono::steady_clock::time_point iStart;
+    };
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+CACHE_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks an LRU CHashCache against a reference model over 200,000 random finds and adds of items of mixed sizes:
+the same items must be found, and the item count and total size must agree after every operation. Then compares the hit rates
+of the three eviction policies on a skewed workload, which must never exceed the maximum size, checks that a sharded cache
+shared by four threads always returns the right items, and compares the time taken by CCache and CHashCache.
+
+Link with the CartoType library, which supplies the list functions used by CCache:
+
+g++ -std=c++14 -O2 -pthread -I../../main/base cache_test.cpp -lcartotype -o cache_test
+*/
+
+#include <cartotype_cache.h>
+#include "benchmark_graph.h"
+#include <atomic>
+#include <cstdio>
+#include <list>
+#include <thread>
+
+using namespace CartoType;
+
+class TItem
+    {
+    public:
+    int Key() const { return iKey; }
+    int Size() const { return iSize; }
+
+    int iKey;
+    int iSize;
+    };
+
+template<class TCache> static double FindOrAddTime(TCache& aCache)
+    {
+    std::mt19937 random(3);
+    CStopwatch stopwatch;
+    for (int i = 0; i < 200000; i++)
+        {
+        const int key = random() % 3000;
+        if (!aCache.Find(key))
+            aCache.Add(new TItem { key,1 });
+        }
+    return stopwatch.Seconds();
+    }
+
+int main()
+    {
+    size_t mismatch_count = 0;
+    std::mt19937 random(1);
+    CHashCache<TItem,int> cache(1000);
+    std::list<TItem> reference;
+    size_t reference_size = 0;
+    for (int op = 0; op < 200000; op++)
+        {
+        const int key = random() % 300;
+        auto iter = std::find_if(reference.begin(),reference.end(),[key](const TItem& aItem) { return aItem.iKey == key; });
+        if (random() % 2)
+            {
+            if ((cache.Find(key) != nullptr) != (iter != reference.end()))
+                mismatch_count++;
+            if (iter != reference.end())
+                reference.splice(reference.begin(),reference,iter);
+            }
+        else
+            {
+            const int size = 1 + random() % 50;
+            cache.Add(new TItem { key,size });
+            if (iter != reference.end())
+                {
+                reference_size -= iter->iSize;
+                reference.erase(iter);
+                }
+            while (reference_size + size > 1000 && !reference.empty())
+                {
+                reference_size -= reference.back().iSize;
+                reference.pop_back();
+                }
+            reference.push_front(TItem { key,size });
+            reference_size += size;
+            }
+        const TCacheCounters counters = cache.Counters();
+        if (counters.iSize != reference_size || counters.iItemCount != reference.size())
+            mismatch_count++;
+        }
+    TCacheCounters counters = cache.Counters();
+    printf("LRU: hit rate %.3f, %zu items, size %zu, %zu evictions\n",counters.HitRate(),counters.iItemCount,counters.iSize,counters.iEvictionCount);
+
+    // Keys with an exponential distribution and sizes from 1 to 200.
+    for (TCachePolicy policy : { TCachePolicy::LRU,TCachePolicy::Clock,TCachePolicy::GDSF })
+        {
+        const char* name[] = { "LRU", "CLOCK", "GDSF" };
+        CHashCache<TItem,int> policy_cache(20000,policy);
+        std::mt19937 policy_random(2);
+        std::exponential_distribution<double> distribution(0.002);
+        size_t oversize_count = 0;
+        for (int i = 0; i < 500000; i++)
+            {
+            const int key = int(distribution(policy_random));
+            if (!policy_cache.Find(key))
+                policy_cache.Add(new TItem { key,1 + (key * 7919) % 200 });
+            if (policy_cache.Counters().iSize > 20000)
+                oversize_count++;
+            }
+        counters = policy_cache.Counters();
+        printf("%s: hit rate %.3f, %zu items, size %zu\n",name[int(policy)],counters.HitRate(),counters.iItemCount,counters.iSize);
+        mismatch_count += oversize_count;
+        }
+
+    for (size_t shard_count : { 1,16 })
+        {
+        CHashCache<TItem,int> shared_cache(100000,TCachePolicy::LRU,shard_count);
+        std::atomic<size_t> wrong_count(0);
+        CStopwatch stopwatch;
+        std::vector<std::thread> thread;
+        for (int t = 0; t < 4; t++)
+            thread.emplace_back([&shared_cache,&wrong_count,t]
+                {
+                std::mt19937 thread_random(t);
+                for (int i = 0; i < 200000; i++)
+                    {
+                    const int key = thread_random() % 5000;
+                    std::shared_ptr<TItem> item = shared_cache.FindShared(key);
+                    if (!item)
+                        shared_cache.Add(std::make_shared<TItem>(TItem { key,10 }));
+                    else if (item->iKey != key)
+                        wrong_count++;
+                    }
+                });
+        for (auto& t : thread)
+            t.join();
+        counters = shared_cache.Counters();
+        printf("%zu shards, 4 threads: hit rate %.3f, %zu items, %.3fs\n",shard_count,counters.HitRate(),counters.iItemCount,stopwatch.Seconds());
+        mismatch_count += wrong_count;
+        }
+
+    CCache<TItem,int> list_cache(2000);
+    CHashCache<TItem,int> hash_cache(2000);
+    const double list_time = FindOrAddTime(list_cache);
+    const double hash_time = FindOrAddTime(hash_cache);
+    printf("200000 finds in a cache of 2000 items: CCache %.3fs, CHashCache %.3fs (%.1fx faster)\n",list_time,hash_time,list_time / hash_time);
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,101 @@
+/*
+CCH_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks a customizable contraction hierarchy built on a grid with random asymmetric costs, ordered by
+CCustomizableContractionHierarchy::NodeOrder from the positions of the nodes: customization on one and four threads must agree,
+and bidirectional queries and their unpacked paths must cost the same as plain Dijkstra searches on the original graph.
+The sizes of the hierarchies made using NodeOrder and using a nested dissection order made for the grid are reported.
+
+g++ -std=c++14 -O2 -pthread -I../../main/base cch_test.cpp -o cch_test
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_contraction_hierarchy.h>
+#include <cstdio>
+
+using namespace CartoType;
+
+int main()
+    {
+    const uint32 width = 60;
+    const uint32 node_count = width * width;
+    const CBenchmarkGraph grid = CBenchmarkGraph::Grid(width,width,1,100,5);
+    std::vector<TPoint> position;
+    for (uint32 v = 0; v < node_count; v++)
+        position.emplace_back(int32(v % width),int32(v / width));
+    std::vector<std::pair<uint32,uint32>> grid_edge;
+    for (uint32 arc = 1; arc <= grid.ArcCount(); arc++)
+        grid_edge.emplace_back(grid.ArcStart(arc),grid.ArcEnd(arc));
+    CStopwatch stopwatch;
+    const std::vector<uint32> rank = CCustomizableContractionHierarchy::NodeOrder(position,grid_edge);
+    const double order_time = stopwatch.Seconds();
+    CBenchmarkGraph graph = RenumberNodes(grid,rank);
+
+    std::vector<std::pair<uint32,uint32>> edge;
+    for (uint32 arc = 1; arc <= graph.ArcCount(); arc++)
+        edge.emplace_back(graph.ArcStart(arc),graph.ArcEnd(arc));
+    stopwatch.Restart();
+    CCustomizableContractionHierarchy hierarchy(node_count,edge);
+    double build_time = stopwatch.Seconds();
+
+    const CBenchmarkGraph grid_ordered = RenumberNodes(grid,NestedDissectionOrder(width,width));
+    edge.clear();
+    for (uint32 arc = 1; arc <= grid_ordered.ArcCount(); arc++)
+        edge.emplace_back(grid_ordered.ArcStart(arc),grid_ordered.ArcEnd(arc));
+    const uint32 grid_order_arc_count = CCustomizableContractionHierarchy(node_count,edge).ArcCount();
+
+    CContractionHierarchyMetric metric1;
+    metric1.Init(hierarchy.ArcCount());
+    for (uint32 arc = 1; arc <= graph.ArcCount(); arc++)
+        hierarchy.SetArcCost(metric1,graph.ArcStart(arc),graph.ArcEnd(arc),graph.ArcCost(arc));
+    CContractionHierarchyMetric metric4 = metric1;
+    stopwatch.Restart();
+    hierarchy.Customize(metric1,1);
+    double customize_time = stopwatch.Seconds();
+    hierarchy.Customize(metric4,4);
+    bool same_metric = metric1.iUpCost == metric4.iUpCost && metric1.iDownCost == metric4.iDownCost;
+
+    using TGraph = CSearchGraph<TContractionHierarchyGraph>;
+    using TNode = TGraph::TNode;
+    TContractionHierarchyGraph hierarchy_graph(hierarchy,metric4);
+    TGraph search_graph(hierarchy_graph);
+    std::mt19937 random(5);
+    size_t cost_mismatch_count = 0, path_mismatch_count = 0;
+    const int query_count = 200;
+    for (int i = 0; i < query_count; i++)
+        {
+        uint32 start = random() % node_count;
+        uint32 end = random() % node_count;
+        uint32 expected = ReferenceCosts(graph,start)[end];
+
+        const TNode* middle = nullptr;
+        TDijkstra<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>>::CalculateRoutesBidirectionally(search_graph,search_graph.Node(start,true),search_graph.Node(end,false),middle);
+        uint32 m = search_graph.NodeIndex(middle);
+        uint32 cost = search_graph.NodeCostInQuery(search_graph.Node(m,true),true) + search_graph.NodeCostInQuery(search_graph.Node(m,true),false);
+        if (cost != expected)
+            cost_mismatch_count++;
+
+        // Unpack the upward path from the start to the middle node, then the downward path to the end.
+        std::vector<uint32> up;
+        for (uint32 v = m; v != UINT32_MAX; v = search_graph.PreviousNodeIndex(search_graph.Node(v,true)))
+            up.push_back(v);
+        std::reverse(up.begin(),up.end());
+        std::vector<uint32> path { start };
+        for (size_t k = 1; k < up.size(); k++)
+            hierarchy.Unpack(metric4,up[k - 1],up[k],path);
+        for (uint32 v = m, w; (w = search_graph.PreviousNodeIndex(search_graph.Node(v,false))) != UINT32_MAX; v = w)
+            hierarchy.Unpack(metric4,v,w,path);
+        uint64 path_cost = 0;
+        for (size_t k = 1; k < path.size(); k++)
+            path_cost += graph.ArcCost(path[k - 1],path[k]);
+        if (path.back() != end || path_cost != expected)
+            path_mismatch_count++;
+        }
+
+    printf("%u nodes, %u hierarchy arcs (%u using the grid order): ordered in %.3fs, built in %.3fs, customized in %.3fs; 1 and 4 thread metrics %s\n",
+           node_count,hierarchy.ArcCount(),grid_order_arc_count,order_time,build_time,customize_time,same_metric ? "identical" : "DIFFER");
+    printf("%d queries: %zu cost mismatches, %zu path mismatches\n",query_count,cost_mismatch_count,path_mismatch_count);
+    return same_metric && !cost_mismatch_count && !path_mismatch_count ? 0 : 1;
+    }
@@ -0,0 +1,232 @@
+/*
+DISK_TILE_CACHE_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks CDiskTileCache: tiles added must be found with the same data, including a tile added again, and must be found again
+after the file is reopened. A file whose last record is truncated must lose only that record, and the next tile added must
+overwrite it. Compaction must keep the most recently used tiles, and a failed compaction must not lose the file or fail the Add.
+The cache must return the right tiles when used by four threads.
+The style sheet hash must change when the style sheet file is edited, and the tile hash when any option affecting the tiles changes.
+If a map, font and style sheet are given, CachedTileBitmap must draw a tile the first time and take it from the cache the second time.
+
+Link with the CartoType library, which supplies CFramework and the bitmap functions:
+
+g++ -std=c++14 -O2 -pthread -I../../main/base disk_tile_cache_test.cpp -lcartotype -o disk_tile_cache_test
+disk_tile_cache_test [map.ctm1 font.ttf style.xml]
+*/
+
+#include <cartotype_disk_tile_cache.h>
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace CartoType;
+
+static TDiskTileKey Key(int32 aZoom,int32 aX,int32 aY,uint32 aMapGeneration = 1)
+    {
+    TDiskTileKey key;
+    key.iStyleHash = 0x1234567890ULL;
+    key.iMapGeneration = aMapGeneration;
+    key.iZoom = aZoom;
+    key.iX = aX;
+    key.iY = aY;
+    return key;
+    }
+
+static std::vector<uint8> Data(int32 aZoom,int32 aX,int32 aY,size_t aLength)
+    {
+    std::vector<uint8> data(aLength);
+    for (size_t i = 0; i < aLength; i++)
+        data[i] = uint8(aZoom * 31 + aX * 7 + aY * 3 + i);
+    return data;
+    }
+
+static bool WriteFile(const char* aFileName,const std::vector<uint8>& aData)
+    {
+    FILE* file = fopen(aFileName,"wb");
+    if (!file)
+        return false;
+    bool ok = aData.empty() || fwrite(aData.data(),aData.size(),1,file) == 1;
+    return fclose(file) == 0 && ok;
+    }
+
+static std::vector<uint8> ReadFile(const char* aFileName)
+    {
+    std::vector<uint8> data;
+    FILE* file = fopen(aFileName,"rb");
+    if (file)
+        {
+        uint8 buffer[4096];
+        size_t length;
+        while ((length = fread(buffer,1,sizeof(buffer),file)) > 0)
+            data.insert(data.end(),buffer,buffer + length);
+        fclose(file);
+        }
+    return data;
+    }
+
+int main(int argc,char** argv)
+    {
+    const char* file_name = "disk_tile_cache_test.ctdc";
+    std::remove(file_name);
+    size_t mismatch_count = 0;
+    TResult error = KErrorNone;
+    std::vector<uint8> data;
+    auto check = [&mismatch_count](bool aCondition,const char* aText)
+        {
+        if (!aCondition)
+            {
+            printf("failed: %s\n",aText);
+            mismatch_count++;
+            }
+        };
+
+    std::unique_ptr<CDiskTileCache> cache = CDiskTileCache::New(error,file_name,1 << 30);
+    check(!error,"create the cache");
+    if (error)
+        return 1;
+    for (int32 x = 0; x < 100; x++)
+        for (int32 y = 0; y < 10; y++)
+            {
+            const std::vector<uint8> d = Data(10,x,y,100 + x * 13 % 977);
+            check(!cache->Add(Key(10,x,y),d.data(),d.size()),"add a tile");
+            }
+    const std::vector<uint8> replacement = Data(10,5,5,55);
+    cache->Add(Key(10,5,5),replacement.data(),replacement.size());
+    check(!cache->Find(Key(10,5,5),data) && data == replacement,"find a tile added again");
+    check(cache->Find(Key(10,5,5,2),data) == KErrorNotFound,"a different map generation is not found");
+    TCacheCounters counters = cache->Counters();
+    printf("%zu tiles, %zu bytes, file size %llu\n",counters.iItemCount,counters.iSize,(unsigned long long)cache->FileSize());
+    check(counters.iItemCount == 1000,"tile count");
+
+    cache = CDiskTileCache::New(error,file_name,1 << 30);
+    size_t wrong_count = 0;
+    for (int32 x = 0; x < 100; x++)
+        for (int32 y = 0; y < 10; y++)
+            if (cache->Find(Key(10,x,y),data) || data != (x == 5 && y == 5 ? replacement : Data(10,x,y,100 + x * 13 % 977)))
+                wrong_count++;
+    counters = cache->Counters();
+    printf("reopened: %zu tiles, hit rate %.2f\n",counters.iItemCount,counters.HitRate());
+    check(!error && !wrong_count,"find every tile after reopening");
+
+    // Cut the last record short, as if the application stopped while writing it.
+    cache.reset();
+    std::vector<uint8> file_data = ReadFile(file_name);
+    file_data.resize(file_data.size() - 20);
+    check(WriteFile(file_name,file_data),"truncate the file");
+    cache = CDiskTileCache::New(error,file_name,1 << 30);
+    // The last record is the tile added again, so the earlier copy of it is found instead.
+    check(!error && cache->Counters().iItemCount == 1000 && !cache->Find(Key(10,5,5),data) && data == Data(10,5,5,100 + 5 * 13 % 977),
+          "only the truncated record is lost");
+    const std::vector<uint8> new_tile = Data(11,0,0,300);
+    cache->Add(Key(11,0,0),new_tile.data(),new_tile.size());
+    cache = CDiskTileCache::New(error,file_name,1 << 30);
+    check(!error && cache->Counters().iItemCount == 1001 && !cache->Find(Key(11,0,0),data) && data == new_tile,"a tile replaces the truncated one");
+
+    // Keep using the first 50 tiles while adding more than fit, so that they survive compaction.
+    cache.reset();
+    std::remove(file_name);
+    cache = CDiskTileCache::New(error,file_name,200000);
+    wrong_count = 0;
+    for (int32 i = 0; i < 2000; i++)
+        {
+        const std::vector<uint8> d = Data(12,i,0,500);
+        if (cache->Add(Key(12,i,0),d.data(),d.size()))
+            wrong_count++;
+        for (int32 j = 0; j < 50 && j < i; j++)
+            if (cache->Find(Key(12,j,0),data) || data != Data(12,j,0,500))
+                wrong_count++;
+        }
+    counters = cache->Counters();
+    printf("compaction: %zu tiles, %zu bytes, file size %llu, %zu evictions\n",counters.iItemCount,counters.iSize,(unsigned long long)cache->FileSize(),counters.iEvictionCount);
+    check(!wrong_count && counters.iEvictionCount && cache->FileSize() <= 200000,"the most recently used tiles survive compaction");
+
+    // A directory in the place of the temporary file makes compaction fail, but the tiles must still be added and kept.
+    const std::string temp_name = std::string(file_name) + ".tmp";
+    mkdir(temp_name.c_str(),0777);
+    wrong_count = 0;
+    for (int32 i = 0; i < 400; i++)
+        {
+        const std::vector<uint8> d = Data(12,i,1,500);
+        if (cache->Add(Key(12,i,1),d.data(),d.size()) || cache->Find(Key(12,i,1),data) || data != d)
+            wrong_count++;
+        }
+    rmdir(temp_name.c_str());
+    printf("failed compaction: %zu tiles, file size %llu\n",cache->Counters().iItemCount,(unsigned long long)cache->FileSize());
+    check(!wrong_count && cache->LastCompactionError() == KErrorIo && cache->FileSize() > 200000,"tiles are added when compaction fails");
+    const std::vector<uint8> d = Data(12,0,2,500);
+    check(!cache->Add(Key(12,0,2),d.data(),d.size()) && !cache->LastCompactionError() && cache->FileSize() <= 200000,"compaction succeeds again");
+
+    cache.reset();
+    std::remove(file_name);
+    std::shared_ptr<CDiskTileCache> shared_cache = CDiskTileCache::New(error,file_name,100000);
+    std::atomic<size_t> thread_wrong_count(0);
+    std::vector<std::thread> thread;
+    for (int t = 0; t < 4; t++)
+        thread.emplace_back([&shared_cache,&thread_wrong_count,t]
+            {
+            std::mt19937 random(t);
+            std::vector<uint8> d;
+            for (int i = 0; i < 5000; i++)
+                {
+                const int32 x = random() % 400;
+                const std::vector<uint8> expected = Data(13,x,0,700);
+                if (shared_cache->Find(Key(13,x,0),d))
+                    shared_cache->Add(Key(13,x,0),expected.data(),expected.size());
+                else if (d != expected)
+                    thread_wrong_count++;
+                }
+            });
+    for (auto& t : thread)
+        t.join();
+    counters = shared_cache->Counters();
+    printf("4 threads: hit rate %.3f, %zu tiles, %zu evictions\n",counters.HitRate(),counters.iItemCount,counters.iEvictionCount);
+    check(!thread_wrong_count,"the right tiles are found by several threads");
+    shared_cache.reset();
+    std::remove(file_name);
+
+    const char* style_file_name = "disk_tile_cache_test.xml";
+    const std::string style_text = "<CartoTypeStyleSheet background='white'/>";
+    WriteFile(style_file_name,std::vector<uint8>(style_text.begin(),style_text.end()));
+    const uint64 style_hash = CDiskTileCache::StyleSheetHash(style_file_name,"");
+    const std::string edited_style_text = "<CartoTypeStyleSheet background='black'/>";
+    WriteFile(style_file_name,std::vector<uint8>(edited_style_text.begin(),edited_style_text.end()));
+    check(CDiskTileCache::StyleSheetHash(style_file_name,"") != style_hash,"editing the style sheet file changes its hash");
+    check(CDiskTileCache::StyleSheetHash("",style_text) != CDiskTileCache::StyleSheetHash("",edited_style_text),"style sheet text is hashed");
+    std::remove(style_file_name);
+    TTileBitmapParam param;
+    const uint64 tile_hash = CDiskTileCache::TileHash(256,param);
+    size_t same_hash_count = CDiskTileCache::TileHash(512,param) == tile_hash;
+    for (bool TTileBitmapParam::* option : { &TTileBitmapParam::iDrawMapObjects,&TTileBitmapParam::iDrawLabels,&TTileBitmapParam::iDrawBackground })
+        {
+        TTileBitmapParam p;
+        p.*option = false;
+        same_hash_count += CDiskTileCache::TileHash(256,p) == tile_hash;
+        }
+    check(!same_hash_count,"every tile option changes the tile hash");
+
+    if (argc >= 4)
+        {
+        std::unique_ptr<CFramework> framework = CFramework::New(error,argv[1],argv[3],argv[2],256,256);
+        cache = CDiskTileCache::New(error,file_name,1 << 30);
+        if (error)
+            {
+            printf("cannot load the map, font or style sheet: error %d\n",int(error));
+            return 1;
+            }
+        const uint64 hash = CDiskTileCache::StyleSheetHash(argv[3],"");
+        CBitmap drawn = CachedTileBitmap(error,*framework,*cache,hash,1,256,2,1,1);
+        check(!error && cache->Counters().iMissCount == 1 && cache->Counters().iItemCount == 1,"draw a tile and add it to the cache");
+        CBitmap cached = CachedTileBitmap(error,*framework,*cache,hash,1,256,2,1,1);
+        check(!error && cache->Counters().iHitCount == 1 && cached.Width() == drawn.Width() && cached.Height() == drawn.Height(),"take a tile from the cache");
+        cache.reset();
+        std::remove(file_name);
+        }
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,58 @@
+/*
+ISOCHRONE_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Compares TDijkstra::CalculateIsochroneBands, which finds several isochrones in one search,
+with a separate CalculateIsochrone search for each limit. The nodes inside each limit must be the same.
+
+g++ -std=c++14 -O2 -I../../main/base isochrone_benchmark.cpp -o isochrone_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cstdio>
+
+using namespace CartoType;
+
+using TGraph = CSearchGraph<CBenchmarkGraph>;
+using TNode = TGraph::TNode;
+
+int main()
+    {
+    const uint32 width = 500;
+    CBenchmarkGraph graph = CBenchmarkGraph::Grid(width,width,50,100,6);
+    TGraph search_graph(graph);
+    TDijkstra<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>> dijkstra(search_graph,false,true);
+    TNode* start = search_graph.Node(width * (width / 2) + width / 2);
+    const std::vector<uint32> limit { 5000, 10000, 15000, 20000 };
+
+    // One search per limit, counting the nodes inside it.
+    std::vector<size_t> separate_count(limit.size());
+    CStopwatch stopwatch;
+    for (size_t b = 0; b < limit.size(); b++)
+        dijkstra.CalculateIsochrone(start,limit[b],[&](TNode* aNode)
+            {
+            if (search_graph.Cost(aNode) < limit[b])
+                separate_count[b]++;
+            });
+    double separate_time = stopwatch.Seconds();
+
+    // One search for all the limits; nodes in band N are inside limits N and above.
+    std::vector<size_t> band_count(limit.size() + 1);
+    stopwatch.Restart();
+    dijkstra.CalculateIsochroneBands(start,limit,[&](const TNode*,size_t aBand) { band_count[aBand]++; });
+    double band_time = stopwatch.Seconds();
+
+    size_t mismatch_count = 0;
+    size_t inside = 0;
+    for (size_t b = 0; b < limit.size(); b++)
+        {
+        inside += band_count[b];
+        printf("limit %u: %zu nodes inside; separate search %zu\n",limit[b],inside,separate_count[b]);
+        if (inside != separate_count[b])
+            mismatch_count++;
+        }
+    printf("%zu limits: separate searches %.3fs, one banded search %.3fs (%.2fx faster); %zu mismatches\n",
+           limit.size(),separate_time,band_time,separate_time / band_time,mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,110 @@
+/*
+LANDMARK_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Compares A* searches guided by a CLandmarkTable (the ALT method) with plain Dijkstra searches on a grid
+crossed by faster roads. Both must find the same costs; the numbers of settled nodes and the times are reported.
+The table is then written, attached from the written data and moved, and must give the same bounds.
+
+g++ -std=c++14 -O2 -I../../main/base landmark_benchmark.cpp -o landmark_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_landmark.h>
+#include <cstdio>
+
+using namespace CartoType;
+
+class CMemoryOutput: public MOutputStream
+    {
+    public:
+    TResult Write(const uint8* aBuffer,size_t aLength) override
+        {
+        iData.insert(iData.end(),aBuffer,aBuffer + aLength);
+        return KErrorNone;
+        }
+
+    std::vector<uint8> iData;
+    };
+
+int main()
+    {
+    const uint32 width = 300;
+    const uint32 node_count = width * width;
+    std::mt19937 random(7);
+    CBenchmarkGraph graph(node_count);
+    for (uint32 y = 0; y < width; y++)
+        for (uint32 x = 0; x < width; x++)
+            {
+            uint32 i = y * width + x;
+            uint32 cost = (y % 50 == 0 || x % 50 == 0) ? 20 : 60 + random() % 40;
+            if (x + 1 < width)
+                graph.AddTwoWayArc(i,i + 1,cost,cost);
+            if (y + 1 < width)
+                graph.AddTwoWayArc(i,i + width,cost,cost);
+            }
+
+    CLandmarkTable table;
+    CStopwatch stopwatch;
+    table.Create(graph,16);
+    printf("16 landmarks created in %.2fs\n",stopwatch.Seconds());
+
+    using TGraph = CSearchGraph<CBenchmarkGraph>;
+    using TNode = TGraph::TNode;
+    using TLandmarkSearch = CSearchGraph<TLandmarkGraph<CBenchmarkGraph>>;
+    using TLandmarkNode = TLandmarkSearch::TNode;
+    TGraph search_graph(graph);
+    const int query_count = 30;
+    size_t dijkstra_settled = 0;
+    size_t landmark_settled = 0;
+    double dijkstra_time = 0;
+    double landmark_time = 0;
+    size_t mismatch_count = 0;
+    for (int q = 0; q < query_count; q++)
+        {
+        uint32 start = random() % node_count;
+        uint32 end = random() % node_count;
+
+        stopwatch.Restart();
+        TDijkstra<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>> dijkstra(search_graph,false,true);
+        std::vector<uint32> cost;
+        dijkstra.CalculateOneToMany(search_graph.Node(start),{ search_graph.Node(end) },cost);
+        dijkstra_time += stopwatch.Seconds();
+        dijkstra_settled += dijkstra.Stats().iSettledNodes;
+
+        stopwatch.Restart();
+        TLandmarkGraph<CBenchmarkGraph> landmark_graph(graph,table,start,end);
+        TLandmarkSearch landmark_search_graph(landmark_graph);
+        TDijkstra<TLandmarkSearch,TLandmarkNode,uint32,CRadixHeapOpenSet<TLandmarkNode>> landmark_dijkstra(landmark_search_graph,false,true);
+        std::vector<uint32> landmark_cost;
+        landmark_dijkstra.CalculateOneToMany(landmark_search_graph.Node(start),{ landmark_search_graph.Node(end) },landmark_cost);
+        landmark_time += stopwatch.Seconds();
+        landmark_settled += landmark_dijkstra.Stats().iSettledNodes;
+
+        if (landmark_graph.RealCost(start,end,landmark_cost[0]) != cost[0])
+            mismatch_count++;
+        }
+    printf("settled nodes per query: Dijkstra %zu, landmarks %zu (%.1fx fewer); time %.3fs against %.3fs\n",
+           dijkstra_settled / query_count,landmark_settled / query_count,double(dijkstra_settled) / landmark_settled,dijkstra_time,landmark_time);
+
+    CMemoryOutput output;
+    table.Write(output);
+    CLandmarkTable attached;
+    TResult error = attached.Attach(output.iData.data(),output.iData.size());
+    CLandmarkTable moved(std::move(table));
+    for (int i = 0; i < 100; i++)
+        {
+        uint32 from = random() % node_count;
+        uint32 to = random() % node_count;
+        uint32 bound = moved.LowerBound(from,to);
+        if (error || attached.LowerBound(from,to) != bound || bound > ReferenceCosts(graph,from)[to])
+            {
+            mismatch_count++;
+            break;
+            }
+        }
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,135 @@
+/*
+NAVIGATOR_SESSION_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Drives CNavigatorSession objects along a straight route of ten 100-metre segments with turns, checking the events,
+states and turns after each fix: first position, turn changes, turning round, leaving the route and needing a new route.
+Ten thousand sessions sharing the route are then updated in parallel by NavigateSessions, which must give the same events
+as updating them one by one; the time per update is reported.
+
+Link with the CartoType library, which supplies CRoute and CString:
+
+g++ -std=c++14 -O2 -pthread -I../../main/base navigator_session_test.cpp -lcartotype -o navigator_session_test
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_navigator_session.h>
+#include <cstdio>
+
+using namespace CartoType;
+
+static std::shared_ptr<const CRoute> StraightRoute()
+    {
+    // Map units are metres. Segments 3, 4 and 8 start with left turns and segment 2 with an 'ahead' turn.
+    auto route = std::make_shared<CRoute>();
+    route->iPointScale = 1;
+    for (int32 k = 0; k < 10; k++)
+        {
+        std::unique_ptr<CRouteSegment> segment(new CRouteSegment);
+        segment->iDistance = 100;
+        segment->iTime = 10;
+        segment->iPath.AppendPoint(TPoint(k * 100,0));
+        segment->iPath.AppendPoint(TPoint((k + 1) * 100,0));
+        if (k == 3 || k == 4 || k == 8)
+            {
+            segment->iTurn.iTurnType = TTurnType::Left;
+            segment->iTurn.iContinue = false;
+            }
+        else if (k == 2)
+            segment->iTurn.iTurnType = TTurnType::Ahead;
+        route->iPath.AppendPoint(TPoint(k * 100,0));
+        route->iRouteSegment.push_back(std::move(segment));
+        }
+    route->iPath.AppendPoint(TPoint(1000,0));
+    route->iDistance = 1000;
+    route->iTime = 100;
+    return route;
+    }
+
+static TNavigationData Fix(double aX,double aY,double aTime)
+    {
+    TNavigationData fix;
+    fix.iValidity = TNavigationData::KPositionValid;
+    fix.iPosition = TPointFP(aX,aY);
+    fix.iTime = aTime;
+    return fix;
+    }
+
+int main()
+    {
+    using S = CNavigatorSession;
+    class TStep
+        {
+        public:
+        double iX;
+        double iY;
+        uint32 iEvents;
+        TNavigatorState iState;
+        double iFirstTurnDistance; // negative if not checked
+        };
+    const TStep step[] =
+        {
+        { 10,0,S::KPositionKnown | S::KTurnChanged,TNavigatorState::OnRoute,290 },
+        { 150,0,0,TNavigatorState::OnRoute,150 },
+        { 250,0,0,TNavigatorState::OnRoute,50 },
+        { 260,0,0,TNavigatorState::OnRoute,40 },
+        { 330,5,S::KTurnChanged,TNavigatorState::OnRoute,70 },
+        { 100,0,S::KTurnRound | S::KTurnChanged,TNavigatorState::OnRoute,200 },
+        { 100,50,0,TNavigatorState::OffRoute,-1 },
+        { 500,50,0,TNavigatorState::OffRoute,-1 },
+        { 500,50,S::KReRouteNeeded,TNavigatorState::ReRouteNeeded,-1 },
+        { 500,50,S::KReRouteNeeded,TNavigatorState::ReRouteNeeded,-1 }
+        };
+
+    std::shared_ptr<const CRoute> route = StraightRoute();
+    TNavigatorParam param;
+    CNavigatorSession session(route);
+    size_t mismatch_count = 0;
+    for (size_t i = 0; i < sizeof(step) / sizeof(step[0]); i++)
+        {
+        const TStep& s = step[i];
+        uint32 events = session.Update(Fix(s.iX,s.iY,i * 20.0),param);
+        TNavigatorTurn first = session.FirstTurn();
+        bool ok = events == s.iEvents && session.State() == s.iState && (s.iFirstTurnDistance < 0 || first.iDistance == s.iFirstTurnDistance);
+        if (i == 0)
+            ok &= first.iTurnType == TTurnType::Left && session.SecondTurn().iTurnType == TTurnType::Left && session.SecondTurn().iDistance == 100 &&
+                  session.ContinuationTurn().iTurnType == TTurnType::Ahead && session.ContinuationTurn().iDistance == 190;
+        printf("fix at (%g,%g): events %u, state %d, first turn %gm ahead%s\n",s.iX,s.iY,events,int(session.State()),first.iDistance,ok ? "" : " - wrong");
+        if (!ok)
+            mismatch_count++;
+        }
+
+    // Many vehicles following the same route, with each fix a little farther along, and every 64th vehicle off the route.
+    const size_t session_count = 10000;
+    std::vector<CNavigatorSession> parallel(session_count,CNavigatorSession(route));
+    std::vector<CNavigatorSession> serial(session_count,CNavigatorSession(route));
+    std::vector<CNavigatorSession*> parallel_ptr, serial_ptr;
+    for (size_t i = 0; i < session_count; i++)
+        {
+        parallel_ptr.push_back(&parallel[i]);
+        serial_ptr.push_back(&serial[i]);
+        }
+    double parallel_time = 0;
+    double serial_time = 0;
+    std::vector<uint32> parallel_events, serial_events;
+    for (int t = 0; t < 20; t++)
+        {
+        std::vector<TNavigationData> fix;
+        for (size_t i = 0; i < session_count; i++)
+            fix.push_back(Fix(double((i * 37 + t * 45) % 1000),i % 64 ? 0 : 60,t * 5.0));
+        CStopwatch stopwatch;
+        NavigateSessions(parallel_ptr,fix,param,parallel_events);
+        parallel_time += stopwatch.Seconds();
+        stopwatch.Restart();
+        NavigateSessions(serial_ptr,fix,param,serial_events,1);
+        serial_time += stopwatch.Seconds();
+        if (parallel_events != serial_events)
+            mismatch_count++;
+        }
+    printf("%zu sessions of %zu bytes: %.3fus per update with all threads, %.3fus with one\n",
+           session_count,sizeof(CNavigatorSession),parallel_time / (20 * session_count) * 1e6,serial_time / (20 * session_count) * 1e6);
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,116 @@
+/*
+OPEN_SET_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Compares the open sets available to TDijkstra on a synthetic graph: random arcs plus a long chain of expensive arcs,
+which drives the default unbalanced tree towards linear depth. All three must give identical costs.
+
+g++ -std=c++14 -O2 -I../../main/base open_set_benchmark.cpp -o open_set_benchmark
+*/
+
+#include <cartotype_graph.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace CartoType;
+
+class TBenchmarkNode
+    {
+    public:
+    uint32 Key() const { return iCost; }
+    static int CompareKeys(uint32 aKey1,uint32 aKey2) { return aKey1 < aKey2 ? -1 : (aKey1 > aKey2 ? 1 : 0); }
+
+    // CPointerTree links, for CTreeOpenSet
+    TBenchmarkNode* iLeft = nullptr;
+    TBenchmarkNode* iRight = nullptr;
+    TBenchmarkNode* iParent = nullptr;
+    // heap position, for CFourAryHeapOpenSet and CRadixHeapOpenSet
+    size_t iQueueIndex = KNotInOpenSet;
+
+    uint32 iCost = 0;
+    int32 iPrevArc = 0;
+    bool iClosed = false;
+    std::vector<std::pair<uint32,uint32>> iArc; // (end node, cost)
+    };
+
+class CBenchmarkGraph
+    {
+    public:
+    void Reset()
+        {
+        for (auto& n : iNode)
+            {
+            n.iCost = 0;
+            n.iPrevArc = 0;
+            n.iClosed = false;
+            n.iQueueIndex = KNotInOpenSet;
+            n.iLeft = n.iRight = n.iParent = nullptr;
+            }
+        }
+    void Set(TBenchmarkNode* aNode,uint32 aCost,int32 aPrevArc) { aNode->iCost = aCost; aNode->iPrevArc = aPrevArc; }
+    void Close(TBenchmarkNode* aNode) { aNode->iClosed = true; }
+    uint32 Cost(TBenchmarkNode* aNode) { return aNode->iCost; }
+    int32 Previous(TBenchmarkNode* aNode) { return aNode->iPrevArc; }
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(CBenchmarkGraph& aGraph,TBenchmarkNode* aNode): iGraph(aGraph), iNode(aNode) { }
+        bool Next(TResult& /*aError*/)
+            {
+            while (++iIndex < iNode->iArc.size())
+                if (!iGraph.iNode[iNode->iArc[iIndex].first].iClosed)
+                    return true;
+            return false;
+            }
+        int32 Arc() { return int32(iIndex) + 1; }
+        uint32 Cost() { return iNode->iArc[iIndex].second; }
+        TBenchmarkNode* EndNode() { return &iGraph.iNode[iNode->iArc[iIndex].first]; }
+
+        private:
+        CBenchmarkGraph& iGraph;
+        TBenchmarkNode* iNode;
+        size_t iIndex = SIZE_MAX;
+        };
+    TArcIterator ArcIterator(TBenchmarkNode* aNode,bool /*aOutgoing*/) { return TArcIterator(*this,aNode); }
+
+    std::vector<TBenchmarkNode> iNode;
+    };
+
+template<class TOpenSet> std::vector<uint32> Run(CBenchmarkGraph& aGraph,double& aSeconds)
+    {
+    TDijkstra<CBenchmarkGraph,TBenchmarkNode,int32,TOpenSet> dijkstra(aGraph,false,true);
+    auto start = std::chrono::steady_clock::now();
+    dijkstra.CalculateRoutes(&aGraph.iNode[0],INT32_MAX);
+    aSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<uint32> cost;
+    for (const auto& n : aGraph.iNode)
+        cost.push_back(n.iPrevArc || &n == &aGraph.iNode[0] ? n.iCost : UINT32_MAX);
+    return cost;
+    }
+
+int main()
+    {
+    const uint32 node_count = 200000;
+    std::mt19937 random(1);
+    CBenchmarkGraph graph;
+    graph.iNode.resize(node_count);
+    for (uint32 i = 0; i < node_count; i++)
+        for (int k = 0; k < 3; k++)
+            graph.iNode[i].iArc.emplace_back(uint32(random() % node_count),uint32(random() % 1000));
+    for (uint32 i = 0; i + 1 < node_count; i++)
+        graph.iNode[i].iArc.emplace_back(i + 1,5000);
+
+    double tree_time = 0, four_ary_time = 0, radix_time = 0;
+    auto tree_cost = Run<CTreeOpenSet<TBenchmarkNode>>(graph,tree_time);
+    auto four_ary_cost = Run<CFourAryHeapOpenSet<TBenchmarkNode>>(graph,four_ary_time);
+    auto radix_cost = Run<CRadixHeapOpenSet<TBenchmarkNode>>(graph,radix_time);
+
+    bool same = tree_cost == four_ary_cost && tree_cost == radix_cost;
+    printf("%u nodes: tree %.3fs, 4-ary heap %.3fs, radix heap %.3fs; costs %s\n",
+           node_count,tree_time,four_ary_time,radix_time,same ? "identical" : "DIFFER");
+    return same ? 0 : 1;
+    }
@@ -0,0 +1,60 @@
+/*
+REROUTE_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks TDijkstra::CalculateRouteToRetainedTree: after a bidirectional query, a re-route from a new start node
+to the same destination, reusing the backward search tree, must cost the same as a fresh search,
+and should settle fewer nodes.
+
+g++ -std=c++14 -O2 -I../../main/base reroute_test.cpp -o reroute_test
+*/
+
+#include "benchmark_graph.h"
+#include <cstdio>
+
+using namespace CartoType;
+
+using TGraph = CSearchGraph<CBenchmarkGraph>;
+using TNode = TGraph::TNode;
+using TSearch = TDijkstra<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>>;
+
+static uint32 MiddleCost(TGraph& aGraph,const TNode* aMiddle)
+    {
+    if (!aMiddle)
+        return UINT32_MAX;
+    uint32 m = aGraph.NodeIndex(aMiddle);
+    return aGraph.NodeCostInQuery(aGraph.Node(m,true),true) + aGraph.NodeCostInQuery(aGraph.Node(m,true),false);
+    }
+
+int main()
+    {
+    const uint32 node_count = 100000;
+    CBenchmarkGraph graph = CBenchmarkGraph::Random(node_count,3,1000,3);
+    std::mt19937 random(3);
+    TGraph search_graph(graph);
+    size_t mismatch_count = 0;
+    TSearchStats reroute_stats, fresh_stats;
+    const int query_count = 50;
+    for (int i = 0; i < query_count; i++)
+        {
+        uint32 start = random() % node_count;
+        uint32 end = random() % node_count;
+        uint32 new_start = random() % node_count;
+
+        const TNode* middle = nullptr;
+        TSearch::CalculateRoutesBidirectionally(search_graph,search_graph.Node(start,true),search_graph.Node(end,false),middle);
+        TSearch::CalculateRouteToRetainedTree(search_graph,search_graph.Node(new_start,true),middle,&reroute_stats);
+        uint32 reroute_cost = MiddleCost(search_graph,middle);
+
+        TSearch::CalculateRoutesBidirectionally(search_graph,search_graph.Node(new_start,true),search_graph.Node(end,false),middle,&fresh_stats);
+        uint32 fresh_cost = MiddleCost(search_graph,middle);
+        uint32 expected = ReferenceCosts(graph,new_start)[end];
+        if (reroute_cost != expected || fresh_cost != expected)
+            mismatch_count++;
+        }
+
+    printf("%d re-routes: %zu mismatches; settled nodes per re-route %zu, per fresh bidirectional search %zu\n",
+           query_count,mismatch_count,reroute_stats.iSettledNodes / query_count,fresh_stats.iSettledNodes / query_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,138 @@
+/*
+ROAD_INDEX_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Builds a CRoadSegmentIndex of a million random road segments and checks nearest-segment queries, with and without
+a heading, against a linear scan. The index is written, attached from the written data and moved, and must give the same
+results; copies with corrupted level tables must be rejected by Attach. Finally the query rate is measured.
+
+g++ -std=c++14 -O2 -I../../main/base road_index_benchmark.cpp -o road_index_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_road_index.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace CartoType;
+
+class CMemoryOutput: public MOutputStream
+    {
+    public:
+    TResult Write(const uint8* aBuffer,size_t aLength) override
+        {
+        iData.insert(iData.end(),aBuffer,aBuffer + aLength);
+        return KErrorNone;
+        }
+
+    std::vector<uint8> iData;
+    };
+
+// Return the distances of all segments within aMaxDistance of aPoint and passing the heading test, nearest first.
+static std::vector<double> ScanNearest(const std::vector<TRoadSegment>& aSegment,const TPointFP& aPoint,double aMaxDistance,double aHeading,double aMaxHeadingDifference)
+    {
+    const double pi = 3.14159265358979323846;
+    std::vector<double> distance;
+    for (const auto& s : aSegment)
+        {
+        double vx = double(s.iX1) - s.iX0, vy = double(s.iY1) - s.iY0, length2 = vx * vx + vy * vy;
+        if (aHeading >= 0 && length2 > 0)
+            {
+            double c = (vx * std::sin(aHeading * pi / 180) + vy * std::cos(aHeading * pi / 180)) / std::sqrt(length2);
+            if (!s.iOneWay)
+                c = std::abs(c);
+            if (c < std::cos(aMaxHeadingDifference * pi / 180))
+                continue;
+            }
+        double t = length2 > 0 ? ((aPoint.iX - s.iX0) * vx + (aPoint.iY - s.iY0) * vy) / length2 : 0;
+        t = std::min(std::max(t,0.0),1.0);
+        double d = std::hypot(s.iX0 + t * vx - aPoint.iX,s.iY0 + t * vy - aPoint.iY);
+        if (d <= aMaxDistance)
+            distance.push_back(d);
+        }
+    std::sort(distance.begin(),distance.end());
+    return distance;
+    }
+
+int main()
+    {
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int32> coord(0,10000000), offset(-300,300);
+    std::vector<TRoadSegment> segment;
+    for (int i = 0; i < 1000000; i++)
+        {
+        int32 x = coord(random), y = coord(random);
+        segment.push_back(TRoadSegment { x,y,x + offset(random),y + offset(random),uint32(i / 5),uint16(i % 5),uint16(i % 3 == 0) });
+        }
+    CStopwatch stopwatch;
+    CRoadSegmentIndex index;
+    index.Create(segment);
+    printf("%zu segments indexed in %.1fms\n",segment.size(),stopwatch.Seconds() * 1000);
+
+    size_t mismatch_count = 0;
+    std::vector<TRoadSegmentMatch> match;
+    for (int q = 0; q < 300; q++)
+        {
+        TPointFP point(coord(random),coord(random));
+        double heading = q % 2 ? (q * 37) % 360 : -1;
+        index.FindNearest(point,20000,match,3,heading,30);
+        std::vector<double> expected = ScanNearest(segment,point,20000,heading,30);
+        if (match.size() != std::min<size_t>(3,expected.size()))
+            mismatch_count++;
+        for (size_t i = 0; i < match.size() && i < expected.size(); i++)
+            if (std::abs(match[i].iDistance - expected[i]) > 1e-6)
+                mismatch_count++;
+        }
+
+    CMemoryOutput output;
+    index.Write(output);
+    CRoadSegmentIndex attached;
+    if (attached.Attach(output.iData.data(),output.iData.size()))
+        mismatch_count++;
+    CRoadSegmentIndex moved(std::move(index));
+    for (int q = 0; q < 100; q++)
+        {
+        TPointFP point(coord(random),coord(random));
+        std::vector<TRoadSegmentMatch> attached_match;
+        moved.FindNearest(point,1e9,match,2);
+        attached.FindNearest(point,1e9,attached_match,2);
+        if (match.size() != 2 || attached_match.size() != 2 || match[0].iSegment != attached_match[0].iSegment || match[1].iSegment != attached_match[1].iSegment)
+            mismatch_count++;
+        }
+    if (index.SegmentCount() != 0)
+        mismatch_count++;
+
+    // The level table follows the four-word header: corrupt it in ways that keep the total length right.
+    std::vector<uint32> data(output.iData.size() / sizeof(uint32));
+    std::memcpy(data.data(),output.iData.data(),output.iData.size());
+    for (int c = 0; c < 3; c++)
+        {
+        std::vector<uint32> corrupt = data;
+        if (c == 0)
+            std::swap(corrupt[5],corrupt[6]);   // non-monotonic starts
+        else if (c == 1)
+            corrupt[4] = 1;                     // first level not at zero
+        else
+            corrupt[5] += 16;                   // leaf level too big for the segment count
+        CRoadSegmentIndex bad;
+        if (bad.Attach(reinterpret_cast<const uint8*>(corrupt.data()),corrupt.size() * sizeof(uint32)) != KErrorCorrupt)
+            mismatch_count++;
+        }
+
+    const int query_count = 1000000;
+    double sum = 0;
+    stopwatch.Restart();
+    for (int q = 0; q < query_count; q++)
+        {
+        attached.FindNearest(TPointFP(coord(random),coord(random)),5000,match,1,(q * 7) % 360,45);
+        if (!match.empty())
+            sum += match[0].iDistance;
+        }
+    double seconds = stopwatch.Seconds();
+    printf("%.0f queries per second, %.2fus per query (mean distance %.1f)\n",query_count / seconds,seconds / query_count * 1e6,sum / query_count);
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
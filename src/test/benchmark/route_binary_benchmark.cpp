@@ -0,0 +1,239 @@
+/*
+ROUTE_BINARY_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Writes a route of 400 segments and 16,000 points in the compact binary format, attaches it and converts it back to a CRoute,
+which must be the same as the original, and compares the sizes and times with those of XML text of the kind found in CTROUTE
+files. The XML is only formatted and its numbers parsed, which is a lower bound on the cost of writing and reading real XML.
+Truncated data and a path whose point count is larger than the data must be rejected, and reading paths with point types
+must not allocate memory.
+
+Link with the CartoType library, which supplies CRoute, CString and the data streams:
+
+g++ -std=c++14 -O2 -I../../main/base route_binary_benchmark.cpp -lcartotype -o route_binary_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_route_binary.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+using namespace CartoType;
+
+static size_t TheAllocationCount = 0;
+
+void* operator new(size_t aSize)
+    {
+    TheAllocationCount++;
+    if (void* p = std::malloc(aSize ? aSize : 1))
+        return p;
+    throw std::bad_alloc();
+    }
+
+void operator delete(void* aPointer) noexcept
+    {
+    std::free(aPointer);
+    }
+
+void operator delete(void* aPointer,size_t) noexcept
+    {
+    std::free(aPointer);
+    }
+
+class CMemoryOutput: public MOutputStream
+    {
+    public:
+    TResult Write(const uint8* aBuffer,size_t aLength) override
+        {
+        iData.insert(iData.end(),aBuffer,aBuffer + aLength);
+        return KErrorNone;
+        }
+
+    std::vector<uint8> iData;
+    };
+
+static bool SamePath(const CContour& aA,const CContour& aB)
+    {
+    if (aA.Points() != aB.Points())
+        return false;
+    for (size_t i = 0; i < aA.Points(); i++)
+        if (!(aA.Point(i) == aB.Point(i)) || aA.Point(i).iType != aB.Point(i).iType)
+            return false;
+    return true;
+    }
+
+int main()
+    {
+    // Map units are 32nds of a metre. Every tenth segment has curved parts, so its path has point types.
+    const char* name[] = { "High Street", "Station Road", "Church Lane", "A40", "Banbury Road", "Woodstock Road" };
+    TRouteProfile profile;
+    profile.iSpeed[3] = 70;
+    profile.iUTurnTime = 123;
+    CRoute route(profile,1.0 / 32);
+    std::mt19937 random(1);
+    int32 x = 123456789, y = 987654321;
+    for (int s = 0; s < 400; s++)
+        {
+        std::unique_ptr<CRouteSegment> segment(new CRouteSegment);
+        segment->iRoadType = TRoadType(s % 7);
+        segment->iMaxSpeed = 48.28;
+        segment->iName.Set(name[s % 6]);
+        segment->iRef.Set(s % 3 ? "" : "B4495");
+        segment->iDistance = 123.456 + s;
+        segment->iTime = 10.5 + s;
+        segment->iTurnTime = 2;
+        segment->iRestricted = s == 7;
+        segment->iTurn.iTurnType = TTurnType::Left;
+        segment->iTurn.iTurnAngle = -87.125;
+        segment->iTurn.iChoices = 3;
+        segment->iTurn.iJunctionName.Set(s % 5 ? "" : "Carfax");
+        if (s)
+            segment->iPath.AppendPoint(route.iRouteSegment.back()->iPath.Point(route.iRouteSegment.back()->iPath.Points() - 1));
+        for (int i = 0; i < 40; i++)
+            {
+            x += int32(random() % 2000) - 1000;
+            y += int32(random() % 2000) - 1000;
+            TOutlinePoint point(TPoint(x,y));
+            if (s % 10 == 0 && i % 3 == 1)
+                point.iType = TPointType::Quadratic;
+            segment->iPath.AppendPointEvenIfSame(point);
+            }
+        for (const auto& p : segment->iPath)
+            route.iPath.AppendPoint(p);
+        route.iRouteSegment.push_back(std::move(segment));
+        }
+    route.iDistance = 55555.5;
+    route.iTime = 4444.4;
+    route.iPathToJunctionAfter.iPath.AppendPoint(TPoint(1,2));
+    route.iPathToJunctionAfter.iDistance = 17.25;
+    const size_t point_count = route.iPath.Points();
+
+    const int repeat_count = 200;
+    CMemoryOutput output;
+    TDataOutputStream data_output(output);
+    CStopwatch stopwatch;
+    for (int i = 0; i < repeat_count; i++)
+        {
+        output.iData.clear();
+        CBinaryRoute::Write(route,data_output);
+        }
+    const double write_time = stopwatch.Seconds() / repeat_count;
+
+    CBinaryRoute binary_route;
+    TResult error = 0;
+    stopwatch.Restart();
+    for (int i = 0; i < repeat_count && !error; i++)
+        error = binary_route.Attach(output.iData.data(),output.iData.size());
+    const double attach_time = stopwatch.Seconds() / repeat_count;
+    std::unique_ptr<CRoute> copy;
+    stopwatch.Restart();
+    for (int i = 0; i < repeat_count && !error; i++)
+        copy = binary_route.CreateRoute(error);
+    const double create_time = stopwatch.Seconds() / repeat_count;
+    printf("binary: %zu bytes (%.2f bytes per point); write %.1fus, attach %.1fus, create route %.1fus\n",
+           output.iData.size(),double(output.iData.size()) / point_count,write_time * 1e6,attach_time * 1e6,create_time * 1e6);
+
+    size_t mismatch_count = 0;
+    bool same = !error && copy->iRouteSegment.size() == route.iRouteSegment.size() && SamePath(copy->iPath,route.iPath) &&
+                copy->iDistance == route.iDistance && copy->iPointScale == route.iPointScale && copy->iProfile.iSpeed[3] == 70 &&
+                copy->iProfile.iUTurnTime == 123 && copy->iPathToJunctionAfter.iDistance == 17.25 && copy->iPathToJunctionAfter.iPath.Points() == 1;
+    for (size_t s = 0; same && s < route.iRouteSegment.size(); s++)
+        {
+        const CRouteSegment& a = *route.iRouteSegment[s];
+        const CRouteSegment& b = *copy->iRouteSegment[s];
+        same = a.iName == b.iName && a.iRef == b.iRef && a.iTurn.iJunctionName == b.iTurn.iJunctionName && a.iRoadType == b.iRoadType &&
+               a.iRestricted == b.iRestricted && std::abs(a.iDistance - b.iDistance) < 1e-3 && std::abs(a.iTime - b.iTime) < 1e-3 &&
+               b.iTurn.iTurnAngle == -87.125 && b.iTurn.iChoices == 3 && SamePath(a.iPath,b.iPath);
+        }
+    if (!same)
+        {
+        printf("the route read back differs from the original\n");
+        mismatch_count++;
+        }
+
+    // Reading the segments and their paths, including those with point types, must not allocate.
+    size_t allocation_count = TheAllocationCount;
+    TBinaryRouteSegment segment;
+    size_t typed_point_count = 0;
+    for (size_t s = 0; s < binary_route.SegmentCount(); s++)
+        {
+        binary_route.GetSegment(s,segment);
+        binary_route.GetPath(segment,[&typed_point_count](const TOutlinePoint& aPoint) { typed_point_count += aPoint.iType != TPointType::OnCurve; });
+        }
+    allocation_count = TheAllocationCount - allocation_count;
+    printf("reading all segments and paths: %zu allocations, %zu points with types\n",allocation_count,typed_point_count);
+    if (allocation_count || !typed_point_count)
+        mismatch_count++;
+
+    size_t accepted_count = 0;
+    for (size_t length = 0; length < output.iData.size(); length += 97)
+        {
+        CBinaryRoute truncated;
+        if (!truncated.Attach(output.iData.data(),length))
+            accepted_count++;
+        }
+
+    // An empty route ends with an empty route path, no strings and no segments: give the path a huge count of points with types.
+    CRoute empty_route;
+    CMemoryOutput corrupt;
+    TDataOutputStream corrupt_output(corrupt);
+    CBinaryRoute::Write(empty_route,corrupt_output);
+    corrupt.iData.resize(corrupt.iData.size() - 3);
+    corrupt_output.WriteUint((uint64(1) << 40) + 1);
+    corrupt.iData.insert(corrupt.iData.end(),{ 0,0,0,0 });
+    CBinaryRoute bad;
+    if (bad.Attach(corrupt.iData.data(),corrupt.iData.size()) != KErrorCorrupt)
+        accepted_count++;
+    printf("%zu corrupt routes accepted\n",accepted_count);
+    mismatch_count += accepted_count;
+
+    // XML text of the kind found in CTROUTE files: each point as degrees with seven decimal places, each segment with its attributes.
+    std::string xml;
+    char buffer[256];
+    stopwatch.Restart();
+    for (int i = 0; i < repeat_count; i++)
+        {
+        xml.clear();
+        for (const auto& s : route.iRouteSegment)
+            {
+            snprintf(buffer,sizeof(buffer),"<segment type='%d' maxspeed='%g' name='%s' ref='%s' distance='%g' time='%g' turnTime='%g' section='0' turnType='left' turnAngle='%g' choices='3'>\n",
+                     int(s->iRoadType),s->iMaxSpeed,s->iName.CreateUtf8String().c_str(),s->iRef.CreateUtf8String().c_str(),s->iDistance,s->iTime,s->iTurnTime,s->iTurn.iTurnAngle);
+            xml += buffer;
+            for (const auto& p : s->iPath)
+                {
+                snprintf(buffer,sizeof(buffer),"%.7f,%.7f ",p.iX / 32.0 / 111320.0,p.iY / 32.0 / 111320.0);
+                xml += buffer;
+                }
+            xml += "\n</segment>\n";
+            }
+        }
+    const double xml_write_time = stopwatch.Seconds() / repeat_count;
+    double sum = 0;
+    stopwatch.Restart();
+    for (int i = 0; i < repeat_count; i++)
+        {
+        const char* p = xml.c_str();
+        while (*p)
+            {
+            if (!isdigit(uint8(*p)) && *p != '-')
+                {
+                p++;
+                continue;
+                }
+            char* end;
+            sum += strtod(p,&end);
+            p = end > p ? end : p + 1;
+            }
+        }
+    const double xml_read_time = stopwatch.Seconds() / repeat_count;
+    printf("XML: %zu bytes (%.1fx larger); format %.1fus (%.1fx slower), parse numbers %.1fus (%.1fx slower than create route) (%g)\n",
+           xml.size(),double(xml.size()) / output.iData.size(),xml_write_time * 1e6,xml_write_time / write_time,
+           xml_read_time * 1e6,xml_read_time / create_time,sum);
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,96 @@
+/*
+ROUTE_CACHE_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks that CRouteCache keys distinguish routes differing only in an intermediate waypoint or in where a waypoint
+was snapped along its arc, that the least recently used routes are evicted first, that a CRouteCacheObserver
+clears the cache when the map data changes, and that the counters stay consistent when the cache is used from several threads.
+
+Link with the CartoType library, which supplies the CRoute constructor:
+
+g++ -std=c++14 -O2 -pthread -I../../main/base route_cache_test.cpp -lcartotype -o route_cache_test
+*/
+
+#include <cartotype_route_cache.h>
+#include <cstdio>
+#include <thread>
+
+using namespace CartoType;
+
+static TRouteCacheKey Key(std::vector<TRouteCacheWaypoint> aWaypoint)
+    {
+    TRouteCacheKey key;
+    key.iWaypoint = std::move(aWaypoint);
+    key.iProfileHash = RouteProfileHash(TRouteProfile());
+    return key;
+    }
+
+int main()
+    {
+    size_t mismatch_count = 0;
+    auto check = [&](bool aCondition,const char* aText)
+        {
+        if (!aCondition)
+            {
+            printf("failed: %s\n",aText);
+            mismatch_count++;
+            }
+        };
+
+    CRouteCache cache(1000);
+    auto route = std::make_shared<const CRoute>();
+    TRouteCacheKey a_to_b = Key({ { 1,0 },{ 2,50 } });
+    TRouteCacheKey a_via_c_to_b = Key({ { 1,0 },{ 3,10 },{ 2,50 } });
+    TRouteCacheKey a_to_b_moved = Key({ { 1,0 },{ 2,60 } });
+    cache.Add(a_to_b,route,100);
+    check(cache.Find(a_to_b) == route,"route found");
+    check(!cache.Find(a_via_c_to_b),"intermediate waypoint distinguishes routes");
+    check(!cache.Find(a_to_b_moved),"snap offset distinguishes routes");
+    TRouteCacheKey shortest = a_to_b;
+    TRouteProfile profile;
+    profile.iShortest = true;
+    shortest.iProfileHash = RouteProfileHash(profile);
+    check(!cache.Find(shortest),"profile distinguishes routes");
+
+    // Fill the cache; using a_to_b keeps it from being evicted.
+    for (uint64 i = 10; i < 19; i++)
+        {
+        cache.Add(Key({ { i,0 },{ i + 100,0 } }),std::make_shared<const CRoute>(),100);
+        cache.Find(a_to_b);
+        }
+    cache.Add(Key({ { 50,0 },{ 150,0 } }),std::make_shared<const CRoute>(),100);
+    check(cache.Find(a_to_b) == route,"recently used route kept");
+    check(!cache.Find(Key({ { 10,0 },{ 110,0 } })),"least recently used route evicted");
+    TRouteCacheCounters counters = cache.Counters();
+    check(counters.iRouteCount == 10 && counters.iBytes == 1000 && counters.iEvictionCount == 1,"counters after eviction");
+
+    CRouteCacheObserver observer(cache);
+    observer.OnDynamicDataChange();
+    check(cache.Find(a_to_b) == route,"dynamic data changes keep routes");
+    observer.OnMainDataChange();
+    check(!cache.Find(a_to_b) && cache.Counters().iRouteCount == 0 && cache.Counters().iInvalidationCount == 1,"map data changes clear the cache");
+
+    // Several threads adding and finding overlapping routes.
+    CRouteCache shared_cache(50 * 100);
+    std::vector<std::thread> thread;
+    for (uint64 t = 0; t < 8; t++)
+        thread.emplace_back([&shared_cache,t]
+            {
+            for (uint64 i = 0; i < 20000; i++)
+                {
+                TRouteCacheKey key = Key({ { (i * 7 + t) % 200,int32(i % 3) },{ 1000,0 } });
+                if (!shared_cache.Find(key))
+                    shared_cache.Add(key,std::make_shared<const CRoute>(),100);
+                }
+            });
+    for (auto& t : thread)
+        t.join();
+    counters = shared_cache.Counters();
+    printf("threads: %zu hits, %zu misses, %zu evictions, %zu routes\n",counters.iHitCount,counters.iMissCount,counters.iEvictionCount,counters.iRouteCount);
+    check(counters.iHitCount + counters.iMissCount == 8 * 20000,"every request counted");
+    check(counters.iRouteCount <= 50 && counters.iBytes == counters.iRouteCount * 100,"size limit kept");
+
+    printf("%zu failures\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
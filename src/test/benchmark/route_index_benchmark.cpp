@@ -0,0 +1,177 @@
+/*
+ROUTE_INDEX_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Builds a CRouteIndex for a winding route of a thousand kilometres, with 300,000 points in 6,000 segments, some of which
+have no path, and tracks noisy fixes along it with a cursor. Nearest points are checked against a linear scan, and distances
+and times along the route are checked against the sums of the segment distances and times, which must include the segments
+without paths. The times for tracking, for searches without a cursor and for finding points at distances are reported.
+
+Link with the CartoType library, which supplies CRoute and CString:
+
+g++ -std=c++14 -O2 -I../../main/base route_index_benchmark.cpp -lcartotype -o route_index_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_route_index.h>
+#include <cmath>
+#include <cstdio>
+
+using namespace CartoType;
+
+// Return the distance from aPoint to the nearest line of any segment of aRoute.
+static double ScanNearest(const CRoute& aRoute,const TPoint& aPoint)
+    {
+    double best = HUGE_VAL;
+    for (const auto& s : aRoute.iRouteSegment)
+        {
+        const CContour& path = s->iPath;
+        for (size_t i = 1; i < path.Points(); i++)
+            {
+            TPoint a = path.Point(i - 1), b = path.Point(i);
+            double vx = double(b.iX) - a.iX, vy = double(b.iY) - a.iY, length2 = vx * vx + vy * vy;
+            double t = length2 > 0 ? ((double(aPoint.iX) - a.iX) * vx + (double(aPoint.iY) - a.iY) * vy) / length2 : 0;
+            t = std::min(std::max(t,0.0),1.0);
+            best = std::min(best,std::hypot(a.iX + t * vx - aPoint.iX,a.iY + t * vy - aPoint.iY));
+            }
+        }
+    return best;
+    }
+
+int main()
+    {
+    // Map units are metres; points are 3.3 metres apart and there are 50 lines to a segment.
+    // Every 100th segment is a zero-length junction segment without a path, taking a second to traverse.
+    const int point_count = 300000;
+    const int lines_per_segment = 50;
+    std::mt19937 random(3);
+    std::normal_distribution<double> turn(0,0.05), noise(0,5);
+    std::vector<TPoint> point;
+    double x = 0, y = 0, heading = 0;
+    for (int i = 0; i <= point_count; i++)
+        {
+        point.push_back(TPoint(int32(x),int32(y)));
+        heading += turn(random);
+        x += 3.3 * std::cos(heading);
+        y += 3.3 * std::sin(heading);
+        }
+
+    CRoute route;
+    std::vector<double> segment_start_distance, segment_start_time;
+    for (int s = 0; s < point_count / lines_per_segment; s++)
+        {
+        if (s % 100 == 50)
+            {
+            std::unique_ptr<CRouteSegment> junction(new CRouteSegment);
+            junction->iTime = 1;
+            segment_start_distance.push_back(route.iDistance);
+            segment_start_time.push_back(route.iTime);
+            route.iTime += junction->iTime;
+            route.iRouteSegment.push_back(std::move(junction));
+            }
+        std::unique_ptr<CRouteSegment> segment(new CRouteSegment);
+        double length = 0;
+        for (int i = s * lines_per_segment; i <= (s + 1) * lines_per_segment; i++)
+            {
+            segment->iPath.AppendPointEvenIfSame(TOutlinePoint(point[i]));
+            if (i > s * lines_per_segment)
+                length += std::hypot(double(point[i].iX) - point[i - 1].iX,double(point[i].iY) - point[i - 1].iY);
+            }
+        segment->iDistance = length;
+        segment->iTime = length / 20 + 1;
+        segment->iTurnTime = 1;
+        segment_start_distance.push_back(route.iDistance);
+        segment_start_time.push_back(route.iTime);
+        route.iDistance += segment->iDistance;
+        route.iTime += segment->iTime;
+        route.iRouteSegment.push_back(std::move(segment));
+        }
+
+    CStopwatch stopwatch;
+    CRouteIndex index(route);
+    printf("%zu lines in %zu segments indexed in %.1fms; route length %.0fkm\n",
+           index.LineCount(),route.iRouteSegment.size(),stopwatch.Seconds() * 1000,route.iDistance / 1000);
+    size_t mismatch_count = index.Matches(route) ? 0 : 1;
+
+    // Fixes every 10 metres along the route, tracked with a cursor.
+    std::vector<TPoint> fix;
+    for (int i = 0; i < point_count; i += 3)
+        fix.push_back(TPoint(int32(point[i].iX + noise(random)),int32(point[i].iY + noise(random))));
+    TRouteCursor cursor;
+    TNearestSegmentInfo info;
+    std::vector<TNearestSegmentInfo> tracked;
+    stopwatch.Restart();
+    for (const auto& p : fix)
+        {
+        index.GetNearestSegment(p,info,-1,cursor);
+        tracked.push_back(info);
+        }
+    double tracking_time = stopwatch.Seconds();
+
+    // The distance and time along the route must agree with those along the segment, and the nearest line with a linear scan.
+    size_t scan_count = 0;
+    double scan_time = 0;
+    for (size_t k = 0; k < fix.size(); k++)
+        {
+        const TNearestSegmentInfo& t = tracked[k];
+        if (std::abs(t.iDistanceAlongRoute - segment_start_distance[t.iSegmentIndex] - t.iDistanceAlongSegment) > 1e-6 ||
+            std::abs(t.iTimeAlongRoute - segment_start_time[t.iSegmentIndex] - t.iTimeAlongSegment) > 1e-6)
+            mismatch_count++;
+        if (k % 100)
+            continue;
+        stopwatch.Restart();
+        double expected = ScanNearest(route,fix[k]);
+        scan_time += stopwatch.Seconds();
+        scan_count++;
+        TRouteCursor no_cursor;
+        index.GetNearestSegment(fix[k],info,-1,no_cursor);
+        if (std::abs(info.iDistanceToRoute - expected) > 1e-6 * std::max(1.0,expected))
+            mismatch_count++;
+        }
+    printf("nearest point with a cursor: %.3fus per fix; linear scan %.0fus per fix\n",tracking_time / fix.size() * 1e6,scan_time / scan_count * 1e6);
+
+    stopwatch.Restart();
+    for (const auto& p : fix)
+        {
+        TRouteCursor no_cursor;
+        index.GetNearestSegment(p,info,-1,no_cursor);
+        }
+    printf("nearest point without a cursor: %.3fus per fix\n",stopwatch.Seconds() / fix.size() * 1e6);
+
+    // Points at distances, in order with a cursor and at random without one.
+    cursor = TRouteCursor();
+    size_t step_count = 0;
+    stopwatch.Restart();
+    for (double d = 0; d < route.iDistance; d += 10, step_count++)
+        {
+        index.GetPointAtDistance(d,info,cursor);
+        if (std::abs(info.iDistanceAlongRoute - d) > 1e-6)
+            mismatch_count++;
+        }
+    printf("point at distance with a cursor: %.3fus\n",stopwatch.Seconds() / step_count * 1e6);
+    std::uniform_real_distribution<double> distance(0,route.iDistance);
+    stopwatch.Restart();
+    for (size_t i = 0; i < step_count; i++)
+        {
+        TRouteCursor no_cursor;
+        index.GetPointAtDistance(distance(random),info,no_cursor);
+        }
+    printf("point at distance without a cursor: %.3fus\n",stopwatch.Seconds() / step_count * 1e6);
+
+    // Times along the route must never decrease and must end at the route's time.
+    cursor = TRouteCursor();
+    double previous_time = 0;
+    for (double t = 0; t <= route.iTime + 10; t += 5)
+        {
+        index.GetPointAtTime(t,info,cursor);
+        if (info.iTimeAlongRoute < previous_time - 1e-9)
+            mismatch_count++;
+        previous_time = info.iTimeAlongRoute;
+        }
+    if (std::abs(previous_time - route.iTime) > 1e-6)
+        mismatch_count++;
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
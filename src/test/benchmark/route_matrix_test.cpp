@@ -0,0 +1,63 @@
+/*
+ROUTE_MATRIX_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks the many-to-many cost matrix from CalculateManyToManyCosts against separate one-to-many searches
+and a reference Dijkstra search, including duplicate and null end nodes.
+
+g++ -std=c++14 -O2 -I../../main/base route_matrix_test.cpp -o route_matrix_test
+*/
+
+#include "benchmark_graph.h"
+#include <cstdio>
+
+using namespace CartoType;
+
+using TGraph = CSearchGraph<CBenchmarkGraph>;
+using TNode = TGraph::TNode;
+
+int main()
+    {
+    const uint32 node_count = 5000;
+    CBenchmarkGraph graph(node_count);
+    std::mt19937 random(2);
+    for (uint32 i = 0; i < node_count; i++)
+        for (int k = 0; k < 2; k++)
+            {
+            uint32 j = random() % node_count;
+            uint32 cost = random() % 1000;
+            graph.AddTwoWayArc(i,j,cost,cost);
+            }
+
+    TGraph search_graph(graph);
+    std::vector<TNode*> start;
+    std::vector<TNode*> end;
+    for (int i = 0; i < 20; i++)
+        start.push_back(search_graph.Node(random() % node_count));
+    for (int i = 0; i < 30; i++)
+        end.push_back(search_graph.Node(random() % node_count));
+    end.push_back(end[3]);
+    end.push_back(nullptr);
+
+    std::vector<uint32> matrix;
+    TResult error = CalculateManyToManyCosts<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>>(search_graph,start,end,matrix);
+
+    size_t mismatch_count = 0;
+    for (size_t i = 0; !error && i < start.size(); i++)
+        {
+        TDijkstra<TGraph,TNode,uint32,CFourAryHeapOpenSet<TNode>> dijkstra(search_graph,false,true);
+        std::vector<uint32> cost;
+        error = dijkstra.CalculateOneToMany(start[i],end,cost);
+        std::vector<uint32> reference = ReferenceCosts(graph,search_graph.NodeIndex(start[i]));
+        for (size_t j = 0; j < end.size(); j++)
+            {
+            uint32 expected = end[j] ? reference[search_graph.NodeIndex(end[j])] : UINT32_MAX;
+            if (cost[j] != expected || matrix[i * end.size() + j] != expected)
+                mismatch_count++;
+            }
+        }
+
+    printf("%zu x %zu matrix: error %d, %zu mismatches\n",start.size(),end.size(),int(error),mismatch_count);
+    return error || mismatch_count ? 1 : 0;
+    }
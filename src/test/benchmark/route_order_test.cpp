@@ -0,0 +1,98 @@
+/*
+ROUTE_ORDER_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks CRouteOrderOptimizer against exhaustive search on small random cost matrices, some with unreachable pairs,
+with every combination of fixed start and end, then times it on 150 points with one thread and four threads
+and prints the first and last costs of the history.
+
+g++ -std=c++14 -O2 -pthread -I../../main/base route_order_test.cpp -o route_order_test
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_route_order.h>
+#include <cmath>
+#include <cstdio>
+
+using namespace CartoType;
+
+int main()
+    {
+    std::mt19937 random(1);
+    int mismatches = 0;
+    for (int trial = 0; trial < 200; trial++)
+        {
+        size_t n = 2 + random() % 7;
+        std::vector<uint32> cost(n * n);
+        for (auto& c : cost)
+            c = random() % 1000;
+        if (trial % 5 == 0)
+            cost[random() % (n * n)] = UINT32_MAX;
+        bool start_fixed = random() % 2 != 0;
+        bool end_fixed = random() % 2 != 0;
+        CRouteOrderOptimizer optimizer(n,cost,start_fixed,end_fixed);
+
+        // Find the best order by trying every permutation.
+        std::vector<uint32> p(n);
+        for (uint32 i = 0; i < n; i++)
+            p[i] = i;
+        uint64 best = UINT64_MAX;
+        do
+            {
+            if ((start_fixed && p[0] != 0) || (end_fixed && p[n - 1] != n - 1))
+                continue;
+            bool reachable = true;
+            for (size_t i = 1; i < n; i++)
+                if (cost[p[i - 1] * n + p[i]] == UINT32_MAX)
+                    reachable = false;
+            if (reachable)
+                best = std::min(best,optimizer.Cost(p));
+            }
+        while (std::next_permutation(p.begin(),p.end()));
+        if (best == UINT64_MAX)
+            continue;
+
+        std::vector<uint32> order;
+        uint64 found = optimizer.Optimize(order,100,2);
+        std::vector<uint32> sorted = order;
+        std::sort(sorted.begin(),sorted.end());
+        bool is_permutation = sorted.size() == n;
+        for (size_t i = 0; i < sorted.size() && is_permutation; i++)
+            is_permutation = sorted[i] == i;
+        bool ends_fixed = (!start_fixed || order[0] == 0) && (!end_fixed || order[n - 1] == n - 1);
+        if (found != best || !is_permutation || !ends_fixed || optimizer.Cost(order) != found)
+            {
+            if (mismatches++ < 5)
+                printf("%zu points, start fixed %d, end fixed %d: best %llu, found %llu\n",n,start_fixed,end_fixed,(unsigned long long)best,(unsigned long long)found);
+            }
+        }
+    printf("small matrices: %d mismatches\n",mismatches);
+
+    // Asymmetric costs between random points in a square.
+    const size_t n = 150;
+    std::vector<double> x(n), y(n);
+    for (size_t i = 0; i < n; i++)
+        {
+        x[i] = random() % 10000;
+        y[i] = random() % 10000;
+        }
+    std::vector<uint32> cost(n * n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            cost[i * n + j] = uint32(std::hypot(x[i] - x[j],y[i] - y[j]) * (1 + 0.1 * ((i + j) % 3)));
+    CRouteOrderOptimizer optimizer(n,cost,true,true);
+    for (size_t thread_count : { 1, 4 })
+        {
+        std::vector<uint32> order;
+        std::vector<uint64> history;
+        CStopwatch stopwatch;
+        uint64 found = optimizer.Optimize(order,100,thread_count,&history);
+        printf("%zu points, %zu threads: initial cost %llu, final cost %llu, %.3fs\n",
+               n,thread_count,(unsigned long long)history.front(),(unsigned long long)found,stopwatch.Seconds());
+        if (history.back() != found || optimizer.Cost(order) != found)
+            mismatches++;
+        }
+
+    return mismatches ? 1 : 0;
+    }
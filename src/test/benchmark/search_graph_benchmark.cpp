@@ -0,0 +1,87 @@
+/*
+SEARCH_GRAPH_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Runs route queries on one shared immutable graph from 1 to 32 threads, each thread using its own CSearchGraph,
+and checks the one-to-one and bidirectional results against a reference search.
+Throughput should scale with the number of cores until memory bandwidth is saturated.
+
+g++ -std=c++14 -O2 -pthread -I../../main/base search_graph_benchmark.cpp -o search_graph_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+using namespace CartoType;
+
+using TGraph = CSearchGraph<CBenchmarkGraph>;
+using TNode = TGraph::TNode;
+
+static uint32 BidirectionalCost(TGraph& aGraph,uint32 aStart,uint32 aEnd)
+    {
+    const TNode* middle = nullptr;
+    TDijkstra<TGraph,TNode,uint32,CFourAryHeapOpenSet<TNode>>::CalculateRoutesBidirectionally(aGraph,aGraph.Node(aStart,true),aGraph.Node(aEnd,false),middle);
+    if (!middle)
+        return UINT32_MAX;
+    uint32 m = aGraph.NodeIndex(middle);
+    return aGraph.NodeCostInQuery(aGraph.Node(m,true),true) + aGraph.NodeCostInQuery(aGraph.Node(m,true),false);
+    }
+
+int main()
+    {
+    const uint32 node_count = 100000;
+    const size_t query_count = 64;
+    CBenchmarkGraph graph = CBenchmarkGraph::Random(node_count,3,1000,3);
+    std::mt19937 random(3);
+    std::vector<std::pair<uint32,uint32>> query;
+    for (size_t i = 0; i < query_count; i++)
+        query.emplace_back(random() % node_count,random() % node_count);
+
+    std::vector<uint32> expected(query_count);
+    for (size_t i = 0; i < query_count; i++)
+        expected[i] = ReferenceCosts(graph,query[i].first)[query[i].second];
+
+    size_t mismatch_count = 0;
+        {
+        TGraph search_graph(graph);
+        for (size_t i = 0; i < query_count; i++)
+            if (BidirectionalCost(search_graph,query[i].first,query[i].second) != expected[i])
+                mismatch_count++;
+        }
+    printf("bidirectional: %zu mismatches in %zu queries\n",mismatch_count,query_count);
+
+    double one_thread_time = 0;
+    for (size_t thread_count = 1; thread_count <= 32; thread_count *= 2)
+        {
+        std::atomic<size_t> thread_mismatch_count(0);
+        CStopwatch stopwatch;
+        std::vector<std::thread> thread;
+        for (size_t t = 0; t < thread_count; t++)
+            thread.emplace_back([&,t]
+                {
+                TGraph search_graph(graph);
+                TDijkstra<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>> dijkstra(search_graph,false,true);
+                for (size_t i = t; i < query_count; i += thread_count)
+                    {
+                    std::vector<TNode*> end { search_graph.Node(query[i].second) };
+                    std::vector<uint32> cost;
+                    dijkstra.CalculateOneToMany(search_graph.Node(query[i].first),end,cost);
+                    if (cost[0] != expected[i])
+                        thread_mismatch_count++;
+                    }
+                });
+        for (auto& t : thread)
+            t.join();
+        double seconds = stopwatch.Seconds();
+        if (thread_count == 1)
+            one_thread_time = seconds;
+        printf("%2zu threads: %.3fs, %.1f queries/s, speedup %.2f, %zu mismatches\n",
+               thread_count,seconds,query_count / seconds,one_thread_time / seconds,thread_mismatch_count.load());
+        mismatch_count += thread_mismatch_count;
+        }
+    printf("hardware threads: %u\n",std::thread::hardware_concurrency());
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,89 @@
+/*
+SEARCH_STATS_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks the counts kept by TDijkstra in TSearchStats, and the search space reported by CSearchGraph::GetSearchSpace,
+on a 200 by 200 grid. A one-to-all search must settle every node and insert and remove each one once; it examines one arc
+of each two-way pair, because arcs to settled nodes are skipped. Its search space must give the true cost of every node.
+For bidirectional searches the search space must contain exactly the nodes removed from the open sets, the route found
+must have the true cost, and the counts must be added to those already in the caller's TSearchStats.
+
+g++ -std=c++14 -O2 -I../../main/base search_stats_test.cpp -o search_stats_test
+*/
+
+#include "benchmark_graph.h"
+#include <cstdio>
+
+using namespace CartoType;
+
+int main()
+    {
+    const uint32 width = 200;
+    CBenchmarkGraph graph = CBenchmarkGraph::Grid(width,width,1,100,1);
+    const uint32 node_count = width * width;
+    using TGraph = CSearchGraph<CBenchmarkGraph>;
+    using TNode = TGraph::TNode;
+    using TSearch = TDijkstra<TGraph,TNode,uint32,CRadixHeapOpenSet<TNode>>;
+    TGraph search_graph(graph);
+    size_t mismatch_count = 0;
+    auto check = [&mismatch_count](bool aCondition,const char* aText)
+        {
+        if (!aCondition)
+            {
+            printf("failed: %s\n",aText);
+            mismatch_count++;
+            }
+        };
+
+    TSearch dijkstra(search_graph,false,true);
+    dijkstra.CalculateSettledNodes(search_graph.Node(0),UINT32_MAX,[](const TNode*,uint32) { return true; });
+    const TSearchStats& stats = dijkstra.Stats();
+    printf("one-to-all: %zu settled, %zu arcs relaxed, %zu insertions, %zu decreases, %zu removals, peak open set %zu\n",
+           stats.iSettledNodes,stats.iRelaxedArcs,stats.iOpenSetInsertions,stats.iOpenSetDecreases,stats.iOpenSetRemovals,stats.iPeakOpenSetSize);
+    check(stats.iSettledNodes == node_count && stats.iRelaxedArcs == graph.ArcCount() / 2,"every node settled and one arc of each pair relaxed");
+    check(stats.iOpenSetInsertions == node_count && stats.iOpenSetRemovals == node_count,"every node inserted and removed once");
+    check(stats.iOpenSetDecreases <= stats.iRelaxedArcs && stats.iPeakOpenSetSize > 0 && stats.iPeakOpenSetSize < node_count,"decreases and peak open set size");
+    check(stats.OpenSetOperations() == stats.iOpenSetInsertions + stats.iOpenSetDecreases + stats.iOpenSetRemovals,"total open set operations");
+
+    std::vector<uint32> reference = ReferenceCosts(graph,0);
+    size_t space_count = 0;
+    size_t wrong_cost_count = 0;
+    search_graph.GetSearchSpace([&](uint32 aNode,uint32 aPreviousNode,uint32 aCost,bool aForwards)
+        {
+        space_count++;
+        if (!aForwards || aCost != reference[aNode] || (aPreviousNode == UINT32_MAX ? aNode != 0 : reference[aPreviousNode] > aCost))
+            wrong_cost_count++;
+        });
+    check(space_count == node_count && !wrong_cost_count,"one-to-all search space");
+
+    // Bidirectional searches between random nodes, adding to counts already present.
+    std::mt19937 random(2);
+    size_t settled_count = 0;
+    for (int q = 0; q < 50; q++)
+        {
+        const uint32 start = random() % node_count;
+        const uint32 end = random() % node_count;
+        TSearchStats total;
+        total.iSettledNodes = 1000;
+        const TNode* middle = nullptr;
+        TSearch::CalculateRoutesBidirectionally(search_graph,search_graph.Node(start,true),search_graph.Node(end,false),middle,&total);
+        total.iSettledNodes -= 1000;
+        settled_count += total.iSettledNodes;
+
+        space_count = 0;
+        search_graph.GetSearchSpace([&space_count](uint32,uint32,uint32,bool) { space_count++; });
+        TNode* m = const_cast<TNode*>(middle);
+        const uint64 cost = m ? uint64(search_graph.NodeCostInQuery(m,true)) + search_graph.NodeCostInQuery(m,false) : UINT64_MAX;
+        if (space_count != total.iOpenSetRemovals || total.iSettledNodes > total.iOpenSetRemovals ||
+            total.iOpenSetInsertions < total.iOpenSetRemovals || cost != ReferenceCosts(graph,start)[end])
+            {
+            printf("query %d from %u to %u: %zu settled, %zu removed, search space %zu nodes\n",q,start,end,total.iSettledNodes,total.iOpenSetRemovals,space_count);
+            mismatch_count++;
+            }
+        }
+    printf("bidirectional: %.1f%% of the nodes settled on average\n",settled_count * 100.0 / (50.0 * node_count));
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,114 @@
+/*
+SPEED_PROFILE_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks the cost factors of a CSpeedProfileSet at the profile points, between them and after the period wraps round,
+then checks one-to-many searches on a TTimeDependentGraph at several departure times against a reference time-dependent
+Dijkstra search. Searches on the underlying static graph must still match the plain reference search.
+
+g++ -std=c++14 -O2 -I../../main/base speed_profile_test.cpp -o speed_profile_test
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_speed_profile.h>
+#include <cstdio>
+
+using namespace CartoType;
+
+int main()
+    {
+    const uint32 hour = 3600;
+    CSpeedProfileSet profile_set(24 * hour);
+    uint32 rush = profile_set.AddProfile({ { 0,1.0 }, { 7 * hour,1.0 }, { 8 * hour,0.4 }, { 9 * hour,1.0 }, { 17 * hour,1.0 }, { 18 * hour,0.5 }, { 19 * hour,1.0 } });
+    uint32 flat = profile_set.AddProfile({ { 0,0.8 } });
+    size_t mismatch_count = 0;
+
+    // Factors are fixed point, so a speed of 0.4 slows travel by a factor of 2.5.
+    const uint32 one = profile_set.Factor(rush,0);
+    const uint32 factor[] = { profile_set.Factor(rush,7 * hour + hour / 2),profile_set.Factor(rush,8 * hour),
+                              profile_set.Factor(rush,24 * hour + 8 * hour),profile_set.Factor(flat,123) };
+    printf("rush hour factors: %u at midnight, %u at 7:30, %u at 8:00, %u at 8:00 the next day; flat profile %u\n",one,factor[0],factor[1],factor[2],factor[3]);
+    if (factor[1] != (one * 5 + 1) / 2 || factor[2] != factor[1] || factor[0] <= one || factor[0] >= factor[1] || factor[3] != (one * 5 + 2) / 4)
+        mismatch_count++;
+
+    const uint32 node_count = 3000;
+    CBenchmarkGraph graph = CBenchmarkGraph::Random(node_count,3,600,3);
+    std::mt19937 random(3);
+    std::vector<uint32> arc_profile(graph.ArcCount());
+    for (auto& p : arc_profile)
+        p = random() % 3 == 0 ? KNoSpeedProfile : (random() % 2 ? rush : flat);
+    auto profile_of = [&](uint32 aArc) { return arc_profile[aArc - 1]; };
+    using TGraph = TTimeDependentGraph<CBenchmarkGraph,decltype(profile_of)>;
+    using TSearch = CSearchGraph<TGraph>;
+    using TNode = TSearch::TNode;
+
+    for (uint32 departure_time : { 0 * hour,7 * hour,8 * hour,17 * hour + hour / 2 })
+        {
+        TGraph time_dependent_graph(graph,profile_set,profile_of,departure_time,1.0);
+        TSearch search_graph(time_dependent_graph);
+        TDijkstra<TSearch,TNode,uint32,CFourAryHeapOpenSet<TNode>> dijkstra(search_graph,false,true);
+        for (int q = 0; q < 20; q++)
+            {
+            uint32 start = random() % node_count;
+            std::vector<uint32> target_index;
+            std::vector<TNode*> target;
+            for (int k = 0; k < 5; k++)
+                {
+                target_index.push_back(random() % node_count);
+                target.push_back(search_graph.Node(target_index.back()));
+                }
+            std::vector<uint32> cost;
+            dijkstra.CalculateOneToMany(search_graph.Node(start),target,cost);
+
+            // A reference search costing each arc at the time it is entered.
+            std::vector<uint64> reference(node_count,UINT64_MAX);
+            using TEntry = std::pair<uint64,uint32>;
+            std::priority_queue<TEntry,std::vector<TEntry>,std::greater<TEntry>> queue;
+            reference[start] = 0;
+            queue.emplace(0,start);
+            while (!queue.empty())
+                {
+                TEntry e = queue.top();
+                queue.pop();
+                if (e.first != reference[e.second])
+                    continue;
+                auto iter = graph.ArcIterator(e.second,true);
+                TResult error = 0;
+                while (iter.Next(error))
+                    {
+                    uint64 c = e.first + profile_set.Cost(profile_of(iter.Arc()),iter.Cost(),departure_time + uint32(e.first));
+                    if (c < reference[iter.EndNodeIndex()])
+                        {
+                        reference[iter.EndNodeIndex()] = c;
+                        queue.emplace(c,iter.EndNodeIndex());
+                        }
+                    }
+                }
+
+            for (size_t k = 0; k < target.size(); k++)
+                {
+                uint64 found = cost[k] == UINT32_MAX ? UINT64_MAX : cost[k];
+                if (found != reference[target_index[k]] && mismatch_count++ < 5)
+                    printf("departure %u: found %u, reference %llu\n",departure_time,cost[k],(unsigned long long)reference[target_index[k]]);
+                }
+            }
+        }
+
+    // The static graph alone is searched without node costs being looked up for it.
+    CSearchGraph<CBenchmarkGraph> static_graph(graph);
+    TDijkstra<CSearchGraph<CBenchmarkGraph>,CSearchGraph<CBenchmarkGraph>::TNode,uint32,CFourAryHeapOpenSet<CSearchGraph<CBenchmarkGraph>::TNode>> static_dijkstra(static_graph,false,true);
+    for (int q = 0; q < 20; q++)
+        {
+        uint32 start = random() % node_count;
+        uint32 end = random() % node_count;
+        std::vector<CSearchGraph<CBenchmarkGraph>::TNode*> target { static_graph.Node(end) };
+        std::vector<uint32> cost;
+        static_dijkstra.CalculateOneToMany(static_graph.Node(start),target,cost);
+        if (cost[0] != ReferenceCosts(graph,start)[end])
+            mismatch_count++;
+        }
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
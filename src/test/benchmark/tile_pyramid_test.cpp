@@ -0,0 +1,138 @@
+/*
+TILE_PYRAMID_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Checks that CWorkStealingPool runs every task exactly once whatever the number of threads, even when the tasks are uneven,
+and that it stops soon after a task fails. Then renders the tile pyramid of a map's area, or of the area given on the command line,
+to zoom level 10, drawing single tiles and then 4 x 4 metatiles. Both runs must produce the same tiles, each exactly once
+and at the right size, and a tile found empty as part of a metatile must also be found empty by itself. Metatiles must need
+fewer draws. The rates are reported.
+
+Link with the CartoType library:
+
+g++ -std=c++14 -O2 -pthread -I../../main/base tile_pyramid_test.cpp -lcartotype -o tile_pyramid_test
+tile_pyramid_test map.ctm1 font.ttf style.xml [west south east north]
+*/
+
+#include <cartotype_tile_pyramid.h>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <tuple>
+
+using namespace CartoType;
+
+int main(int argc,char** argv)
+    {
+    size_t mismatch_count = 0;
+    for (size_t thread_count : { 1,2,4,7 })
+        {
+        CWorkStealingPool pool(thread_count);
+        const uint64 task_count = 100000;
+        std::vector<std::atomic<int>> run_count(task_count);
+        TResult error = pool.Run(task_count,[&run_count,task_count](size_t,uint64 aIndex)->TResult
+            {
+            run_count[aIndex]++;
+            // The first tenth of the tasks are much slower than the others.
+            if (aIndex < task_count / 10)
+                {
+                volatile double x = 0;
+                for (int k = 0; k < 20000; k++)
+                    x = x + k;
+                }
+            return KErrorNone;
+            });
+        for (const auto& c : run_count)
+            if (c != 1)
+                error = KErrorGeneral;
+        if (error)
+            {
+            printf("%zu threads: tasks not run exactly once\n",thread_count);
+            mismatch_count++;
+            }
+        }
+    CWorkStealingPool pool(3);
+    std::atomic<uint64> started_count(0);
+    if (pool.Run(1000000,[&started_count](size_t,uint64 aIndex)->TResult { started_count++; return aIndex == 500 ? KErrorCancel : KErrorNone; }) != KErrorCancel ||
+        started_count > 500000)
+        {
+        printf("the pool did not stop after an error\n");
+        mismatch_count++;
+        }
+
+    if (argc < 4)
+        {
+        printf("no map given: the tile pyramid was not rendered\n%zu mismatches\n",mismatch_count);
+        return mismatch_count ? 1 : 0;
+        }
+
+    TResult error = KErrorNone;
+    std::shared_ptr<CFrameworkEngine> engine = CFrameworkEngine::New(error,argv[2]);
+    std::shared_ptr<CFrameworkMapDataSet> map_data_set;
+    if (!error)
+        map_data_set = CFrameworkMapDataSet::New(error,*engine,argv[1]);
+    if (error)
+        {
+        printf("cannot load the map or font: error %d\n",int(error));
+        return 1;
+        }
+
+    CTilePyramidRenderer::TParam param;
+    param.iStyleSheetFileName = argv[3];
+    param.iMaxZoom = 10;
+    if (argc >= 8)
+        param.iBounds = TRectFP(atof(argv[4]),atof(argv[5]),atof(argv[6]),atof(argv[7]));
+    std::map<std::tuple<int32,int32,int32>,bool> tile[2];
+    CTilePyramidRenderer::TStats stats[2];
+    for (int run = 0; run < 2; run++)
+        {
+        param.iMetatileSize = run ? 4 : 1;
+        std::unique_ptr<CTilePyramidRenderer> renderer = CTilePyramidRenderer::New(error,engine,map_data_set,param);
+        std::mutex mutex;
+        size_t duplicate_count = 0;
+        size_t wrong_size_count = 0;
+        if (!error)
+            error = renderer->Render([&](int32 aZoom,int32 aX,int32 aY,const TBitmap& aBitmap,bool aEmpty)->TResult
+                {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!tile[run].emplace(std::make_tuple(aZoom,aX,aY),aEmpty).second)
+                    duplicate_count++;
+                if (aBitmap.Width() != param.iTileSize || aBitmap.Height() != param.iTileSize)
+                    wrong_size_count++;
+                return KErrorNone;
+                });
+        if (error)
+            {
+            printf("rendering failed: error %d\n",int(error));
+            return 1;
+            }
+        stats[run] = renderer->Stats();
+        const CTilePyramidRenderer::TStats& s = stats[run];
+        printf("metatile size %d: %llu tiles (%llu empty, %llu of them inherited), %llu draws, %.3fs, %.0f tiles per second\n",
+               param.iMetatileSize,(unsigned long long)s.iTileCount,(unsigned long long)s.iEmptyTileCount,(unsigned long long)s.iInheritedEmptyTileCount,
+               (unsigned long long)s.iDrawCount,s.iSeconds,s.TilesPerSecond());
+        if (duplicate_count || wrong_size_count || s.iTileCount != tile[run].size() || s.iRenderedTileCount + s.iEmptyTileCount != s.iTileCount)
+            {
+            printf("%zu duplicate tiles, %zu tiles of the wrong size\n",duplicate_count,wrong_size_count);
+            mismatch_count++;
+            }
+        }
+    // Emptiness is found for a whole metatile, so a tile empty in a metatile must be empty by itself, but not the other way round.
+    bool same_tiles = tile[0].size() == tile[1].size();
+    for (auto p = tile[0].begin(), q = tile[1].begin(); same_tiles && p != tile[0].end(); ++p, ++q)
+        same_tiles = p->first == q->first && (p->second || !q->second);
+    if (!same_tiles)
+        {
+        printf("single tiles and metatiles give different sets of tiles, or different empty tiles\n");
+        mismatch_count++;
+        }
+    if (stats[1].iRenderedTileCount && stats[1].iDrawCount >= stats[0].iDrawCount)
+        {
+        printf("metatiles did not reduce the number of draws\n");
+        mismatch_count++;
+        }
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
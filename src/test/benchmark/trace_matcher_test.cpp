@@ -0,0 +1,157 @@
+/*
+TRACE_MATCHER_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Matches noisy traces of random walks along a grid of two-way roads, 100 metres apart, in a map whose unit is a 32nd of a metre,
+so that the matcher's conversion of distances from metres to map units is exercised. Half the traces have courses,
+whose fixes must be matched only to the direction of travel. The matched arcs must be contiguous and must follow the true path;
+without courses a few spurious detours, where noise makes an out-and-back along a side road look likely, are allowed.
+The time taken with one thread and with all hardware threads is reported.
+
+g++ -std=c++14 -O2 -pthread -I../../main/base trace_matcher_test.cpp -o trace_matcher_test
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_trace_matcher.h>
+#include <cstdio>
+
+using namespace CartoType;
+
+// Arcs are added in pairs by AddTwoWayArc, so arcs 2N + 1 and 2N + 2 are the two directions of a road.
+class TGridArcTable
+    {
+    public:
+    explicit TGridArcTable(const CBenchmarkGraph& aGraph): iGraph(aGraph) { }
+    uint32 StartNode(uint32 aArc) const { return iGraph.ArcStart(aArc); }
+    uint32 EndNode(uint32 aArc) const { return iGraph.ArcEnd(aArc); }
+    uint32 Length(uint32 aArc) const { return iGraph.ArcCost(aArc); }
+    uint32 ReverseArc(uint32 aArc) const { return aArc % 2 ? aArc + 1 : aArc - 1; }
+    double Fraction(const TRoadSegmentMatch& aMatch) const { return aMatch.iFraction; }
+
+    private:
+    const CBenchmarkGraph& iGraph;
+    };
+
+int main()
+    {
+    const uint32 width = 200;
+    const double point_scale = 1.0 / 32;
+    const int32 spacing = int32(100 / point_scale);
+    auto position = [&](uint32 aNode) { return TPointFP(double(aNode % width) * spacing,double(aNode / width) * spacing); };
+
+    CBenchmarkGraph graph(width * width);
+    std::vector<TRoadSegment> segment;
+    for (uint32 y = 0; y < width; y++)
+        for (uint32 x = 0; x < width; x++)
+            {
+            uint32 n = y * width + x;
+            for (uint32 m : { x + 1 < width ? n + 1 : UINT32_MAX,y + 1 < width ? n + width : UINT32_MAX })
+                {
+                if (m == UINT32_MAX)
+                    continue;
+                uint32 arc = uint32(graph.ArcCount() + 1);
+                graph.AddTwoWayArc(n,m,spacing,spacing);
+                TPointFP a = position(n), b = position(m);
+                segment.push_back(TRoadSegment { int32(a.iX),int32(a.iY),int32(b.iX),int32(b.iY),arc,0,0 });
+                }
+            }
+    CRoadSegmentIndex index;
+    index.Create(segment);
+    TGridArcTable arc_table(graph);
+
+    // Random walks without U-turns, with a fix every 35 metres and a position error of 8 metres.
+    std::mt19937 random(5);
+    std::normal_distribution<double> noise(0,8 / point_scale);
+    std::normal_distribution<double> course_noise(0,10);
+    std::vector<std::vector<TTraceFix>> trace;
+    std::vector<std::vector<uint32>> truth;
+    for (int k = 0; k < 400; k++)
+        {
+        uint32 node = (width / 2) * width + width / 2 + (random() % 50) - 25;
+        std::vector<uint32> path;
+        uint32 prev = 0;
+        for (int s = 0; s < 40; s++)
+            {
+            std::vector<uint32> choice;
+            auto iter = graph.ArcIterator(node,true);
+            TResult error = 0;
+            while (iter.Next(error))
+                if (!prev || iter.Arc() != arc_table.ReverseArc(prev))
+                    choice.push_back(iter.Arc());
+            uint32 arc = choice[random() % choice.size()];
+            path.push_back(arc);
+            prev = arc;
+            node = graph.ArcEnd(arc);
+            }
+
+        const bool with_course = k % 2 != 0;
+        std::vector<TTraceFix> fix;
+        double distance = 5 / point_scale;
+        for (size_t i = 0; i < path.size(); )
+            {
+            TPointFP a = position(graph.ArcStart(path[i])), b = position(graph.ArcEnd(path[i]));
+            double f = distance / spacing;
+            TTraceFix t;
+            t.iPosition = TPointFP(a.iX + (b.iX - a.iX) * f + noise(random),a.iY + (b.iY - a.iY) * f + noise(random));
+            if (with_course)
+                t.iCourse = std::fmod(std::atan2(b.iX - a.iX,b.iY - a.iY) * 180 / 3.14159265358979323846 + 360 + course_noise(random),360);
+            fix.push_back(t);
+            distance += 35 / point_scale;
+            while (distance >= spacing && i < path.size())
+                {
+                distance -= spacing;
+                i++;
+                }
+            }
+        trace.push_back(fix);
+        truth.push_back(path);
+        }
+
+    TTraceMatchParam param;
+    param.iPositionAccuracy = 8;
+    size_t fix_count = 0;
+    for (const auto& t : trace)
+        fix_count += t.size();
+    std::vector<CTraceMatchResult<uint32>> result;
+    for (size_t thread_count : { 1,0 })
+        {
+        param.iThreadCount = thread_count;
+        CStopwatch stopwatch;
+        MatchTraces(graph,arc_table,index,param,point_scale,trace,result);
+        double seconds = stopwatch.Seconds();
+        printf("%zu threads: %.1fms, %.0f fixes per second\n",thread_count,seconds * 1000,fix_count / seconds);
+        }
+
+    // The arcs of the first and last fixes may be partial, so compare the inner arcs with the true path.
+    size_t mismatch_count[2] = { };
+    size_t break_count = 0;
+    size_t wrong_direction_count = 0;
+    for (size_t k = 0; k < result.size(); k++)
+        {
+        const auto& arc = result[k].iArc;
+        break_count += result[k].iBreak.size();
+        bool ok = !result[k].iError;
+        for (size_t i = 1; i < arc.size(); i++)
+            ok &= graph.ArcEnd(arc[i - 1]) == graph.ArcStart(arc[i]);
+        std::vector<uint32> inner(arc.size() > 2 ? arc.begin() + 1 : arc.end(),arc.size() > 2 ? arc.end() - 1 : arc.end());
+        ok &= std::search(truth[k].begin(),truth[k].end(),inner.begin(),inner.end()) != truth[k].end() && inner.size() + 3 >= truth[k].size();
+        if (!ok)
+            mismatch_count[k % 2]++;
+
+        // A fix with a course must never be matched against the direction of travel.
+        for (size_t i = 0; i < trace[k].size(); i++)
+            {
+            const auto& f = result[k].iFix[i];
+            if (trace[k][i].iCourse < 0 || !f.iArc)
+                continue;
+            TPointFP a = position(graph.ArcStart(f.iArc)), b = position(graph.ArcEnd(f.iArc));
+            double course = trace[k][i].iCourse * 3.14159265358979323846 / 180;
+            if ((b.iX - a.iX) * std::sin(course) + (b.iY - a.iY) * std::cos(course) < 0)
+                wrong_direction_count++;
+            }
+        }
+    printf("%zu traces: %zu mismatches without courses, %zu with courses; %zu breaks; %zu fixes matched against their course\n",
+           result.size(),mismatch_count[0],mismatch_count[1],break_count,wrong_direction_count);
+    return mismatch_count[0] > result.size() / 100 || mismatch_count[1] || wrong_direction_count ? 1 : 0;
+    }
@@ -0,0 +1,117 @@
+/*
+TRAFFIC_OVERLAY_TEST.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Applies rounds of random arc cost changes, including forbidden arcs and removed overrides, through a CArcCostOverlay.
+After each round the partially customized contraction hierarchy must equal a full customization,
+and its queries must match Dijkstra searches on the overlay graph. The times of partial and full customization are reported.
+
+g++ -std=c++14 -O2 -pthread -I../../main/base traffic_overlay_test.cpp -o traffic_overlay_test
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_contraction_hierarchy.h>
+#include <cstdio>
+
+using namespace CartoType;
+
+int main()
+    {
+    const uint32 width = 200;
+    const uint32 node_count = width * width;
+    CBenchmarkGraph graph = RenumberNodes(CBenchmarkGraph::Grid(width,width,10,100,7),NestedDissectionOrder(width,width));
+    std::vector<std::pair<uint32,uint32>> edge;
+    for (uint32 arc = 1; arc <= graph.ArcCount(); arc++)
+        edge.emplace_back(graph.ArcStart(arc),graph.ArcEnd(arc));
+    CCustomizableContractionHierarchy hierarchy(node_count,edge);
+
+    CArcCostOverlay<uint32> overlay;
+    TArcCostOverlayGraph<CBenchmarkGraph> overlay_graph(graph,overlay);
+    auto set_input_costs = [&](CContractionHierarchyMetric& aMetric)
+        {
+        aMetric.Init(hierarchy.ArcCount());
+        for (uint32 arc = 1; arc <= graph.ArcCount(); arc++)
+            {
+            uint32 cost = graph.ArcCost(arc);
+            overlay.Find(arc,cost);
+            if (cost != CArcCostOverlay<uint32>::KForbidden)
+                hierarchy.SetArcCost(aMetric,graph.ArcStart(arc),graph.ArcEnd(arc),cost);
+            }
+        };
+
+    CContractionHierarchyMetric input, metric;
+    set_input_costs(input);
+    metric = input;
+    hierarchy.Customize(metric,1);
+
+    using TOverlaySearchGraph = CSearchGraph<TArcCostOverlayGraph<CBenchmarkGraph>>;
+    using TOverlayNode = TOverlaySearchGraph::TNode;
+    using THierarchySearchGraph = CSearchGraph<TContractionHierarchyGraph>;
+    using THierarchyNode = THierarchySearchGraph::TNode;
+
+    std::mt19937 random(7);
+    size_t metric_mismatch_count = 0, query_mismatch_count = 0;
+    for (int round = 0; round < 5; round++)
+        {
+        for (int k = 0; k < 200; k++)
+            {
+            uint32 arc = 1 + random() % uint32(graph.ArcCount());
+            if (random() % 4 == 0)
+                overlay.Remove(arc);
+            else
+                overlay.Set(arc,random() % 10 == 0 ? CArcCostOverlay<uint32>::KForbidden : 10 + random() % 500);
+            }
+        std::vector<uint32> changed_arc;
+        overlay.TakeChangedArcs(changed_arc);
+        std::vector<uint32> changed_hierarchy_arc;
+        for (uint32 arc : changed_arc)
+            changed_hierarchy_arc.push_back(hierarchy.FindArc(graph.ArcStart(arc),graph.ArcEnd(arc)));
+        set_input_costs(input);
+
+        CStopwatch stopwatch;
+        size_t recalculated = hierarchy.CustomizePartially(metric,input,changed_hierarchy_arc);
+        double partial_time = stopwatch.Seconds();
+        CContractionHierarchyMetric full = input;
+        stopwatch.Restart();
+        hierarchy.Customize(full,1);
+        double full_time = stopwatch.Seconds();
+        size_t round_metric_mismatch_count = 0;
+        for (size_t i = 0; i < hierarchy.ArcCount(); i++)
+            if (full.iUpCost[i] != metric.iUpCost[i] || full.iDownCost[i] != metric.iDownCost[i])
+                round_metric_mismatch_count++;
+
+        TOverlaySearchGraph overlay_search_graph(overlay_graph);
+        TDijkstra<TOverlaySearchGraph,TOverlayNode,uint32,CFourAryHeapOpenSet<TOverlayNode>> dijkstra(overlay_search_graph,false,true);
+        TContractionHierarchyGraph hierarchy_graph(hierarchy,metric);
+        THierarchySearchGraph hierarchy_search_graph(hierarchy_graph);
+        size_t round_query_mismatch_count = 0;
+        for (int q = 0; q < 50; q++)
+            {
+            uint32 start = random() % node_count;
+            uint32 end = random() % node_count;
+            std::vector<TOverlayNode*> end_node { overlay_search_graph.Node(end) };
+            std::vector<uint32> cost;
+            dijkstra.CalculateOneToMany(overlay_search_graph.Node(start),end_node,cost);
+
+            const THierarchyNode* middle = nullptr;
+            TDijkstra<THierarchySearchGraph,THierarchyNode,uint32,CFourAryHeapOpenSet<THierarchyNode>>::CalculateRoutesBidirectionally(
+                hierarchy_search_graph,hierarchy_search_graph.Node(start,true),hierarchy_search_graph.Node(end,false),middle);
+            uint32 hierarchy_cost = UINT32_MAX;
+            if (middle)
+                {
+                uint32 m = hierarchy_search_graph.NodeIndex(middle);
+                hierarchy_cost = hierarchy_search_graph.NodeCostInQuery(hierarchy_search_graph.Node(m,true),true) +
+                                 hierarchy_search_graph.NodeCostInQuery(hierarchy_search_graph.Node(m,true),false);
+                }
+            if (hierarchy_cost != cost[0])
+                round_query_mismatch_count++;
+            }
+
+        printf("round %d: %zu overrides; recalculated %zu of %u arcs; partial %.5fs, full %.5fs; %zu metric mismatches, %zu query mismatches\n",
+               round,overlay.Count(),recalculated,hierarchy.ArcCount(),partial_time,full_time,round_metric_mismatch_count,round_query_mismatch_count);
+        metric_mismatch_count += round_metric_mismatch_count;
+        query_mismatch_count += round_query_mismatch_count;
+        }
+    return metric_mismatch_count || query_mismatch_count ? 1 : 0;
+    }
@@ -0,0 +1,96 @@
+/*
+TRAVEL_TIME_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Compares one-to-all travel times calculated by CTravelTimeSweep, using PHAST on a customized contraction hierarchy,
+with those from CalculateTravelTimes, a Dijkstra search, on a 400 by 400 grid with random asymmetric costs, in both directions.
+The times for a Dijkstra search and for batches of 1 to 32 sources in a sweep are reported, and a travel time table
+is made from the costs of one source.
+
+g++ -std=c++14 -O2 -pthread -I../../main/base travel_time_benchmark.cpp -o travel_time_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_travel_time.h>
+#include <cstdio>
+
+using namespace CartoType;
+
+int main()
+    {
+    const uint32 width = 400;
+    const uint32 node_count = width * width;
+    const std::vector<uint32> rank = NestedDissectionOrder(width,width);
+    CBenchmarkGraph graph = RenumberNodes(CBenchmarkGraph::Grid(width,width,1,100,5),rank);
+    std::vector<uint32> grid_node(node_count);
+    for (uint32 i = 0; i < node_count; i++)
+        grid_node[rank[i]] = i;
+
+    std::vector<std::pair<uint32,uint32>> edge;
+    for (uint32 arc = 1; arc <= graph.ArcCount(); arc++)
+        edge.emplace_back(graph.ArcStart(arc),graph.ArcEnd(arc));
+    CStopwatch stopwatch;
+    CCustomizableContractionHierarchy hierarchy(node_count,edge);
+    CContractionHierarchyMetric metric;
+    metric.Init(hierarchy.ArcCount());
+    for (uint32 arc = 1; arc <= graph.ArcCount(); arc++)
+        hierarchy.SetArcCost(metric,graph.ArcStart(arc),graph.ArcEnd(arc),graph.ArcCost(arc));
+    hierarchy.Customize(metric,0);
+    printf("%u nodes; hierarchy of %u arcs built and customized in %.2fs\n",node_count,hierarchy.ArcCount(),stopwatch.Seconds());
+
+    CTravelTimeSweep sweep(hierarchy,metric);
+    std::mt19937 random(5);
+    size_t mismatch_count = 0;
+    for (bool forwards : { true,false })
+        {
+        std::vector<uint32> source;
+        for (int i = 0; i < 4; i++)
+            source.push_back(random() % node_count);
+        std::vector<uint32> sweep_cost;
+        sweep.Calculate(source,forwards,sweep_cost);
+        for (size_t i = 0; i < source.size(); i++)
+            {
+            std::vector<uint32> cost;
+            CalculateTravelTimes(graph,source[i],forwards,UINT32_MAX,cost);
+            for (uint32 n = 0; n < node_count; n++)
+                if (cost[n] != sweep_cost[size_t(n) * source.size() + i])
+                    mismatch_count++;
+            }
+        }
+
+    std::vector<uint32> cost;
+    const int dijkstra_count = 8;
+    stopwatch.Restart();
+    for (int i = 0; i < dijkstra_count; i++)
+        CalculateTravelTimes(graph,random() % node_count,true,UINT32_MAX,cost);
+    const double dijkstra_time = stopwatch.Seconds() / dijkstra_count;
+    printf("Dijkstra: %.1fms per source\n",dijkstra_time * 1000);
+    for (size_t source_count : { 1,4,8,16,32 })
+        {
+        std::vector<uint32> source;
+        for (size_t i = 0; i < source_count; i++)
+            source.push_back(random() % node_count);
+        const int repeat_count = 4;
+        stopwatch.Restart();
+        for (int r = 0; r < repeat_count; r++)
+            sweep.Calculate(source,true,cost);
+        const double time = stopwatch.Seconds() / repeat_count;
+        printf("PHAST, %zu sources: %.1fms per batch, %.2fms per source (%.1fx faster than Dijkstra)\n",
+               source_count,time * 1000,time * 1000 / source_count,dijkstra_time * source_count / time);
+        }
+
+    // A table of the nodes within a cost of 3000 of one corner must have a row for each such node.
+    CTravelTimeTable table;
+    sweep.Calculate({ rank[0] },true,cost);
+    table.Append(cost.data(),node_count,1,3000,[&grid_node](uint32 aNode) { return TPoint(int32(grid_node[aNode] % width),int32(grid_node[aNode] / width)); });
+    size_t expected_count = 0;
+    for (uint32 c : cost)
+        expected_count += c < 3000;
+    printf("travel time table: %zu rows\n",table.Count());
+    if (table.Count() != expected_count || !table.Count())
+        mismatch_count++;
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }
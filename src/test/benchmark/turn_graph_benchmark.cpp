@@ -0,0 +1,200 @@
+/*
+TURN_GRAPH_BENCHMARK.CPP
+Copyright (C) 2019 CartoType Ltd.
+See www.cartotype.com for more information.
+
+Builds a CCompressedTurnGraph of a 400 by 400 grid with some missing arcs and random turn restrictions, and compares
+its size, and the costs and times of one-to-all searches, with those of an explicitly expanded turn graph.
+The searches use a copy attached from the written data. A graph moved from the created one must give the same costs,
+and the graph it was moved from must be empty.
+
+g++ -std=c++14 -O2 -I../../main/base turn_graph_benchmark.cpp -o turn_graph_benchmark
+*/
+
+#include "benchmark_graph.h"
+#include <cartotype_turn_graph.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace CartoType;
+
+class CMemoryOutput: public MOutputStream
+    {
+    public:
+    TResult Write(const uint8* aBuffer,size_t aLength) override
+        {
+        iData.insert(iData.end(),aBuffer,aBuffer + aLength);
+        return KErrorNone;
+        }
+
+    std::vector<uint8> iData;
+    };
+
+// A turn graph with an arc for every allowed turn, as a static graph for CSearchGraph.
+class CExpandedTurnGraph
+    {
+    public:
+    using TArcRef = uint32;
+
+    class TArcIterator
+        {
+        public:
+        TArcIterator(const std::pair<uint32,uint32>* aBegin,const std::pair<uint32,uint32>* aEnd): iTurn(aBegin - 1), iEnd(aEnd) { }
+        bool Next(TResult&) { return ++iTurn < iEnd; }
+        uint32 Arc() const { return iTurn->first + 1; }
+        uint32 Cost() const { return iTurn->second; }
+        uint32 EndNodeIndex() const { return iTurn->first; }
+
+        private:
+        const std::pair<uint32,uint32>* iTurn;
+        const std::pair<uint32,uint32>* iEnd;
+        };
+
+    size_t NodeCount() const { return iFirstOut.size() - 1; }
+    TArcIterator ArcIterator(uint32 aNode,bool aOutgoing) const
+        {
+        const auto& first = aOutgoing ? iFirstOut : iFirstIn;
+        const auto& turn = aOutgoing ? iOut : iIn;
+        return TArcIterator(turn.data() + first[aNode],turn.data() + first[aNode + 1]);
+        }
+
+    std::vector<uint32> iFirstOut;
+    std::vector<uint32> iFirstIn;
+    std::vector<std::pair<uint32,uint32>> iOut; // the arc after the turn and the cost
+    std::vector<std::pair<uint32,uint32>> iIn;  // the arc before the turn and the cost
+    };
+
+template<class TGraph> static std::vector<uint32> TurnCosts(const TGraph& aGraph,uint32 aStart,bool aForward)
+    {
+    using TSearchGraph = CSearchGraph<TGraph>;
+    using TNode = typename TSearchGraph::TNode;
+    TSearchGraph search_graph(aGraph);
+    std::vector<uint32> cost(aGraph.NodeCount(),UINT32_MAX);
+    TDijkstra<TSearchGraph,TNode,uint32,CRadixHeapOpenSet<TNode>> dijkstra(search_graph,false,aForward);
+    dijkstra.CalculateSettledNodes(search_graph.Node(aStart,aForward),UINT32_MAX,[&](const TNode* aNode,uint32 aCost)
+        {
+        cost[search_graph.NodeIndex(aNode)] = aCost;
+        return true;
+        });
+    return cost;
+    }
+
+int main()
+    {
+    const int width = 400;
+    const int height = 400;
+    std::mt19937 random(7);
+    const double pi = 3.14159265358979323846;
+    auto bearing = [pi](int aDx,int aDy) { return uint8(int(std::lround(std::atan2(aDx,aDy) * 128 / pi)) & 255); };
+    std::vector<TTurnGraphArc> arc;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            for (const auto& d : { std::make_pair(1,0),std::make_pair(-1,0),std::make_pair(0,1),std::make_pair(0,-1) })
+                {
+                const int end_x = x + d.first, end_y = y + d.second;
+                if (end_x < 0 || end_y < 0 || end_x >= width || end_y >= height || random() % 10 == 0)
+                    continue;
+                TTurnGraphArc a;
+                a.iStartNode = uint32(y * width + x);
+                a.iEndNode = uint32(end_y * width + end_x);
+                a.iCost = 50 + random() % 400;
+                a.iStartBearing = a.iEndBearing = bearing(d.first,d.second);
+                arc.push_back(a);
+                }
+    const uint32 node_count = width * height;
+    std::vector<uint32> first(node_count + 1);
+    for (const auto& a : arc)
+        first[a.iStartNode + 1]++;
+    for (uint32 i = 0; i < node_count; i++)
+        first[i + 1] += first[i];
+    std::vector<TTurnRestriction> restriction;
+    for (uint32 i = 0; i < arc.size(); i++)
+        {
+        const uint32 v = arc[i].iEndNode;
+        if (random() % 50 || first[v] == first[v + 1])
+            continue;
+        TTurnRestriction r;
+        r.iFromArc = i;
+        r.iToArc = first[v] + random() % (first[v + 1] - first[v]);
+        r.iMandatory = random() % 4 == 0;
+        restriction.push_back(r);
+        }
+
+    CCompressedTurnGraph graph;
+    CStopwatch stopwatch;
+    TResult error = graph.Create(node_count,arc,restriction);
+    TTurnCosts turn_costs;
+    turn_costs.iTurnCost = 40;
+    turn_costs.iUTurnCost = 3000;
+    turn_costs.iCrossTrafficTurnCost = 80;
+    graph.SetTurnCosts(turn_costs);
+    printf("created in %.2fs: %u road nodes, %u arcs, %u prohibited turns, %.2f bytes per arc\n",
+           stopwatch.Seconds(),graph.RoadNodeCount(),graph.ArcCount(),graph.ProhibitedTurnCount(),double(graph.ByteCount()) / graph.ArcCount());
+
+    CMemoryOutput output;
+    graph.Write(output);
+    std::vector<uint32> aligned((output.iData.size() + 3) / 4);
+    std::memcpy(aligned.data(),output.iData.data(),output.iData.size());
+    CCompressedTurnGraph attached;
+    if (!error)
+        error = attached.Attach(reinterpret_cast<const uint8*>(aligned.data()),output.iData.size());
+    attached.SetTurnCosts(turn_costs);
+
+    CExpandedTurnGraph expanded;
+    std::vector<std::vector<std::pair<uint32,uint32>>> incoming(arc.size());
+    expanded.iFirstOut.push_back(0);
+    for (uint32 a = 0; a < arc.size(); a++)
+        {
+        const uint32 v = arc[a].iEndNode;
+        for (uint32 b = first[v]; b < first[v + 1]; b++)
+            {
+            if (graph.IsProhibited(a,b))
+                continue;
+            const uint32 cost = arc[b].iCost + graph.TurnCost(arc[a].iEndBearing,arc[b].iStartBearing);
+            expanded.iOut.emplace_back(b,cost);
+            incoming[b].emplace_back(a,cost);
+            }
+        expanded.iFirstOut.push_back(uint32(expanded.iOut.size()));
+        }
+    expanded.iFirstIn.push_back(0);
+    for (const auto& turn : incoming)
+        {
+        expanded.iIn.insert(expanded.iIn.end(),turn.begin(),turn.end());
+        expanded.iFirstIn.push_back(uint32(expanded.iIn.size()));
+        }
+    const size_t expanded_bytes = (expanded.iFirstOut.size() + expanded.iFirstIn.size()) * sizeof(uint32) + (expanded.iOut.size() + expanded.iIn.size()) * 8;
+    const size_t node_based_bytes = (size_t(node_count) + 1) * sizeof(uint32) * 2 + arc.size() * 8 * 2;
+    printf("%.2f turns per arc; expanded graph %.2f bytes per arc; node-based graph %.2f bytes per arc\n",
+           double(expanded.iOut.size()) / arc.size(),double(expanded_bytes) / arc.size(),double(node_based_bytes) / arc.size());
+
+    size_t mismatch_count = error ? 1 : 0;
+    double compressed_time = 0;
+    double expanded_time = 0;
+    const int query_count = 20;
+    for (int q = 0; q < query_count && !error; q++)
+        {
+        const uint32 start = random() % arc.size();
+        const bool forward = q % 2 == 0;
+        stopwatch.Restart();
+        std::vector<uint32> compressed_cost = TurnCosts(attached,start,forward);
+        compressed_time += stopwatch.Seconds();
+        stopwatch.Restart();
+        std::vector<uint32> expanded_cost = TurnCosts(expanded,start,forward);
+        expanded_time += stopwatch.Seconds();
+        if (compressed_cost != expanded_cost)
+            mismatch_count++;
+        }
+    printf("one-to-all search: compressed %.1fms, expanded %.1fms\n",compressed_time / query_count * 1000,expanded_time / query_count * 1000);
+
+    // A moved graph keeps its data; the graph it was moved from is left empty.
+    std::vector<uint32> created_cost = TurnCosts(graph,7,true);
+    CCompressedTurnGraph moved(std::move(graph));
+    CCompressedTurnGraph assigned;
+    assigned = std::move(moved);
+    if (TurnCosts(assigned,7,true) != created_cost || assigned.TurnCosts().iUTurnCost != 3000 || graph.ByteCount() || moved.ByteCount())
+        mismatch_count++;
+
+    printf("%zu mismatches\n",mismatch_count);
+    return mismatch_count ? 1 : 0;
+    }